@@ -1,6 +1,7 @@
 import Anthropic from '@anthropic-ai/sdk'
 import WebSocket from 'ws'
-import { Canvas } from './canvas'
+import { Canvas, CanvasView } from './canvas'
+import { AppRegistry } from './registry'
 import { toolDefinitions } from './tools'
 import { BusEvent, CanvasElement, InstalledApp, WSMessage } from './types'
 
@@ -10,18 +11,23 @@ const SERVICE_PORTS: Record<string, number> = {
   agent: 7702,
 }
 
-async function fetchApps(): Promise<InstalledApp[]> {
-  try {
-    const res = await fetch('http://localhost:7701/apps')
-    return await res.json() as InstalledApp[]
-  } catch {
-    return []
-  }
+const HISTORY_TOKENS   = 40_000   // context size past which the conversation starts over
+const TOOL_CONCURRENCY = 4        // tool calls of one turn run at once
+
+export const registry = new AppRegistry()
+
+// buildSystemPrompt() output for registry.version — rebuilt only when the apps change
+let promptCache: { version: number; text: string } | null = null
+
+function systemPrompt(): string {
+  if (promptCache?.version !== registry.version)
+    promptCache = { version: registry.version, text: buildSystemPrompt(registry.apps) }
+  return promptCache.text
 }
 
-function appPort(appId: string, apps: InstalledApp[]): number {
+function appPort(appId: string): number {
   if (SERVICE_PORTS[appId]) return SERVICE_PORTS[appId]
-  return apps.find(a => a.id === appId)?.port ?? 3000
+  return registry.find(appId)?.port ?? 3000
 }
 
 function buildSystemPrompt(apps: InstalledApp[]): string {
@@ -50,102 +56,223 @@ Behaviour:
 - On app_icon.clicked: render the app's default window next to the icon
 - On cursor.input: interpret naturally — open apps, answer questions, rearrange canvas, call APIs
 - On button.clicked or api events: decide whether to respond or stay silent
-- Only respond when you have something useful to do — silence is fine`
+- Only respond when you have something useful to do — silence is fine
+
+Each event comes with the canvas: all of it the first time, then only the elements changed or removed since you last saw it.`
+}
+
+type Session = {
+  history: Anthropic.MessageParam[]   // every event's turns since the last reset
+  view:    CanvasView
+  queue:   Promise<void>              // events run one at a time, in order
 }
 
-export async function handleEvent(
+const sessions = new WeakMap<Canvas, Session>()
+
+/**
+ * Run the agent on one event. Events on the same canvas share a conversation,
+ * so each one sends only the canvas changes since the model's last view;
+ * the conversation starts over once it passes HISTORY_TOKENS.
+ */
+export function handleEvent(
   event: BusEvent,
   canvas: Canvas,
   ws: WebSocket | null,
   apiKey: string,
 ): Promise<void> {
-  const apps  = await fetchApps()
-  const model = process.env.CLAUDE_MODEL || 'claude-haiku-4-5-20251001'
-
-  const client = new Anthropic({ apiKey })
-
-  const canvasJson = JSON.stringify(canvas.getState(), null, 2)
-  const userMsg    = `Canvas:\n${canvasJson}\n\nEvent: ${JSON.stringify(event)}`
-
-  const messages: Anthropic.MessageParam[] = [
-    { role: 'user', content: userMsg },
-  ]
-
-  // Agentic loop — keep going until Claude stops calling tools
-  while (true) {
-    const response = await client.messages.create({
-      model,
-      max_tokens: 2048,
-      system:     buildSystemPrompt(apps),
-      tools:      toolDefinitions,
-      messages,
-    })
-
-    const toolUses = response.content.filter(b => b.type === 'tool_use')
-    if (toolUses.length === 0) break
-
-    const toolResults: Anthropic.ToolResultBlockParam[] = []
-
-    for (const block of response.content) {
-      if (block.type !== 'tool_use') continue
-
-      const input = block.input as Record<string, unknown>
-      let   result: unknown = { ok: true }
-
-      switch (block.name) {
-        case 'render': {
-          const el = input as unknown as CanvasElement
-          canvas.render(el)
-          send(ws, { op: 'render', element: el })
-          break
-        }
-
-        case 'remove': {
-          const id = input.id as string
-          canvas.remove(id)
-          send(ws, { op: 'remove', id })
-          break
-        }
-
-        case 'call_api': {
-          try {
-            const port = appPort(input.app as string, apps)
-            const url  = `http://localhost:${port}${input.endpoint as string}`
-            const res  = await fetch(url, {
-              method:  input.method as string,
-              headers: { 'Content-Type': 'application/json' },
-              body:    input.body ? JSON.stringify(input.body) : undefined,
-            })
-            result = await res.json()
-          } catch (e: unknown) {
-            result = { error: String(e) }
-          }
-          break
-        }
-
-        case 'show_cursor_response': {
-          send(ws, {
-            op:       'cursor_response',
-            text:     input.text as string | undefined,
-            pills:    input.pills as string[] | undefined,
-            position: input.position as { x: number; y: number },
-          })
-          break
-        }
-      }
+  let session = sessions.get(canvas)
+  if (!session) {
+    session = { history: [], view: new CanvasView(), queue: Promise.resolve() }
+    sessions.set(canvas, session)
+  }
+  const run = session.queue.then(() => runEvent(event, canvas, session!, ws, apiKey))
+  session.queue = run.catch(() => {})
+  return run
+}
 
-      toolResults.push({
+async function runEvent(
+  event: BusEvent,
+  canvas: Canvas,
+  session: Session,
+  ws: WebSocket | null,
+  apiKey: string,
+): Promise<void> {
+  const started = Date.now()
+  await registry.ready()
+  const model    = process.env.CLAUDE_MODEL || 'claude-haiku-4-5-20251001'
+  const client   = anthropic(apiKey)
+  const messages = session.history
+  const usage    = { calls: 0, input: 0, cacheRead: 0, cacheWrite: 0, output: 0, modelMs: 0, context: 0 }
+
+  const text: Anthropic.TextBlockParam = {
+    type: 'text',
+    text: `${session.view.encode(canvas.getState())}\nEvent: ${JSON.stringify(event)}`,
+  }
+  // A turn cut off after its tool calls leaves the tool results last
+  const last = messages[messages.length - 1]
+  if (last?.role === 'user' && Array.isArray(last.content)) last.content.push(text)
+  else messages.push({ role: 'user', content: [text] })
+
+  try {
+    // Agentic loop — keep going until Claude stops calling tools
+    while (true) {
+      const callStarted = Date.now()
+      const response = await client.messages.create({
+        model,
+        max_tokens: 2048,
+        system:     [{ type: 'text', text: systemPrompt(), cache_control: EPHEMERAL }],
+        tools:      cachedTools,
+        messages:   markLast(messages),
+      })
+      usage.calls++
+      usage.modelMs    += Date.now() - callStarted
+      usage.input      += response.usage.input_tokens
+      usage.cacheRead  += response.usage.cache_read_input_tokens ?? 0
+      usage.cacheWrite += response.usage.cache_creation_input_tokens ?? 0
+      usage.output     += response.usage.output_tokens
+      usage.context     = response.usage.input_tokens +
+                          (response.usage.cache_read_input_tokens ?? 0) +
+                          (response.usage.cache_creation_input_tokens ?? 0)
+
+      messages.push({ role: 'assistant', content: response.content })
+
+      const toolUses = response.content.filter((b): b is Anthropic.ToolUseBlock => b.type === 'tool_use')
+      if (toolUses.length === 0) break
+
+      // Run the turn's tools side by side; the browser gets their canvas ops in one frame
+      const frame:   WSMessage[] = []
+      const results = await mapLimit(toolUses, TOOL_CONCURRENCY, block => runTool(block, canvas, session.view, frame))
+      sendFrame(ws, frame)
+
+      const toolResults: Anthropic.ToolResultBlockParam[] = toolUses.map((block, i) => ({
         type:        'tool_result',
         tool_use_id: block.id,
-        content:     JSON.stringify(result),
+        content:     JSON.stringify(results[i]),
+      }))
+
+      messages.push({ role: 'user', content: toolResults })
+
+      if (response.stop_reason !== 'tool_use') break
+    }
+  } catch (e) {
+    // The history may now end mid-turn; start the next event from scratch
+    resetSession(session)
+    throw e
+  } finally {
+    console.log(`agent: ${event.type} in ${Date.now() - started} ms (${usage.modelMs} ms model, ` +
+                `${usage.calls} calls) tokens in=${usage.input} cache_read=${usage.cacheRead} ` +
+                `cache_write=${usage.cacheWrite} out=${usage.output}`)
+  }
+
+  if (usage.context > HISTORY_TOKENS) resetSession(session)
+}
+
+// One tool call. Canvas ops are applied and queued before the first await, so
+// they keep the model's order even while call_api requests overlap.
+async function runTool(
+  block: Anthropic.ToolUseBlock,
+  canvas: Canvas,
+  view: CanvasView,
+  frame: WSMessage[],
+): Promise<unknown> {
+  const input = block.input as Record<string, unknown>
+  let   result: unknown = { ok: true }
+
+  switch (block.name) {
+    case 'render': {
+      const el = input as unknown as CanvasElement
+      canvas.render(el)
+      view.render(el)
+      frame.push({ op: 'render', element: el })
+      break
+    }
+
+    case 'remove': {
+      const id = input.id as string
+      canvas.remove(id)
+      view.remove(id)
+      frame.push({ op: 'remove', id })
+      break
+    }
+
+    case 'call_api': {
+      try {
+        const port = appPort(input.app as string)
+        const url  = `http://localhost:${port}${input.endpoint as string}`
+        const res  = await fetch(url, {
+          method:  input.method as string,
+          headers: { 'Content-Type': 'application/json' },
+          body:    input.body ? JSON.stringify(input.body) : undefined,
+        })
+        result = await res.json()
+      } catch (e: unknown) {
+        result = { error: String(e) }
+      }
+      break
+    }
+
+    case 'show_cursor_response': {
+      frame.push({
+        op:       'cursor_response',
+        text:     input.text as string | undefined,
+        pills:    input.pills as string[] | undefined,
+        position: input.position as { x: number; y: number },
       })
+      break
     }
+  }
 
-    messages.push({ role: 'assistant', content: response.content })
-    messages.push({ role: 'user',      content: toolResults })
+  return result
+}
 
-    if (response.stop_reason !== 'tool_use') break
+// fn over items with at most limit calls in flight, started in order; results keep the items' order
+async function mapLimit<T, R>(items: T[], limit: number, fn: (item: T) => Promise<R>): Promise<R[]> {
+  const results = new Array<R>(items.length)
+  let   next    = 0
+  const worker  = async () => {
+    while (next < items.length) {
+      const i = next++
+      results[i] = await fn(items[i])
+    }
   }
+  await Promise.all(Array.from({ length: Math.min(limit, items.length) }, worker))
+  return results
+}
+
+function resetSession(session: Session): void {
+  session.history = []
+  session.view.reset()
+}
+
+// The stable prefix — tools, then the system prompt — is cached provider-side.
+// The third breakpoint, on the newest message, caches the conversation so far.
+const EPHEMERAL: Anthropic.CacheControlEphemeral = { type: 'ephemeral' }
+
+const cachedTools: Anthropic.Tool[] = toolDefinitions.map((t, i) =>
+  i === toolDefinitions.length - 1 ? { ...t, cache_control: EPHEMERAL } : t)
+
+// A copy of messages with a cache breakpoint on the last block; the history itself stays unmarked
+function markLast(messages: Anthropic.MessageParam[]): Anthropic.MessageParam[] {
+  const last = messages[messages.length - 1]
+  if (!Array.isArray(last.content) || !last.content.length) return messages
+
+  const blocks = last.content as (Anthropic.TextBlockParam | Anthropic.ToolResultBlockParam)[]
+  const marked = blocks.map((b, i) => i === blocks.length - 1 ? { ...b, cache_control: EPHEMERAL } : b)
+  return [...messages.slice(0, -1), { ...last, content: marked }]
+}
+
+// One client per key, so its connections are reused across events
+let clientCache: { apiKey: string; client: Anthropic } | null = null
+
+function anthropic(apiKey: string): Anthropic {
+  if (clientCache?.apiKey !== apiKey) clientCache = { apiKey, client: new Anthropic({ apiKey }) }
+  return clientCache.client
+}
+
+// A turn's ops as one message, so the browser lays them out in a single pass
+function sendFrame(ws: WebSocket | null, ops: WSMessage[]): void {
+  if (ops.length === 0) return
+  send(ws, ops.length === 1 ? ops[0] : { op: 'batch', ops })
 }
 
 function send(ws: WebSocket | null, msg: WSMessage): void {
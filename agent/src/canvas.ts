@@ -24,3 +24,47 @@ export class Canvas {
     this.elements.clear()
   }
 }
+
+/**
+ * What the model last saw of a canvas: the elements it was sent plus the
+ * ones it rendered or removed itself. encode() returns the whole canvas the
+ * first time and only the differences after that, as compact JSON.
+ */
+export class CanvasView {
+  private seen = new Map<string, string>()   // id → element JSON
+  private fresh = true
+
+  encode(state: CanvasElement[]): string {
+    const full    = this.fresh
+    const changed: CanvasElement[] = []
+    const ids     = new Set<string>()
+
+    for (const el of state) {
+      const json = JSON.stringify(el)
+      ids.add(el.id)
+      if (this.seen.get(el.id) !== json) changed.push(el)
+      this.seen.set(el.id, json)
+    }
+    const removed = [...this.seen.keys()].filter(id => !ids.has(id))
+    for (const id of removed) this.seen.delete(id)
+    this.fresh = false
+
+    if (full)                               return `Canvas: ${JSON.stringify(state)}`
+    if (!changed.length && !removed.length) return 'Canvas: unchanged'
+    return `Canvas changes: ${JSON.stringify({ changed, removed })}`
+  }
+
+  render(el: CanvasElement): void {
+    this.seen.set(el.id, JSON.stringify(el))
+  }
+
+  remove(id: string): void {
+    this.seen.delete(id)
+  }
+
+  /** Forget everything, so the next encode() sends the whole canvas */
+  reset(): void {
+    this.seen.clear()
+    this.fresh = true
+  }
+}
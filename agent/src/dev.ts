@@ -9,6 +9,10 @@
  *
  * Usage:
  *   ANTHROPIC_API_KEY=sk-... npm run dev
+ *
+ * ANTHROPIC_BASE_URL=http://localhost:<port> points the agent at a mock
+ * Messages API instead; each event logs its latency and token counts
+ * (input, cache reads and writes, output) for comparing runs.
  */
 
 import express from 'express'
@@ -18,7 +22,7 @@ import { createServer as createHttpServer } from 'http'
 import { readFileSync, readdirSync } from 'fs'
 import { join, resolve } from 'path'
 import { Canvas }      from './canvas'
-import { handleEvent } from './agent'
+import { handleEvent, registry } from './agent'
 import { BusEvent }    from './types'
 
 const PORT     = 7702
@@ -36,19 +40,23 @@ function localApps() {
       try {
         const raw = readFileSync(join(APPS_DIR, entry.name, 'crimata.json'), 'utf8')
         const m   = JSON.parse(raw)
-        apps.push({ running: true, ...m })
+        apps.push({ running: true, ready: true, probeMs: null, ...m })
       } catch { /* skip malformed manifests */ }
     }
   } catch { /* apps dir missing */ }
   return apps
 }
 
-/* ── Mock dock on :7701 so agent's fetchApps() works ─────────────────────── */
+/* ── Mock dock on :7701 for the agent's app registry ─────────────────────── */
 
+// No /apps/events here, so the registry re-reads /apps on its reconnect
+// backoff (up to 30 s) — restart dev to pick up a manifest edit sooner
 const dockApp = express()
 dockApp.get('/apps', (_req, res) => res.json(localApps()))
-createHttpServer(dockApp).listen(7701, () =>
-  console.log('  mock dock      → :7701'))
+createHttpServer(dockApp).listen(7701, () => {
+  console.log('  mock dock      → :7701')
+  registry.start()
+})
 
 /* ── Main dev server on :7702 ────────────────────────────────────────────── */
 
@@ -2,7 +2,7 @@ import express from 'express'
 import { WebSocketServer, WebSocket } from 'ws'
 import { createServer } from 'http'
 import { Canvas } from './canvas'
-import { handleEvent } from './agent'
+import { handleEvent, registry } from './agent'
 import { BusEvent } from './types'
 
 const PORT    = 7702
@@ -55,6 +55,9 @@ wss.on('connection', (ws) => {
   })
 })
 
+// Load the apps now rather than on the first event
+registry.start()
+
 server.listen(PORT, () => {
   console.log(`crimata-agent listening on :${PORT}`)
 })
@@ -0,0 +1,144 @@
+import { InstalledApp } from './types'
+
+const DOCK_URL      = 'http://localhost:7701'
+const RETRY_MIN_MS  = 1_000
+const RETRY_MAX_MS  = 30_000
+const STALL_MS      = 60_000   // the dock pings every 25 s, so a silent stream is dead
+
+/**
+ * The dock's app list, kept in memory so events never wait on the dock.
+ *
+ * Loaded once at start, then re-read (with If-None-Match, so usually a 304)
+ * whenever /apps/events reports a change. While the event stream is down the
+ * registry reconnects with backoff and re-reads on every attempt, which also
+ * covers a dock without /apps/events, such as the dev mock.
+ */
+export class AppRegistry {
+  private list:       InstalledApp[] = []
+  private etag:       string | null  = null
+  private rev         = 0
+  private loaded:     Promise<void> | null = null
+  private refreshing: Promise<void> | null = null
+  private again       = false
+  private lastEventId: string | null = null
+  private retryMs     = RETRY_MIN_MS
+
+  /** Load the apps and follow the dock's events; later calls do nothing */
+  start(): void {
+    if (this.loaded) return
+    this.loaded = this.refresh()
+    void this.follow()
+  }
+
+  /** Resolves once the first load has been tried, whether or not the dock answered */
+  ready(): Promise<void> {
+    this.start()
+    return this.loaded as Promise<void>
+  }
+
+  get apps(): InstalledApp[] {
+    return this.list
+  }
+
+  /** Bumped whenever the app list changes — lets callers memoize what they derive from it */
+  get version(): number {
+    return this.rev
+  }
+
+  find(id: string): InstalledApp | undefined {
+    return this.list.find(a => a.id === id)
+  }
+
+  /** Re-read /apps; concurrent calls share one request, plus one more if asked for meanwhile */
+  refresh(): Promise<void> {
+    if (this.refreshing) {
+      this.again = true
+      return this.refreshing
+    }
+    this.refreshing = (async () => {
+      do {
+        this.again = false
+        await this.load()
+      } while (this.again)
+      this.refreshing = null
+    })()
+    return this.refreshing
+  }
+
+  private async load(): Promise<void> {
+    try {
+      const headers: Record<string, string> = this.etag ? { 'If-None-Match': this.etag } : {}
+      const res = await fetch(`${DOCK_URL}/apps`, { headers })
+      if (res.status === 304) return
+      if (!res.ok) throw new Error(`GET /apps: ${res.status}`)
+
+      this.list = await res.json() as InstalledApp[]
+      this.etag = res.headers.get('etag')
+      this.rev++
+    } catch (e) {
+      // Keep serving the last list; the event stream's reconnect retries
+      console.error('app registry:', String(e))
+    }
+  }
+
+  /* ── /apps/events ──────────────────────────────────────────────────────── */
+
+  private async follow(): Promise<never> {
+    for (;;) {
+      try {
+        await this.stream()
+      } catch { /* dock down or restarting */ }
+      await sleep(this.retryMs)
+      this.retryMs = Math.min(this.retryMs * 2, RETRY_MAX_MS)
+      await this.refresh()
+    }
+  }
+
+  private async stream(): Promise<void> {
+    const abort   = new AbortController()
+    const headers: Record<string, string> = { Accept: 'text/event-stream' }
+    if (this.lastEventId) headers['Last-Event-ID'] = this.lastEventId
+
+    let stall = setTimeout(() => abort.abort(), STALL_MS)
+    try {
+      const res = await fetch(`${DOCK_URL}/apps/events`, { headers, signal: abort.signal })
+      if (!res.ok || !res.body) return
+      this.retryMs = RETRY_MIN_MS
+
+      const reader  = res.body.getReader()
+      const decoder = new TextDecoder()
+      let   buf     = ''
+      for (;;) {
+        const { done, value } = await reader.read()
+        if (done) return
+        clearTimeout(stall)
+        stall = setTimeout(() => abort.abort(), STALL_MS)
+
+        buf += decoder.decode(value, { stream: true })
+        let end: number
+        while ((end = buf.indexOf('\n\n')) >= 0) {
+          this.onFrame(buf.slice(0, end))
+          buf = buf.slice(end + 2)
+        }
+      }
+    } finally {
+      clearTimeout(stall)
+    }
+  }
+
+  // Every event (installed, removed, a unit state change or resync) can change
+  // /apps, so any of them triggers a refresh; ": ping" comments don't
+  private onFrame(frame: string): void {
+    let isEvent = false
+    for (const line of frame.split('\n')) {
+      if (line.startsWith('id:'))         this.lastEventId = line.slice(3).trim()
+      else if (line.startsWith('event:')) isEvent = true
+      else if (line.startsWith('data:'))  isEvent = true
+    }
+    if (isEvent) void this.refresh()
+  }
+}
+
+function sleep(ms: number): Promise<void> {
+  return new Promise(resolve => setTimeout(resolve, ms))
+}
@@ -21,6 +21,8 @@ export type InstalledApp = {
   icon:             string
   port:             number
   running:          boolean
+  ready:            boolean        // health path answering, or just running without one
+  probeMs:          number | null  // mean health probe latency
   defaultComponent: string
   components:       string[]
   api:              ApiEndpoint[]
@@ -40,3 +42,4 @@ export type WSMessage =
   | { op: 'remove';          id: string }
   | { op: 'canvas';          elements: CanvasElement[] }
   | { op: 'cursor_response'; text?: string; pills?: string[]; position: { x: number; y: number } }
+  | { op: 'batch';           ops: WSMessage[] }   // one turn's ops, applied in order
@@ -1,9 +1,25 @@
 import express from "express"
+import { pool } from "./db"
 import { router } from "./routes"
 
 const app = express()
 app.use(express.json())
 app.use("/contacts", router)
 
-const port = Number(process.env.PORT ?? 3001)
-app.listen(port, () => console.log(`contacts app listening on :${port}`))
+// Probed by crimata-dock: ready once the server is up and Postgres answers
+app.get("/health", async (_req, res) => {
+  try {
+    await pool.query("SELECT 1")
+    res.status(200).json({ ok: true })
+  } catch {
+    res.status(503).json({ ok: false })
+  }
+})
+
+// Started on demand, systemd hands over the listening socket as fd 3
+if (process.env.LISTEN_FDS) {
+  app.listen({ fd: 3 }, () => console.log("contacts app listening on the systemd socket"))
+} else {
+  const port = Number(process.env.PORT ?? 3001)
+  app.listen(port, () => console.log(`contacts app listening on :${port}`))
+}
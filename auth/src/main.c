@@ -1,44 +1,151 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <arpa/inet.h>
 #include <microhttpd.h>
+#include "httpd.h"
+#include "json.h"
+#include "metrics.h"
 #include "pam_auth.h"
+#include "pam_pool.h"
+#include "response.h"
 #include "session.h"
+#include "throttle.h"
 #include "user.h"
 
 #define PORT       7700
 #define MAX_BODY   4096
+#define MAX_TOKENS 64      /* JSON tokens accepted in a request body */
+#define STATS_BODY 768
+
+#define MAX_BATCH_BODY  (256 * 1024)
+#define MAX_BATCH_USERS 1024
+
+#define DEFAULT_MAX_SESSIONS 4096
+#define DEFAULT_SESSION_TTL  (12 * 60 * 60)  /* absolute lifetime, seconds */
+#define DEFAULT_IDLE_TTL     (30 * 60)       /* idle timeout, seconds */
+#define DEFAULT_PAM_WORKERS  4
+#define DEFAULT_PAM_QUEUE    64
+#define DEFAULT_PAM_SERVICE  "login"
+#define DEFAULT_IP_RATE      30      /* login attempts per minute */
+#define DEFAULT_IP_BURST     20
+#define DEFAULT_USER_RATE    10
+#define DEFAULT_USER_BURST   5
+#define DEFAULT_THROTTLE_KEYS 16384
+
+static int trust_proxy;   /* take the client address from X-Real-IP */
+
+/* ── Metrics ──────────────────────────────────────────────────────────────── */
+
+enum {
+    R_VERIFY, R_HEALTH, R_ME, R_STATS, R_METRICS, R_AUTH, R_LOGOUT,
+    R_USERS, R_USERS_BATCH, R_USERS_JOBS, R_NOT_FOUND, R_COUNT
+};
+
+#define ROUTE(path) METRIC_HISTOGRAM_DEF("crimata_auth_http_request_duration_seconds", \
+                                         "route=\"" path "\"", "HTTP request latency by route")
+
+static metric_t route_metrics[R_COUNT] = {
+    [R_VERIFY]      = ROUTE("/verify"),
+    [R_HEALTH]      = ROUTE("/health"),
+    [R_ME]          = ROUTE("/me"),
+    [R_STATS]       = ROUTE("/stats"),
+    [R_METRICS]     = ROUTE("/metrics"),
+    [R_AUTH]        = ROUTE("/auth"),
+    [R_LOGOUT]      = ROUTE("/logout"),
+    [R_USERS]       = ROUTE("/users"),
+    [R_USERS_BATCH] = ROUTE("/users/batch"),
+    [R_USERS_JOBS]  = ROUTE("/users/jobs"),
+    [R_NOT_FOUND]   = ROUTE("other"),
+};
+
+static double sessions_gauge(void *arg)
+{
+    (void)arg;
+    return (double)session_count();
+}
 
 /* ── JSON helpers ─────────────────────────────────────────────────────────── */
 
-static const char *json_get(const char *json, const char *key, char *out, size_t out_len)
+/* Pull the "username" and "password" strings out of a JSON object body */
+static int parse_credentials(const char *body, size_t len,
+                             char *username, size_t username_len,
+                             char *password, size_t password_len)
 {
-    char search[128];
-    snprintf(search, sizeof(search), "\"%s\"", key);
-    const char *pos = strstr(json, search);
-    if (!pos) return NULL;
+    json_tok_t toks[MAX_TOKENS];
+    json_doc_t doc;
+
+    if (json_parse(&doc, body, len, toks, MAX_TOKENS) != 0) return -1;
+    if (json_get_string(&doc, 0, "username", username, username_len) < 0) return -1;
+    if (json_get_string(&doc, 0, "password", password, password_len) < 0) return -1;
+    return 0;
+}
 
-    pos += strlen(search);
-    while (*pos == ' ' || *pos == ':') pos++;
-    if (*pos != '"') return NULL;
-    pos++;
+/* ── Responses ────────────────────────────────────────────────────────────── */
+
+/* Constant bodies, built once in main() and shared by every request */
+enum {
+    J_HEALTH, J_NOT_FOUND, J_CREDENTIALS, J_BAD_LOGIN, J_AUTH_BUSY, J_NO_SLOTS,
+    J_MISSING_TOKEN, J_INVALID_TOKEN, J_LOGGED_OUT, J_AUTH_REQUIRED, J_JOB_AUTH,
+    J_USER_FAILED, J_USERS_ARRAY, J_USER_FIELDS, J_OUT_OF_MEMORY, J_PROVISION_BUSY,
+    J_NO_SUCH_JOB, J_TOO_LARGE, J_COUNT
+};
+
+static const struct {
+    const char *body;
+    const char *retry_after;   /* Retry-After header value, or NULL */
+} json_bodies[J_COUNT] = {
+    [J_HEALTH]         = { "{\"status\":\"ok\"}", NULL },
+    [J_NOT_FOUND]      = { "{\"error\":\"not found\"}", NULL },
+    [J_CREDENTIALS]    = { "{\"success\":false,\"error\":\"username and password required\"}", NULL },
+    [J_BAD_LOGIN]      = { "{\"success\":false,\"error\":\"invalid credentials\"}", NULL },
+    [J_AUTH_BUSY]      = { "{\"success\":false,\"error\":\"auth busy\"}", "1" },
+    [J_NO_SLOTS]       = { "{\"success\":false,\"error\":\"no session slots\"}", NULL },
+    [J_MISSING_TOKEN]  = { "{\"error\":\"missing token\"}", NULL },
+    [J_INVALID_TOKEN]  = { "{\"error\":\"invalid token\"}", NULL },
+    [J_LOGGED_OUT]     = { "{\"success\":true}", NULL },
+    [J_AUTH_REQUIRED]  = { "{\"success\":false,\"error\":\"authentication required\"}", NULL },
+    [J_JOB_AUTH]       = { "{\"error\":\"authentication required\"}", NULL },
+    [J_USER_FAILED]    = { "{\"success\":false,\"error\":\"could not create user\"}", NULL },
+    [J_USERS_ARRAY]    = { "{\"success\":false,\"error\":\"users must be a non-empty array\"}", NULL },
+    [J_USER_FIELDS]    = { "{\"success\":false,\"error\":\"every user needs a username and password\"}", NULL },
+    [J_OUT_OF_MEMORY]  = { "{\"success\":false,\"error\":\"out of memory\"}", NULL },
+    [J_PROVISION_BUSY] = { "{\"success\":false,\"error\":\"provisioning busy\"}", "5" },
+    [J_NO_SUCH_JOB]    = { "{\"error\":\"no such job\"}", NULL },
+    [J_TOO_LARGE]      = { "{\"success\":false,\"error\":\"request body too large\"}", NULL },
+};
+
+static struct MHD_Response *json_static[J_COUNT];
+
+static int responses_init(void)
+{
+    for (int i = 0; i < J_COUNT; i++) {
+        json_static[i] = response_static(json_bodies[i].body);
+        if (!json_static[i]) return -1;
+        if (json_bodies[i].retry_after)
+            MHD_add_response_header(json_static[i], "Retry-After", json_bodies[i].retry_after);
+    }
+    return 0;
+}
 
-    size_t i = 0;
-    while (*pos && *pos != '"' && i < out_len - 1)
-        out[i++] = *pos++;
-    out[i] = '\0';
-    return out;
+static enum MHD_Result send_static(struct MHD_Connection *conn, unsigned int status, int id)
+{
+    return response_queue(conn, status, json_static[id]);
 }
 
-static enum MHD_Result send_json(struct MHD_Connection *conn,
-                                  unsigned int status,
-                                  const char *body)
+/* 429 — the body is constant but Retry-After is per client */
+static enum MHD_Result send_throttled(struct MHD_Connection *conn, unsigned int wait)
 {
-    struct MHD_Response *resp = MHD_create_response_from_buffer(
-        strlen(body), (void *)body, MHD_RESPMEM_MUST_COPY);
-    MHD_add_response_header(resp, "Content-Type", "application/json");
-    MHD_add_response_header(resp, "Access-Control-Allow-Origin", "*");
-    enum MHD_Result ret = MHD_queue_response(conn, status, resp);
+    static const char body[] = "{\"success\":false,\"error\":\"too many attempts\"}";
+    char secs[16];
+    snprintf(secs, sizeof(secs), "%u", wait);
+
+    struct MHD_Response *resp = response_json(body, sizeof(body) - 1);
+    if (!resp) return MHD_NO;
+    MHD_add_response_header(resp, "Retry-After", secs);
+    enum MHD_Result ret = MHD_queue_response(conn, MHD_HTTP_TOO_MANY_REQUESTS, resp);
     MHD_destroy_response(resp);
     return ret;
 }
@@ -52,67 +159,233 @@ static const char *bearer_token(struct MHD_Connection *conn)
     return auth + 7;
 }
 
+/* Client address for throttling — nginx's X-Real-IP when --trust-proxy is set */
+static void client_ip(struct MHD_Connection *conn, char *out, size_t out_len)
+{
+    out[0] = '\0';
+
+    if (trust_proxy) {
+        const char *real = MHD_lookup_connection_value(conn, MHD_HEADER_KIND, "X-Real-IP");
+        if (real && *real) {
+            snprintf(out, out_len, "%s", real);
+            return;
+        }
+    }
+
+    const union MHD_ConnectionInfo *ci =
+        MHD_get_connection_info(conn, MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+    if (!ci || !ci->client_addr) return;
+
+    const struct sockaddr *sa = ci->client_addr;
+    if (sa->sa_family == AF_INET)
+        inet_ntop(AF_INET, &((const struct sockaddr_in *)sa)->sin_addr, out, out_len);
+    else if (sa->sa_family == AF_INET6)
+        inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)sa)->sin6_addr, out, out_len);
+}
+
 /* ── Request context ──────────────────────────────────────────────────────── */
 
 typedef struct {
-    char   body[MAX_BODY];
-    size_t body_len;
+    char     *body;         /* inline_body until a route allows more than MAX_BODY */
+    size_t    body_len;
+    size_t    body_cap;
+    size_t    body_max;     /* per-route limit, including the NUL */
+    int       too_large;    /* body exceeded body_max — answered with 413 */
+    int       auth_queued;  /* PAM job handed to the pool; connection suspended */
+    pam_job_t job;
+    char      ip[INET6_ADDRSTRLEN];
+    uint64_t  start;        /* metrics_now() when the request arrived */
+    char      inline_body[MAX_BODY];
 } request_ctx_t;
 
+/*
+ * Append upload data, growing onto the heap up to body_max. Anything past
+ * the limit is discarded and flagged rather than silently truncated.
+ * Returns -1 only on out-of-memory.
+ */
+static int body_append(request_ctx_t *ctx, const char *data, size_t n)
+{
+    if (ctx->too_large || n > ctx->body_max - 1 - ctx->body_len) {
+        ctx->too_large = 1;
+        return 0;
+    }
+
+    if (ctx->body_len + n + 1 > ctx->body_cap) {
+        size_t cap = ctx->body_cap;
+        while (cap < ctx->body_len + n + 1) cap *= 2;
+        if (cap > ctx->body_max) cap = ctx->body_max;
+
+        /* Copy by hand so the old buffer can be wiped — it may hold passwords */
+        char *p = malloc(cap);
+        if (!p) return -1;
+        memcpy(p, ctx->body, ctx->body_len);
+        memset(ctx->body, 0, ctx->body_len);
+        if (ctx->body != ctx->inline_body) free(ctx->body);
+        ctx->body     = p;
+        ctx->body_cap = cap;
+    }
+
+    memcpy(ctx->body + ctx->body_len, data, n);
+    ctx->body_len += n;
+    ctx->body[ctx->body_len] = '\0';
+    return 0;
+}
+
 /* ── Route handlers ───────────────────────────────────────────────────────── */
 
 static enum MHD_Result handle_health(struct MHD_Connection *conn)
 {
-    return send_json(conn, MHD_HTTP_OK, "{\"status\":\"ok\"}");
+    return send_static(conn, MHD_HTTP_OK, J_HEALTH);
 }
 
-/* POST /auth  { username, password } → { token } */
-static enum MHD_Result handle_auth(struct MHD_Connection *conn, const char *body)
+/* Runs on a PAM worker once the job has a result */
+static void auth_done(pam_job_t *job, void *arg)
 {
-    char username[256] = {0};
-    char password[256] = {0};
+    (void)job;
+    MHD_resume_connection(arg);
+}
+
+/*
+ * POST /auth  { username, password } → { token }
+ *
+ * PAM can block for seconds, so the first call parks the connection and
+ * queues the credentials on the worker pool; MHD calls back in here once
+ * auth_done resumes it. Attempts over the per-IP or per-username rate are
+ * turned away with 429 before they reach PAM.
+ */
+static enum MHD_Result handle_auth(struct MHD_Connection *conn, request_ctx_t *ctx)
+{
+    pam_job_t *job = &ctx->job;
+
+    if (!ctx->auth_queued) {
+        if (parse_credentials(ctx->body, ctx->body_len,
+                              job->username, sizeof(job->username),
+                              job->password, sizeof(job->password)) != 0) {
+            return send_static(conn, MHD_HTTP_BAD_REQUEST, J_CREDENTIALS);
+        }
+
+        client_ip(conn, ctx->ip, sizeof(ctx->ip));
+        unsigned wait = throttle_check(ctx->ip, job->username);
+        if (wait) {
+            memset(job->password, 0, sizeof(job->password));
+            return send_throttled(conn, wait);
+        }
 
-    if (!json_get(body, "username", username, sizeof(username)) ||
-        !json_get(body, "password", password, sizeof(password))) {
-        return send_json(conn, MHD_HTTP_BAD_REQUEST,
-                         "{\"success\":false,\"error\":\"username and password required\"}");
+        ctx->auth_queued = 1;
+        job->done = auth_done;
+        job->arg  = conn;
+
+        /* Suspend first so the worker can never resume before we park */
+        MHD_suspend_connection(conn);
+        if (pam_pool_submit(job) != 0) {
+            memset(job->password, 0, sizeof(job->password));
+            job->result = PAM_JOB_BUSY;
+            MHD_resume_connection(conn);
+        }
+        return MHD_YES;
     }
 
-    if (authenticate(username, password) != 0) {
-        return send_json(conn, MHD_HTTP_UNAUTHORIZED,
-                         "{\"success\":false,\"error\":\"invalid credentials\"}");
+    if (job->result == PAM_JOB_BUSY) {
+        return send_static(conn, MHD_HTTP_SERVICE_UNAVAILABLE, J_AUTH_BUSY);
     }
 
-    const char *token = session_create(username);
-    if (!token) {
-        return send_json(conn, MHD_HTTP_INTERNAL_SERVER_ERROR,
-                         "{\"success\":false,\"error\":\"no session slots\"}");
+    throttle_record(ctx->ip, job->username, job->result == PAM_JOB_OK);
+
+    if (job->result != PAM_JOB_OK) {
+        return send_static(conn, MHD_HTTP_UNAUTHORIZED, J_BAD_LOGIN);
     }
 
-    char resp[320];
-    snprintf(resp, sizeof(resp),
-             "{\"success\":true,\"token\":\"%s\",\"username\":\"%s\"}", token, username);
-    return send_json(conn, MHD_HTTP_OK, resp);
+    char token[SESSION_TOKEN_LEN + 1];
+    if (session_create(job->username, token) != 0) {
+        return send_static(conn, MHD_HTTP_INTERNAL_SERVER_ERROR, J_NO_SLOTS);
+    }
+
+    jw_t w;
+    jw_init(&w, httpd_arena(conn), 0);
+    jw_object_begin(&w);
+    jw_key(&w, "success");  jw_bool(&w, 1);
+    jw_key(&w, "token");    jw_string(&w, token);
+    jw_key(&w, "username"); jw_string(&w, job->username);
+    jw_object_end(&w);
+    return response_send_jw(conn, MHD_HTTP_OK, &w);
 }
 
-/* GET /me  Authorization: Bearer <token> → { username } */
+/* GET /me  Authorization: Bearer <token> → { username, expiresIn, idleExpiresIn } */
 static enum MHD_Result handle_me(struct MHD_Connection *conn)
 {
     const char *token = bearer_token(conn);
     if (!token) {
-        return send_json(conn, MHD_HTTP_UNAUTHORIZED,
-                         "{\"error\":\"missing token\"}");
+        return send_static(conn, MHD_HTTP_UNAUTHORIZED, J_MISSING_TOKEN);
     }
 
-    const char *username = session_lookup(token);
-    if (!username) {
-        return send_json(conn, MHD_HTTP_UNAUTHORIZED,
-                         "{\"error\":\"invalid token\"}");
+    session_info_t info;
+    if (session_lookup(token, &info) != 0) {
+        return send_static(conn, MHD_HTTP_UNAUTHORIZED, J_INVALID_TOKEN);
     }
 
-    char resp[320];
-    snprintf(resp, sizeof(resp), "{\"username\":\"%s\"}", username);
-    return send_json(conn, MHD_HTTP_OK, resp);
+    jw_t w;
+    jw_init(&w, httpd_arena(conn), 0);
+    jw_object_begin(&w);
+    jw_key(&w, "username");      jw_string(&w, info.username);
+    jw_key(&w, "expiresIn");     jw_int(&w, info.expires_in);
+    jw_key(&w, "idleExpiresIn"); jw_int(&w, info.idle_expires_in);
+    jw_object_end(&w);
+    return response_send_jw(conn, MHD_HTTP_OK, &w);
+}
+
+/* Bodiless 401 for /verify — built once in main(), shared by every request */
+static struct MHD_Response *verify_denied;
+
+/*
+ * GET /verify  Authorization: Bearer <token> → 204 + X-Crimata-User, or 401
+ *
+ * For nginx auth_request on every proxied request, so no JSON and no body.
+ */
+static enum MHD_Result handle_verify(struct MHD_Connection *conn)
+{
+    const char *token = bearer_token(conn);
+    session_info_t info;
+
+    if (!token || session_lookup(token, &info) != 0)
+        return response_queue(conn, MHD_HTTP_UNAUTHORIZED, verify_denied);
+
+    struct MHD_Response *resp = response_empty();
+    if (!resp) return MHD_NO;
+    MHD_add_response_header(resp, "X-Crimata-User", info.username);
+    enum MHD_Result ret = MHD_queue_response(conn, MHD_HTTP_NO_CONTENT, resp);
+    MHD_destroy_response(resp);
+    return ret;
+}
+
+/* GET /stats → PAM pool queue state, authenticate() latency, login throttling */
+static enum MHD_Result handle_stats(struct MHD_Connection *conn)
+{
+    pam_pool_stats_t pam;
+    throttle_stats_t thr;
+    pam_pool_stats(&pam);
+    throttle_stats(&thr);
+
+    char *resp = arena_alloc(httpd_arena(conn), STATS_BODY);
+    if (!resp) return send_static(conn, MHD_HTTP_INTERNAL_SERVER_ERROR, J_OUT_OF_MEMORY);
+
+    int len = snprintf(resp, STATS_BODY,
+             "{\"pam\":{"
+             "\"workers\":%u,\"queueDepth\":%u,\"maxQueue\":%u,"
+             "\"calls\":%llu,\"rejected\":%llu,"
+             "\"p50Ms\":%.3f,\"p90Ms\":%.3f,\"p99Ms\":%.3f,\"maxMs\":%.3f"
+             "},\"throttle\":{"
+             "\"allowed\":%llu,\"rejectedIp\":%llu,\"rejectedUser\":%llu,"
+             "\"evictions\":%llu,\"ipEntries\":%zu,\"userEntries\":%zu,\"maxEntries\":%zu"
+             "}}",
+             pam.workers, pam.queue_depth, pam.max_queue,
+             (unsigned long long)pam.calls, (unsigned long long)pam.rejected,
+             pam.p50_ms, pam.p90_ms, pam.p99_ms, pam.max_ms,
+             (unsigned long long)thr.allowed, (unsigned long long)thr.rejected_ip,
+             (unsigned long long)thr.rejected_user, (unsigned long long)thr.evictions,
+             thr.ip_entries, thr.user_entries, thr.max_entries);
+    if (len < 0 || len >= STATS_BODY)
+        return send_static(conn, MHD_HTTP_INTERNAL_SERVER_ERROR, J_OUT_OF_MEMORY);
+    return response_send(conn, MHD_HTTP_OK, resp, (size_t)len);
 }
 
 /* POST /logout  Authorization: Bearer <token> */
@@ -120,68 +393,190 @@ static enum MHD_Result handle_logout(struct MHD_Connection *conn)
 {
     const char *token = bearer_token(conn);
     if (token) session_destroy(token);
-    return send_json(conn, MHD_HTTP_OK, "{\"success\":true}");
+    return send_static(conn, MHD_HTTP_OK, J_LOGGED_OUT);
 }
 
 /* POST /users  { username, password } → create Linux user */
-static enum MHD_Result handle_create_user(struct MHD_Connection *conn, const char *body)
+static enum MHD_Result handle_create_user(struct MHD_Connection *conn, request_ctx_t *ctx)
 {
     /* Caller must be authenticated */
     const char *token = bearer_token(conn);
-    if (!token || !session_lookup(token)) {
-        return send_json(conn, MHD_HTTP_UNAUTHORIZED,
-                         "{\"success\":false,\"error\":\"authentication required\"}");
+    if (!token || session_lookup(token, NULL) != 0) {
+        return send_static(conn, MHD_HTTP_UNAUTHORIZED, J_AUTH_REQUIRED);
     }
 
     char username[256] = {0};
     char password[256] = {0};
 
-    if (!json_get(body, "username", username, sizeof(username)) ||
-        !json_get(body, "password", password, sizeof(password))) {
-        return send_json(conn, MHD_HTTP_BAD_REQUEST,
-                         "{\"success\":false,\"error\":\"username and password required\"}");
+    if (parse_credentials(ctx->body, ctx->body_len,
+                          username, sizeof(username),
+                          password, sizeof(password)) != 0) {
+        return send_static(conn, MHD_HTTP_BAD_REQUEST, J_CREDENTIALS);
     }
 
-    if (user_create(username, password) != 0) {
-        return send_json(conn, MHD_HTTP_CONFLICT,
-                         "{\"success\":false,\"error\":\"could not create user\"}");
+    int rc = user_create(username, password);
+    memset(password, 0, sizeof(password));
+    if (rc != 0) {
+        return send_static(conn, MHD_HTTP_CONFLICT, J_USER_FAILED);
     }
 
-    char resp[320];
-    snprintf(resp, sizeof(resp), "{\"success\":true,\"username\":\"%s\"}", username);
-    return send_json(conn, MHD_HTTP_CREATED, resp);
+    jw_t w;
+    jw_init(&w, httpd_arena(conn), 0);
+    jw_object_begin(&w);
+    jw_key(&w, "success");  jw_bool(&w, 1);
+    jw_key(&w, "username"); jw_string(&w, username);
+    jw_object_end(&w);
+    return response_send_jw(conn, MHD_HTTP_CREATED, &w);
+}
+
+/* POST /users/batch  { users: [{ username, password }...] } → 202 { jobId } */
+static enum MHD_Result handle_batch_users(struct MHD_Connection *conn, request_ctx_t *ctx)
+{
+    const char *token = bearer_token(conn);
+    if (!token || session_lookup(token, NULL) != 0) {
+        return send_static(conn, MHD_HTTP_UNAUTHORIZED, J_AUTH_REQUIRED);
+    }
+
+    arena_t    arena;
+    json_doc_t doc;
+    arena_init(&arena, NULL, 0, 64 * 1024);
+
+    int users = -1;
+    if (json_parse_arena(&doc, ctx->body, ctx->body_len, &arena) == 0)
+        users = json_object_get(&doc, 0, "users");
+    if (users < 0 || doc.toks[users].type != JSON_ARRAY ||
+        doc.toks[users].size == 0 || doc.toks[users].size > MAX_BATCH_USERS) {
+        arena_free(&arena);
+        return send_static(conn, MHD_HTTP_BAD_REQUEST, J_USERS_ARRAY);
+    }
+
+    size_t       n     = doc.toks[users].size;
+    user_spec_t *specs = arena_alloc(&arena, n * sizeof(*specs));
+    if (!specs) {
+        arena_free(&arena);
+        return send_static(conn, MHD_HTTP_INTERNAL_SERVER_ERROR, J_OUT_OF_MEMORY);
+    }
+
+    unsigned idx = (unsigned)users + 1;
+    for (size_t i = 0; i < n; i++, idx = doc.toks[idx].next) {
+        if (json_get_string(&doc, (int)idx, "username",
+                            specs[i].username, sizeof(specs[i].username)) < 0 ||
+            json_get_string(&doc, (int)idx, "password",
+                            specs[i].password, sizeof(specs[i].password)) < 0) {
+            memset(specs, 0, n * sizeof(*specs));
+            arena_free(&arena);
+            return send_static(conn, MHD_HTTP_BAD_REQUEST, J_USER_FIELDS);
+        }
+    }
+
+    long id = user_batch_submit(specs, n);
+    memset(specs, 0, n * sizeof(*specs));
+    arena_free(&arena);
+
+    if (id < 0) {
+        return send_static(conn, MHD_HTTP_SERVICE_UNAVAILABLE, J_PROVISION_BUSY);
+    }
+
+    jw_t w;
+    jw_init(&w, httpd_arena(conn), 0);
+    jw_object_begin(&w);
+    jw_key(&w, "success"); jw_bool(&w, 1);
+    jw_key(&w, "jobId");   jw_int(&w, id);
+    jw_key(&w, "total");   jw_uint(&w, n);
+    jw_object_end(&w);
+    return response_send_jw(conn, MHD_HTTP_ACCEPTED, &w);
+}
+
+/* GET /users/jobs/<id> → batch job progress and per-user results */
+static enum MHD_Result handle_batch_status(struct MHD_Connection *conn, const char *id_str)
+{
+    const char *token = bearer_token(conn);
+    if (!token || session_lookup(token, NULL) != 0) {
+        return send_static(conn, MHD_HTTP_UNAUTHORIZED, J_JOB_AUTH);
+    }
+
+    char *end;
+    long id = strtol(id_str, &end, 10);
+    if (*id_str == '\0' || *end != '\0')
+        return send_static(conn, MHD_HTTP_NOT_FOUND, J_NO_SUCH_JOB);
+
+    jw_t w;
+    jw_init(&w, httpd_arena(conn), 0);
+    if (user_batch_status(id, &w) != 0)
+        return send_static(conn, MHD_HTTP_NOT_FOUND, J_NO_SUCH_JOB);
+    return response_send_jw(conn, MHD_HTTP_OK, &w);
 }
 
 /* ── Main handler ─────────────────────────────────────────────────────────── */
 
-static enum MHD_Result handler(void *cls,
-                                struct MHD_Connection *conn,
-                                const char *url,
-                                const char *method,
-                                const char *version,
-                                const char *upload_data,
-                                size_t *upload_data_size,
-                                void **con_cls)
+/*
+ * Route a request. *route is set to the R_* to time when this call finishes
+ * the request, and left at -1 while a body is still arriving or /auth is
+ * parked on the PAM pool; *start is moved back to the request's arrival for
+ * calls that span several handler invocations.
+ */
+static enum MHD_Result dispatch(struct MHD_Connection *conn,
+                                 const char *url,
+                                 const char *method,
+                                 const char *upload_data,
+                                 size_t *upload_data_size,
+                                 void **con_cls,
+                                 int *route,
+                                 uint64_t *start)
 {
-    (void)cls; (void)version;
+    /* GET /verify — checked first, it runs in front of every app request */
+    if (strcmp(url, "/verify") == 0 && strcmp(method, "GET") == 0) {
+        *route = R_VERIFY;
+        return handle_verify(conn);
+    }
 
     /* Health check */
-    if (strcmp(url, "/health") == 0 && strcmp(method, "GET") == 0)
+    if (strcmp(url, "/health") == 0 && strcmp(method, "GET") == 0) {
+        *route = R_HEALTH;
         return handle_health(conn);
+    }
 
     /* GET /me */
-    if (strcmp(url, "/me") == 0 && strcmp(method, "GET") == 0)
+    if (strcmp(url, "/me") == 0 && strcmp(method, "GET") == 0) {
+        *route = R_ME;
         return handle_me(conn);
+    }
+
+    /* GET /stats */
+    if (strcmp(url, "/stats") == 0 && strcmp(method, "GET") == 0) {
+        *route = R_STATS;
+        return handle_stats(conn);
+    }
+
+    /* GET /metrics */
+    if (strcmp(url, "/metrics") == 0 && strcmp(method, "GET") == 0) {
+        *route = R_METRICS;
+        return httpd_send_metrics(conn);
+    }
+
+    /* GET /users/jobs/<id> */
+    if (strncmp(url, "/users/jobs/", 12) == 0 && strcmp(method, "GET") == 0) {
+        *route = R_USERS_JOBS;
+        return handle_batch_status(conn, url + 12);
+    }
 
     /* Routes that need a request body */
-    if ((strcmp(url, "/auth")    == 0 ||
-         strcmp(url, "/logout")  == 0 ||
-         strcmp(url, "/users")   == 0) &&
-        (strcmp(method, "POST")  == 0))
+    if ((strcmp(url, "/auth")        == 0 ||
+         strcmp(url, "/logout")      == 0 ||
+         strcmp(url, "/users")       == 0 ||
+         strcmp(url, "/users/batch") == 0) &&
+        (strcmp(method, "POST")      == 0))
     {
         if (!*con_cls) {
-            request_ctx_t *ctx = calloc(1, sizeof(request_ctx_t));
+            /* Lives until request_completed(), like the connection's arena */
+            request_ctx_t *ctx = arena_alloc(httpd_arena(conn), sizeof(request_ctx_t));
             if (!ctx) return MHD_NO;
+            memset(ctx, 0, offsetof(request_ctx_t, inline_body));
+            ctx->inline_body[0] = '\0';
+            ctx->body     = ctx->inline_body;
+            ctx->body_cap = MAX_BODY;
+            ctx->body_max = strcmp(url, "/users/batch") == 0 ? MAX_BATCH_BODY : MAX_BODY;
+            ctx->start    = *start;
             *con_cls = ctx;
             return MHD_YES;
         }
@@ -189,50 +584,226 @@ static enum MHD_Result handler(void *cls,
         request_ctx_t *ctx = *con_cls;
 
         if (*upload_data_size > 0) {
-            size_t remaining = MAX_BODY - ctx->body_len - 1;
-            size_t to_copy   = *upload_data_size < remaining ? *upload_data_size : remaining;
-            memcpy(ctx->body + ctx->body_len, upload_data, to_copy);
-            ctx->body_len    += to_copy;
+            if (body_append(ctx, upload_data, *upload_data_size) != 0) return MHD_NO;
             *upload_data_size = 0;
             return MHD_YES;
         }
 
-        if (strcmp(url, "/auth")   == 0) return handle_auth(conn, ctx->body);
-        if (strcmp(url, "/logout") == 0) return handle_logout(conn);
-        if (strcmp(url, "/users")  == 0) return handle_create_user(conn, ctx->body);
+        *start = ctx->start;
+
+        int r = strcmp(url, "/auth")   == 0 ? R_AUTH
+              : strcmp(url, "/logout") == 0 ? R_LOGOUT
+              : strcmp(url, "/users")  == 0 ? R_USERS
+              :                               R_USERS_BATCH;
+
+        /* Ahead of every handler: the body was cut at body_max, never parse what's left */
+        if (ctx->too_large) {
+            *route = r;
+            return send_static(conn, MHD_HTTP_CONTENT_TOO_LARGE, J_TOO_LARGE);
+        }
+
+        if (r == R_AUTH) {
+            int first = !ctx->auth_queued;
+            enum MHD_Result ret = handle_auth(conn, ctx);
+            if (!(first && ctx->auth_queued)) *route = R_AUTH;  /* not parked */
+            return ret;
+        }
+
+        *route = r;
+        if (*route == R_LOGOUT) return handle_logout(conn);
+        if (*route == R_USERS)  return handle_create_user(conn, ctx);
+        return handle_batch_users(conn, ctx);
     }
 
-    return send_json(conn, MHD_HTTP_NOT_FOUND, "{\"error\":\"not found\"}");
+    *route = R_NOT_FOUND;
+    return send_static(conn, MHD_HTTP_NOT_FOUND, J_NOT_FOUND);
+}
+
+static enum MHD_Result handler(void *cls,
+                                struct MHD_Connection *conn,
+                                const char *url,
+                                const char *method,
+                                const char *version,
+                                const char *upload_data,
+                                size_t *upload_data_size,
+                                void **con_cls)
+{
+    (void)cls; (void)version;
+
+    int      route = -1;
+    uint64_t start = metrics_now();
+
+    enum MHD_Result ret = dispatch(conn, url, method, upload_data, upload_data_size,
+                                   con_cls, &route, &start);
+    if (route >= 0)
+        metrics_observe(&route_metrics[route], metrics_now() - start);
+    return ret;
 }
 
 static void request_completed(void *cls, struct MHD_Connection *conn,
                                void **con_cls, enum MHD_RequestTerminationCode toe)
 {
     (void)cls; (void)conn; (void)toe;
-    if (*con_cls) { free(*con_cls); *con_cls = NULL; }
+    request_ctx_t *ctx = *con_cls;
+    if (ctx) {
+        memset(ctx->body, 0, ctx->body_len);  /* may hold a password */
+        if (ctx->body != ctx->inline_body) free(ctx->body);
+        *con_cls = NULL;  /* ctx itself goes with the connection's arena */
+    }
 }
 
 /* ── Entry point ──────────────────────────────────────────────────────────── */
 
-int main(void)
+static void usage(const char *prog)
 {
-    struct MHD_Daemon *daemon = MHD_start_daemon(
-        MHD_USE_INTERNAL_POLLING_THREAD,
-        PORT,
-        NULL, NULL,
-        &handler, NULL,
-        MHD_OPTION_NOTIFY_COMPLETED, request_completed, NULL,
-        MHD_OPTION_END
-    );
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --max-sessions N   live session capacity (default %d)\n"
+            "  --session-ttl S    absolute session lifetime in seconds (default %d)\n"
+            "  --idle-ttl S       idle timeout in seconds (default %d)\n"
+            "  --session-store F  keep sessions in mmap'd file F across restarts\n"
+            "  --pam-workers N    PAM worker threads (default %d)\n"
+            "  --pam-queue N      logins allowed to wait for a worker (default %d)\n"
+            "  --pam-service S    PAM service name (default %s)\n"
+            "  --pam-confdir D    read the service file from D instead of /etc/pam.d\n"
+            "  --ip-rate N        login attempts per minute per client IP, 0 = off (default %d)\n"
+            "  --ip-burst N       attempts an IP may make at once (default %d)\n"
+            "  --user-rate N      login attempts per minute per username, 0 = off (default %d)\n"
+            "  --user-burst N     attempts a username may take at once (default %d)\n"
+            "  --throttle-keys N  IPs and usernames tracked, each (default %d)\n"
+            "  --trust-proxy      use X-Real-IP as the client address (behind nginx)\n",
+            prog, DEFAULT_MAX_SESSIONS, DEFAULT_SESSION_TTL, DEFAULT_IDLE_TTL,
+            DEFAULT_PAM_WORKERS, DEFAULT_PAM_QUEUE, DEFAULT_PAM_SERVICE,
+            DEFAULT_IP_RATE, DEFAULT_IP_BURST, DEFAULT_USER_RATE, DEFAULT_USER_BURST,
+            DEFAULT_THROTTLE_KEYS);
+    httpd_config_usage(stderr);
+    fprintf(stderr, "HTTP settings can also be set as CRIMATA_AUTH_THREADS etc.\n");
+}
 
-    if (!daemon) {
-        fprintf(stderr, "failed to start daemon on port %d\n", PORT);
+int main(int argc, char **argv)
+{
+    /* Before the PAM and batch threads exist, so SIGTERM reaches httpd_serve() */
+    httpd_block_signals();
+
+    session_config_t sessions = {
+        .max_sessions = DEFAULT_MAX_SESSIONS,
+        .ttl          = DEFAULT_SESSION_TTL,
+        .idle_ttl     = DEFAULT_IDLE_TTL,
+    };
+    unsigned pam_workers = DEFAULT_PAM_WORKERS;
+    unsigned pam_queue   = DEFAULT_PAM_QUEUE;
+    const char *pam_service = DEFAULT_PAM_SERVICE;
+    const char *pam_confdir = NULL;
+    throttle_config_t throttle = {
+        .ip_rate     = DEFAULT_IP_RATE,
+        .ip_burst    = DEFAULT_IP_BURST,
+        .user_rate   = DEFAULT_USER_RATE,
+        .user_burst  = DEFAULT_USER_BURST,
+        .max_entries = DEFAULT_THROTTLE_KEYS,
+    };
+
+    httpd_config_t httpd = { .port = PORT, .threads = 1 };
+    httpd_config_env(&httpd, "CRIMATA_AUTH");
+
+    static const struct option opts[] = {
+        { "max-sessions",  required_argument, NULL, 's' },
+        { "session-ttl",   required_argument, NULL, 't' },
+        { "idle-ttl",      required_argument, NULL, 'i' },
+        { "session-store", required_argument, NULL, 'f' },
+        { "pam-workers",   required_argument, NULL, 'w' },
+        { "pam-queue",     required_argument, NULL, 'q' },
+        { "pam-service",   required_argument, NULL, 'P' },
+        { "pam-confdir",   required_argument, NULL, 'C' },
+        { "ip-rate",       required_argument, NULL, 'r' },
+        { "ip-burst",      required_argument, NULL, 'b' },
+        { "user-rate",     required_argument, NULL, 'R' },
+        { "user-burst",    required_argument, NULL, 'B' },
+        { "throttle-keys", required_argument, NULL, 'k' },
+        { "trust-proxy",   no_argument,       NULL, 'p' },
+        { "help",          no_argument,       NULL, 'h' },
+        HTTPD_LONG_OPTIONS,
+        { NULL, 0, NULL, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "h", opts, NULL)) != -1) {
+        switch (c) {
+        case 's': sessions.max_sessions = strtoul(optarg, NULL, 10); break;
+        case 't': sessions.ttl          = strtoul(optarg, NULL, 10); break;
+        case 'i': sessions.idle_ttl     = strtoul(optarg, NULL, 10); break;
+        case 'f': sessions.store_path   = optarg;                    break;
+        case 'w': pam_workers           = strtoul(optarg, NULL, 10); break;
+        case 'q': pam_queue             = strtoul(optarg, NULL, 10); break;
+        case 'P': pam_service           = optarg;                    break;
+        case 'C': pam_confdir           = optarg;                    break;
+        case 'r': throttle.ip_rate      = strtod(optarg, NULL);      break;
+        case 'b': throttle.ip_burst     = strtod(optarg, NULL);      break;
+        case 'R': throttle.user_rate    = strtod(optarg, NULL);      break;
+        case 'B': throttle.user_burst   = strtod(optarg, NULL);      break;
+        case 'k': throttle.max_entries  = strtoul(optarg, NULL, 10); break;
+        case 'p': trust_proxy           = 1;                         break;
+        case 'h': usage(argv[0]); return 0;
+        default:
+            if (httpd_config_set(&httpd, c, optarg) == 0) break;
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (session_init(&sessions) != 0) {
+        fprintf(stderr, "failed to allocate session table (%zu sessions)\n",
+                sessions.max_sessions);
         return 1;
     }
 
-    printf("crimata-auth listening on :%d\n", PORT);
-    getchar(); /* block until killed */
+    authenticate_config(pam_service, pam_confdir);
+
+    if (pam_pool_init(pam_workers, pam_queue) != 0) {
+        fprintf(stderr, "failed to start %u PAM workers\n", pam_workers);
+        return 1;
+    }
+
+    /* A client (or chpasswd) hanging up mid-write must not kill the daemon */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (throttle_init(&throttle) != 0) {
+        fprintf(stderr, "failed to allocate login throttle (%zu keys)\n",
+                throttle.max_entries);
+        return 1;
+    }
+
+    for (int i = 0; i < R_COUNT; i++) metrics_register(&route_metrics[i]);
+
+    verify_denied = MHD_create_response_from_buffer(0, NULL, MHD_RESPMEM_PERSISTENT);
+    if (!verify_denied || responses_init() != 0) {
+        fprintf(stderr, "failed to build static responses\n");
+        return 1;
+    }
+
+    const struct MHD_OptionItem extra[] = {
+        { MHD_OPTION_NOTIFY_COMPLETED, (intptr_t)request_completed, NULL },
+        { MHD_OPTION_END, 0, NULL },
+    };
+
+    struct MHD_Daemon *daemon = httpd_start(&httpd, MHD_ALLOW_SUSPEND_RESUME,
+                                            &handler, NULL, extra);
+
+    if (!daemon) {
+        fprintf(stderr, "failed to start daemon on port %u\n", httpd.port);
+        return 1;
+    }
 
-    MHD_stop_daemon(daemon);
+    metrics_gauge("crimata_auth_sessions", "Live sessions", sessions_gauge, NULL);
+    metrics_gauge("crimata_auth_http_connections", "Open HTTP connections",
+                  httpd_connections, daemon);
+    printf("crimata-auth listening on :%u\n", httpd.port);
+    fflush(stdout);
+    /* /auth parks its connection on the PAM pool: none may be left suspended at stop */
+    httpd_set_drain_hook(pam_pool_drain);
+    httpd_set_expire_hook(pam_pool_abandon);
+    httpd_serve(&httpd, daemon); /* until SIGTERM, then drains */
+
+    MHD_destroy_response(verify_denied);
+    for (int i = 0; i < J_COUNT; i++) MHD_destroy_response(json_static[i]);
     return 0;
 }
@@ -1,12 +1,30 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <security/pam_appl.h>
 #include "pam_auth.h"
 
+/* Linux-PAM gained pam_start_confdir() in 1.4 */
+#if defined(__LINUX_PAM__) && (__LINUX_PAM__ > 1 || __LINUX_PAM_MINOR__ >= 4)
+#define HAVE_PAM_CONFDIR 1
+#endif
+
 typedef struct {
     const char *password;
 } pam_credentials_t;
 
+static const char *pam_service = "login";
+static const char *pam_confdir;
+
+void authenticate_config(const char *service, const char *confdir)
+{
+    if (service) pam_service = service;
+    pam_confdir = confdir;
+#ifndef HAVE_PAM_CONFDIR
+    if (confdir) fprintf(stderr, "PAM confdir needs Linux-PAM 1.4+, using /etc/pam.d\n");
+#endif
+}
+
 static int pam_conversation(int num_msg, const struct pam_message **msg,
                             struct pam_response **resp, void *appdata_ptr)
 {
@@ -36,7 +54,12 @@ int authenticate(const char *username, const char *password)
     pam_handle_t *pamh      = NULL;
     int result;
 
-    result = pam_start("login", username, &conv, &pamh);
+#ifdef HAVE_PAM_CONFDIR
+    if (pam_confdir)
+        result = pam_start_confdir(pam_service, username, &conv, pam_confdir, &pamh);
+    else
+#endif
+        result = pam_start(pam_service, username, &conv, &pamh);
     if (result != PAM_SUCCESS) goto done;
 
     result = pam_authenticate(pamh, PAM_SILENT);
@@ -7,4 +7,10 @@
  */
 int authenticate(const char *username, const char *password);
 
+/*
+ * Use PAM service instead of "login", optionally read from confdir rather
+ * than /etc/pam.d (Linux-PAM 1.4+). Call before the first authenticate().
+ */
+void authenticate_config(const char *service, const char *confdir);
+
 #endif
@@ -0,0 +1,165 @@
+#include "pam_pool.h"
+#include "pam_auth.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+static pthread_mutex_t lock     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  nonempty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  settled  = PTHREAD_COND_INITIALIZER;
+
+static pam_job_t *head, *tail;
+static unsigned   nworkers, queued, queue_max;
+static uint64_t   calls, rejected, max_us;
+static pam_job_t **running;      /* per worker: job in authenticate(), NULL once claimed */
+static unsigned   finishing;     /* workers between claiming a job and its done() returning */
+static int        draining;      /* pam_pool_drain() called: submissions fail */
+
+#define PAM_SECONDS "crimata_auth_pam_authenticate_seconds"
+static metric_t m_pam_ok     = METRIC_HISTOGRAM_DEF(PAM_SECONDS, "result=\"ok\"",     "Time spent in PAM authenticate()");
+static metric_t m_pam_failed = METRIC_HISTOGRAM_DEF(PAM_SECONDS, "result=\"failed\"", "Time spent in PAM authenticate()");
+
+/* Both results together, for the percentiles in GET /stats */
+static metric_t *const pam_metrics[] = { &m_pam_ok, &m_pam_failed };
+
+/* Bucket interpolation can land past the slowest call, so cap at it */
+static double percentile_ms(double p, double max_ms)
+{
+    double ms = (double)metrics_quantile(pam_metrics, 2, p) / 1e6;
+    return ms < max_ms ? ms : max_ms;
+}
+
+/*
+ * PAM runs on copies of the credentials, so pam_pool_abandon() can hand a
+ * job back while authenticate() is still using them.
+ */
+static void *worker(void *arg)
+{
+    pam_job_t **slot = arg;
+    char        username[sizeof(((pam_job_t *)0)->username)];
+    char        password[sizeof(((pam_job_t *)0)->password)];
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (!head) pthread_cond_wait(&nonempty, &lock);
+        pam_job_t *job = head;
+        head = job->next;
+        if (!head) tail = NULL;
+        queued--;
+        *slot = job;
+        memcpy(username, job->username, sizeof(username));
+        memcpy(password, job->password, sizeof(password));
+        memset(job->password, 0, sizeof(job->password));
+        pthread_mutex_unlock(&lock);
+
+        uint64_t start  = metrics_now();
+        int      result = (authenticate(username, password) == 0) ? PAM_JOB_OK : PAM_JOB_FAILED;
+        uint64_t took_ns = metrics_now() - start;
+        uint64_t took    = took_ns / 1000;
+        memset(password, 0, sizeof(password));
+
+        metrics_observe(result == PAM_JOB_OK ? &m_pam_ok : &m_pam_failed, took_ns);
+
+        pthread_mutex_lock(&lock);
+        calls++;
+        if (took > max_us) max_us = took;
+        int mine = *slot == job;   /* else abandoned: its connection may be gone */
+        *slot = NULL;
+        if (mine) finishing++;
+        pthread_mutex_unlock(&lock);
+        if (!mine) continue;
+
+        job->result = result;
+        job->done(job, job->arg);
+
+        pthread_mutex_lock(&lock);
+        if (--finishing == 0) pthread_cond_broadcast(&settled);
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+int pam_pool_init(unsigned workers, unsigned max_queue)
+{
+    if (workers == 0) return -1;
+    nworkers  = workers;
+    queue_max = max_queue;
+    running   = calloc(workers, sizeof(*running));
+    if (!running) return -1;
+
+    for (unsigned i = 0; i < workers; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, &running[i]) != 0) return -1;
+        pthread_detach(tid);
+    }
+    return 0;
+}
+
+int pam_pool_submit(pam_job_t *job)
+{
+    pthread_mutex_lock(&lock);
+    if (draining || queued >= queue_max) {
+        rejected++;
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    job->next = NULL;
+    if (tail) tail->next = job;
+    else      head = job;
+    tail = job;
+    queued++;
+
+    pthread_cond_signal(&nonempty);
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+void pam_pool_drain(void)
+{
+    pthread_mutex_lock(&lock);
+    draining = 1;
+    pthread_mutex_unlock(&lock);
+}
+
+void pam_pool_abandon(void)
+{
+    pthread_mutex_lock(&lock);
+    pam_job_t *jobs = head;   /* queued ones, then the ones in authenticate() */
+    head = tail = NULL;
+    queued = 0;
+    for (unsigned i = 0; i < nworkers; i++) {
+        if (!running[i]) continue;
+        running[i]->next = jobs;
+        jobs = running[i];
+        running[i] = NULL;
+    }
+    /* A worker that already claimed its job is resuming that connection now */
+    while (finishing) pthread_cond_wait(&settled, &lock);
+    pthread_mutex_unlock(&lock);
+
+    while (jobs) {
+        pam_job_t *job = jobs;
+        jobs = job->next;
+        memset(job->password, 0, sizeof(job->password));
+        job->result = PAM_JOB_BUSY;
+        job->done(job, job->arg);
+    }
+}
+
+void pam_pool_stats(pam_pool_stats_t *out)
+{
+    pthread_mutex_lock(&lock);
+    out->workers     = nworkers;
+    out->queue_depth = queued;
+    out->max_queue   = queue_max;
+    out->calls       = calls;
+    out->rejected    = rejected;
+    out->max_ms      = (double)max_us / 1000.0;
+    pthread_mutex_unlock(&lock);
+
+    out->p50_ms = percentile_ms(0.50, out->max_ms);
+    out->p90_ms = percentile_ms(0.90, out->max_ms);
+    out->p99_ms = percentile_ms(0.99, out->max_ms);
+}
@@ -0,0 +1,51 @@
+#ifndef PAM_POOL_H
+#define PAM_POOL_H
+
+#include <stdint.h>
+
+#define PAM_JOB_OK      0
+#define PAM_JOB_FAILED (-1)   /* authenticate() rejected the credentials */
+#define PAM_JOB_BUSY   (-2)   /* queue was full, never ran */
+
+typedef struct pam_job {
+    char  username[256];
+    char  password[256];      /* zeroed by the worker once PAM is done */
+    int   result;             /* PAM_JOB_* */
+
+    /* Called on the worker thread when result is set; the job must not be
+     * touched by the pool afterwards, so done may free or reuse it */
+    void (*done)(struct pam_job *job, void *arg);
+    void  *arg;
+
+    struct pam_job *next;
+} pam_job_t;
+
+typedef struct {
+    unsigned workers;
+    unsigned queue_depth;     /* jobs waiting for a worker */
+    unsigned max_queue;
+    uint64_t calls;
+    uint64_t rejected;
+    double   p50_ms, p90_ms, p99_ms, max_ms;
+} pam_pool_stats_t;
+
+/* Start the worker threads and cap the wait queue at max_queue jobs. Returns 0 or -1 */
+int  pam_pool_init(unsigned workers, unsigned max_queue);
+
+/* Queue a job — returns 0, or -1 (without calling done) if the queue is full */
+int  pam_pool_submit(pam_job_t *job);
+
+/* On shutdown: from now on pam_pool_submit() fails; queued and running jobs go on */
+void pam_pool_drain(void);
+
+/*
+ * When the shutdown can wait no longer: finish every queued or running job
+ * with PAM_JOB_BUSY, on the calling thread. A job still in authenticate()
+ * is never touched again, so its owner may free it once done has run.
+ */
+void pam_pool_abandon(void);
+
+/* Snapshot of queue state and authenticate() latency percentiles */
+void pam_pool_stats(pam_pool_stats_t *out);
+
+#endif
@@ -1,32 +1,177 @@
 #include "session.h"
+#include "store.h"
+#include "metrics.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <time.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <sys/mman.h>
+#include <sys/random.h>
 
-#define MAX_SESSIONS 1024
-#define TOKEN_LEN    32
+/*
+ * Sessions live in a hash table keyed by token, split into shards that each
+ * own a bucket index and an expiry wheel behind their own rwlock. Lookups only
+ * take the read lock of one shard, so /me never serializes behind logins or
+ * lookups for other tokens. The records themselves come from one free list
+ * shared by every shard, so the table holds exactly max_sessions sessions no
+ * matter how unevenly tokens hash across shards.
+ *
+ * Expiry is driven by a hierarchical timer wheel per shard with one-second
+ * ticks. A session sits in the wheel at the deadline computed when it was
+ * (re)inserted; lookups only bump last_seen, and when the slot fires the real
+ * deadline is rechecked and the session is either evicted or re-inserted.
+ * A tick therefore costs O(sessions due), never a sweep of the table.
+ *
+ * Records hold only what must survive a restart and may live in an mmap'd
+ * store file; the chain and wheel links are kept beside them in memory and
+ * rebuilt from the records on startup.
+ */
 
+#define SHARD_BITS   6
+#define SHARD_COUNT  (1u << SHARD_BITS)
+#define CREATE_TRIES 4     /* re-roll a token that collides with a live one */
+#define NIL          (-1)
+
+#define WHEEL_BITS   6
+#define WHEEL_SIZE   (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4     /* 64^4 s ≈ 194 days of range */
+
+/*
+ * Persistent record — fixed layout, shared with the store file. Everything a
+ * lookup compares or updates sits in the first cache line; the username
+ * starts the second.
+ */
 typedef struct {
-    char token[TOKEN_LEN + 1];
-    char username[256];
-    int  active;
+    char     token[SESSION_TOKEN_LEN + 1];
+    int32_t  active;       /* written last on create, cleared first on destroy */
+    int64_t  created;
+    int64_t  last_seen;    /* updated under the read lock — atomic access only */
+    uint64_t checksum;     /* over token, username and created */
+    char     username[SESSION_USER_MAX];
 } session_t;
 
-static session_t   sessions[MAX_SESSIONS];
-static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define RECORD_ALIGN 64
+_Static_assert(sizeof(session_t) % RECORD_ALIGN == 0, "records must stay cache-line aligned");
+
+typedef struct {
+    int32_t next;          /* next record in bucket chain, or free list */
+    int32_t wheel_next;
+    int32_t wheel_prev;
+    int32_t wheel_slot;    /* level * WHEEL_SIZE + slot, or NIL when detached */
+} session_link_t;
+
+typedef struct {
+    pthread_rwlock_t lock;
+    int32_t         *buckets;
+    uint32_t         bucket_mask;
+    uint32_t         count;
+    int64_t          wheel_now;
+    int32_t          wheel[WHEEL_LEVELS][WHEEL_SIZE];
+} shard_t;
+
+static shard_t  shards[SHARD_COUNT];
+
+/* Records and their links, indexed alike; a record belongs to the shard of its token's hash */
+static session_t      *records;
+static session_link_t *links;
+static uint32_t        nrecords;
+
+/* Unused records — a leaf lock, taken with or without a shard lock held */
+static pthread_mutex_t free_lock = PTHREAD_MUTEX_INITIALIZER;
+static int32_t         free_head = NIL;
+static unsigned session_ttl;
+static unsigned session_idle_ttl;
+
+#define LOCK_WAIT "crimata_auth_session_lock_wait_seconds"
+#define LOCK_HOLD "crimata_auth_session_lock_hold_seconds"
+
+static metric_t m_wait_read  = METRIC_HISTOGRAM_DEF(LOCK_WAIT, "mode=\"read\"",  "Time spent waiting for a session shard lock");
+static metric_t m_wait_write = METRIC_HISTOGRAM_DEF(LOCK_WAIT, "mode=\"write\"", "Time spent waiting for a session shard lock");
+static metric_t m_hold_read  = METRIC_HISTOGRAM_DEF(LOCK_HOLD, "mode=\"read\"",  "Time a session shard lock is held");
+static metric_t m_hold_write = METRIC_HISTOGRAM_DEF(LOCK_HOLD, "mode=\"write\"", "Time a session shard lock is held");
+
+typedef struct {
+    uint64_t start;
+    uint64_t acquired;
+} lock_timer_t;
+
+static void shard_lock(shard_t *s, int write, lock_timer_t *t)
+{
+    t->start = metrics_now();
+    if (write) pthread_rwlock_wrlock(&s->lock);
+    else       pthread_rwlock_rdlock(&s->lock);
+    t->acquired = metrics_now();
+}
+
+/* Unlock, then record wait and hold time — outside the lock */
+static void shard_unlock(shard_t *s, int write, const lock_timer_t *t)
+{
+    pthread_rwlock_unlock(&s->lock);
+    uint64_t now = metrics_now();
+    metrics_observe(write ? &m_wait_write : &m_wait_read, t->acquired - t->start);
+    metrics_observe(write ? &m_hold_write : &m_hold_read, now - t->acquired);
+}
+
+static int64_t now_sec(void)
+{
+    return (int64_t)time(NULL);
+}
+
+/* FNV-1a, continuing from h */
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+#define FNV_OFFSET 1469598103934665603ULL
+
+static uint64_t token_hash(const char *token)
+{
+    return fnv1a(FNV_OFFSET, token, SESSION_TOKEN_LEN);
+}
+
+static uint64_t session_checksum(const session_t *sess)
+{
+    uint64_t h = fnv1a(FNV_OFFSET, sess->token, sizeof(sess->token));
+    h = fnv1a(h, sess->username, sizeof(sess->username));
+    return fnv1a(h, &sess->created, sizeof(sess->created));
+}
+
+/* Compare two tokens without leaking the position of the first mismatch */
+static int token_equal(const char *a, const char *b)
+{
+    unsigned char diff = 0;
+    for (size_t i = 0; i < SESSION_TOKEN_LEN; i++)
+        diff |= (unsigned char)(a[i] ^ b[i]);
+    return diff == 0;
+}
+
+/* Reject anything that is not exactly SESSION_TOKEN_LEN characters */
+static int token_valid(const char *token)
+{
+    return token && strnlen(token, SESSION_TOKEN_LEN + 1) == SESSION_TOKEN_LEN;
+}
+
+static shard_t *shard_for(uint64_t h)
+{
+    return &shards[h >> (64 - SHARD_BITS)];
+}
 
 /* Generate a random hex token */
 static void gen_token(char *out)
 {
     static const char hex[] = "0123456789abcdef";
-    unsigned char buf[TOKEN_LEN / 2];
-    FILE *f = fopen("/dev/urandom", "rb");
-    if (f) {
-        fread(buf, 1, sizeof(buf), f);
-        fclose(f);
-    } else {
+    unsigned char buf[SESSION_TOKEN_LEN / 2];
+    if (getrandom(buf, sizeof(buf), 0) != (ssize_t)sizeof(buf)) {
         /* fallback: not cryptographically strong but avoids hanging */
         srand((unsigned)time(NULL));
         for (size_t i = 0; i < sizeof(buf); i++)
@@ -36,58 +181,354 @@ static void gen_token(char *out)
         out[i * 2]     = hex[buf[i] >> 4];
         out[i * 2 + 1] = hex[buf[i] & 0xf];
     }
-    out[TOKEN_LEN] = '\0';
+    out[SESSION_TOKEN_LEN] = '\0';
+}
+
+/* Earliest of the absolute and idle deadlines */
+static int64_t session_deadline(const session_t *sess)
+{
+    int64_t seen = __atomic_load_n(&sess->last_seen, __ATOMIC_RELAXED);
+    int64_t abs  = sess->created + session_ttl;
+    int64_t idle = seen + session_idle_ttl;
+    return abs < idle ? abs : idle;
 }
 
-const char *session_create(const char *username)
+/* ── Timer wheel (caller holds the shard write lock) ─────────────────────── */
+
+static void wheel_insert(shard_t *s, int32_t idx, int64_t expires)
 {
-    pthread_mutex_lock(&lock);
+    if (expires <= s->wheel_now) expires = s->wheel_now + 1;
+
+    int64_t delta = expires - s->wheel_now;
+    int     level = 0;
+    while (level < WHEEL_LEVELS - 1 &&
+           delta >= ((int64_t)1 << (WHEEL_BITS * (level + 1))))
+        level++;
 
-    /* Find a free slot */
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (!sessions[i].active) {
-            gen_token(sessions[i].token);
-            strncpy(sessions[i].username, username, sizeof(sessions[i].username) - 1);
-            sessions[i].username[sizeof(sessions[i].username) - 1] = '\0';
-            sessions[i].active = 1;
-            pthread_mutex_unlock(&lock);
-            return sessions[i].token;
+    /* Clamp far-future deadlines to the top level; they get rechecked */
+    int64_t horizon = (int64_t)1 << (WHEEL_BITS * WHEEL_LEVELS);
+    if (delta >= horizon) expires = s->wheel_now + horizon - 1;
+
+    int32_t         slot = level * WHEEL_SIZE + ((expires >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    int32_t        *head = &s->wheel[0][0] + slot;
+    session_link_t *ln   = &links[idx];
+    ln->wheel_slot = slot;
+    ln->wheel_prev = NIL;
+    ln->wheel_next = *head;
+    if (*head != NIL) links[*head].wheel_prev = idx;
+    *head = idx;
+}
+
+static void wheel_remove(shard_t *s, int32_t idx)
+{
+    session_link_t *ln = &links[idx];
+    if (ln->wheel_slot == NIL) return;
+
+    if (ln->wheel_prev != NIL)
+        links[ln->wheel_prev].wheel_next = ln->wheel_next;
+    else
+        (&s->wheel[0][0])[ln->wheel_slot] = ln->wheel_next;
+    if (ln->wheel_next != NIL)
+        links[ln->wheel_next].wheel_prev = ln->wheel_prev;
+
+    ln->wheel_next = ln->wheel_prev = ln->wheel_slot = NIL;
+}
+
+/* Detach the list in one wheel slot and return its head */
+static int32_t wheel_take(shard_t *s, int level, int slot)
+{
+    int32_t head = s->wheel[level][slot];
+    s->wheel[level][slot] = NIL;
+    for (int32_t idx = head; idx != NIL; idx = links[idx].wheel_next)
+        links[idx].wheel_slot = NIL;
+    return head;
+}
+
+/* ── Hash index (caller holds the shard lock) ────────────────────────────── */
+
+/* Find the slot holding token in shard s */
+static int32_t shard_find(const shard_t *s, uint64_t h, const char *token,
+                          int32_t **link_out)
+{
+    int32_t *link = &s->buckets[h & s->bucket_mask];
+    while (*link != NIL) {
+        if (token_equal(records[*link].token, token)) {
+            if (link_out) *link_out = link;
+            return *link;
         }
+        link = &links[*link].next;
     }
+    return NIL;
+}
 
-    pthread_mutex_unlock(&lock);
-    return NULL; /* no free slots */
+/* Hook record idx into its bucket chain and the wheel */
+static void shard_link(shard_t *s, int32_t idx, uint64_t h)
+{
+    int32_t *head = &s->buckets[h & s->bucket_mask];
+    links[idx].next = *head;
+    *head = idx;
+    wheel_insert(s, idx, session_deadline(&records[idx]));
+    __atomic_store_n(&s->count, s->count + 1, __ATOMIC_RELAXED);  /* read lock-free by session_count */
 }
 
-const char *session_lookup(const char *token)
+static void record_free(int32_t idx)
 {
-    if (!token || !*token) return NULL;
+    session_t *sess = &records[idx];
+    __atomic_store_n(&sess->active, 0, __ATOMIC_RELEASE);
+    memset(sess, 0, sizeof(*sess));
+
+    pthread_mutex_lock(&free_lock);
+    links[idx].next = free_head;
+    free_head       = idx;
+    pthread_mutex_unlock(&free_lock);
+}
 
-    pthread_mutex_lock(&lock);
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (sessions[i].active &&
-            strncmp(sessions[i].token, token, TOKEN_LEN) == 0) {
-            pthread_mutex_unlock(&lock);
-            return sessions[i].username;
+/* A free record, or NIL when every one is live */
+static int32_t record_alloc(void)
+{
+    pthread_mutex_lock(&free_lock);
+    int32_t idx = free_head;
+    if (idx != NIL) free_head = links[idx].next;
+    pthread_mutex_unlock(&free_lock);
+    return idx;
+}
+
+/* Unlink record idx from the index and the wheel and return it to the free list */
+static void shard_release(shard_t *s, int32_t idx, int32_t *link)
+{
+    if (!link) shard_find(s, token_hash(records[idx].token), records[idx].token, &link);
+    *link = links[idx].next;
+    wheel_remove(s, idx);
+    record_free(idx);
+    __atomic_store_n(&s->count, s->count - 1, __ATOMIC_RELAXED);
+}
+
+/* Advance the shard's wheel to now, evicting sessions whose deadline passed */
+static void shard_expire(shard_t *s, int64_t now)
+{
+    while (s->wheel_now < now) {
+        s->wheel_now++;
+        int64_t t = s->wheel_now;
+
+        /* Cascade higher levels down when the level below wraps */
+        for (int l = 1; l < WHEEL_LEVELS; l++) {
+            if ((t & (((int64_t)1 << (WHEEL_BITS * l)) - 1)) != 0) break;
+            int32_t idx = wheel_take(s, l, (t >> (WHEEL_BITS * l)) & WHEEL_MASK);
+            while (idx != NIL) {
+                int32_t next = links[idx].wheel_next;
+                wheel_insert(s, idx, session_deadline(&records[idx]));
+                idx = next;
+            }
+        }
+
+        int32_t idx = wheel_take(s, 0, t & WHEEL_MASK);
+        while (idx != NIL) {
+            int32_t next     = links[idx].wheel_next;
+            int64_t deadline = session_deadline(&records[idx]);
+            if (deadline <= t) shard_release(s, idx, NULL);
+            else               wheel_insert(s, idx, deadline);
+            idx = next;
+        }
+    }
+}
+
+/*
+ * Rebuild the shards' indexes and wheels and the free list from the records.
+ * Records from a store file are kept if they are complete, intact and
+ * unexpired; everything else is zeroed and freed.
+ */
+static void rebuild(int64_t now)
+{
+    for (int32_t idx = (int32_t)nrecords - 1; idx >= 0; idx--) {
+        session_t *sess = &records[idx];
+        links[idx].wheel_slot = NIL;
+
+        if (sess->active &&
+            sess->checksum == session_checksum(sess) &&
+            session_deadline(sess) > now) {
+            uint64_t h = token_hash(sess->token);
+            shard_t *s = shard_for(h);
+            if (shard_find(s, h, sess->token, NULL) == NIL) {
+                shard_link(s, idx, h);
+                continue;
+            }
+        }
+        record_free(idx);
+    }
+}
+
+/*
+ * Zeroed, page-aligned memory for the session arrays. Lookups land
+ * at random across them, so huge pages save a TLB miss on most of them.
+ */
+static void *table_alloc(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    madvise(p, size, MADV_HUGEPAGE);
+    return p;
+}
+
+static void *expiry_thread(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        sleep(1);
+        int64_t now = now_sec();
+        for (uint32_t i = 0; i < SHARD_COUNT; i++) {
+            lock_timer_t t;
+            shard_lock(&shards[i], 1, &t);
+            shard_expire(&shards[i], now);
+            shard_unlock(&shards[i], 1, &t);
         }
     }
-    pthread_mutex_unlock(&lock);
     return NULL;
 }
 
-void session_destroy(const char *token)
+/* ── Public API ───────────────────────────────────────────────────────────── */
+
+int session_init(const session_config_t *cfg)
 {
-    if (!token || !*token) return;
+    if (cfg->max_sessions == 0 || cfg->max_sessions > INT32_MAX) return -1;
 
-    pthread_mutex_lock(&lock);
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (sessions[i].active &&
-            strncmp(sessions[i].token, token, TOKEN_LEN) == 0) {
-            sessions[i].active = 0;
-            memset(sessions[i].token,    0, sizeof(sessions[i].token));
-            memset(sessions[i].username, 0, sizeof(sessions[i].username));
-            break;
+    session_ttl      = cfg->ttl;
+    session_idle_ttl = cfg->idle_ttl;
+    nrecords         = (uint32_t)cfg->max_sessions;
+
+    /* A bucket per average shard share, so chains stay about one record long */
+    uint32_t per_shard = (nrecords + SHARD_COUNT - 1) / SHARD_COUNT;
+    uint32_t nbuckets  = 1;
+    while (nbuckets < per_shard) nbuckets <<= 1;
+
+    if (cfg->store_path) {
+        int fresh;
+        records = store_open(cfg->store_path, sizeof(session_t), nrecords, &fresh);
+    } else {
+        records = table_alloc((size_t)nrecords * sizeof(session_t));
+    }
+    links = table_alloc((size_t)nrecords * sizeof(session_link_t));
+    int32_t *buckets = table_alloc((size_t)SHARD_COUNT * nbuckets * sizeof(int32_t));
+    if (!records || !links || !buckets) return -1;
+    memset(buckets, 0xff, (size_t)SHARD_COUNT * nbuckets * sizeof(int32_t));   /* NIL */
+
+    int64_t now = now_sec();
+
+    for (uint32_t i = 0; i < SHARD_COUNT; i++) {
+        shard_t *s = &shards[i];
+        s->buckets = buckets + (size_t)i * nbuckets;
+        for (int l = 0; l < WHEEL_LEVELS; l++)
+            for (int w = 0; w < WHEEL_SIZE; w++)
+                s->wheel[l][w] = NIL;
+
+        s->bucket_mask = nbuckets - 1;
+        s->wheel_now   = now;
+        pthread_rwlock_init(&s->lock, NULL);
+    }
+    rebuild(now);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, expiry_thread, NULL) != 0) return -1;
+    pthread_detach(tid);
+    return 0;
+}
+
+int session_create(const char *username, char *token_out)
+{
+    int32_t idx = record_alloc();
+    if (idx == NIL) return -1;   /* max_sessions live */
+
+    for (int attempt = 0; attempt < CREATE_TRIES; attempt++) {
+        char token[SESSION_TOKEN_LEN + 1];
+        gen_token(token);
+
+        uint64_t h = token_hash(token);
+        shard_t *s = shard_for(h);
+        lock_timer_t t;
+
+        shard_lock(s, 1, &t);
+
+        if (shard_find(s, h, token, NULL) != NIL) {
+            shard_unlock(s, 1, &t);
+            continue;
+        }
+
+        session_t *sess = &records[idx];
+
+        memcpy(sess->token, token, sizeof(sess->token));
+        strncpy(sess->username, username, sizeof(sess->username) - 1);
+        sess->username[sizeof(sess->username) - 1] = '\0';
+        sess->created   = now_sec();
+        sess->last_seen = sess->created;
+        sess->checksum  = session_checksum(sess);
+        __atomic_store_n(&sess->active, 1, __ATOMIC_RELEASE);
+
+        shard_link(s, idx, h);
+
+        shard_unlock(s, 1, &t);
+
+        memcpy(token_out, token, sizeof(token));
+        return 0;
+    }
+
+    record_free(idx);
+    return -1; /* the random source keeps repeating itself */
+}
+
+int session_lookup(const char *token, session_info_t *out)
+{
+    if (!token_valid(token)) return -1;
+
+    uint64_t h   = token_hash(token);
+    shard_t *s   = shard_for(h);
+    int64_t  now = now_sec();
+    int      rc  = -1;
+    lock_timer_t t;
+
+    shard_lock(s, 0, &t);
+    int32_t idx = shard_find(s, h, token, NULL);
+    if (idx != NIL) {
+        session_t *sess = &records[idx];
+
+        /* The wheel may lag a tick behind — never hand out an expired session */
+        if (session_deadline(sess) > now) {
+            __atomic_store_n(&sess->last_seen, now, __ATOMIC_RELAXED);
+            if (out) {
+                /* Only the name's own bytes, not the whole buffer's cache lines */
+                size_t len = strnlen(sess->username, sizeof(sess->username) - 1);
+                memcpy(out->username, sess->username, len);
+                out->username[len] = '\0';
+                out->expires_in      = (long)(sess->created + session_ttl - now);
+                out->idle_expires_in = (long)session_idle_ttl;
+                if (out->idle_expires_in > out->expires_in)
+                    out->idle_expires_in = out->expires_in;
+            }
+            rc = 0;
         }
     }
-    pthread_mutex_unlock(&lock);
+    shard_unlock(s, 0, &t);
+
+    return rc;
+}
+
+void session_destroy(const char *token)
+{
+    if (!token_valid(token)) return;
+
+    uint64_t h = token_hash(token);
+    shard_t *s = shard_for(h);
+    int32_t *link;
+    lock_timer_t t;
+
+    shard_lock(s, 1, &t);
+    int32_t idx = shard_find(s, h, token, &link);
+    if (idx != NIL) shard_release(s, idx, link);
+    shard_unlock(s, 1, &t);
+}
+
+size_t session_count(void)
+{
+    size_t n = 0;
+    for (uint32_t i = 0; i < SHARD_COUNT; i++)
+        n += __atomic_load_n(&shards[i].count, __ATOMIC_RELAXED);
+    return n;
 }
@@ -1,13 +1,44 @@
 #ifndef SESSION_H
 #define SESSION_H
 
-/* Create a session for username — returns token string (valid until destroyed) */
-const char *session_create(const char *username);
+#include <stddef.h>
 
-/* Look up a token — returns username or NULL if not found */
-const char *session_lookup(const char *token);
+#define SESSION_TOKEN_LEN 32
+#define SESSION_USER_MAX  256
+
+typedef struct {
+    size_t   max_sessions;  /* live session capacity */
+    unsigned ttl;           /* absolute lifetime in seconds */
+    unsigned idle_ttl;      /* expire after this many seconds without a lookup */
+    const char *store_path; /* mmap'd store file, or NULL to keep sessions in memory */
+} session_config_t;
+
+typedef struct {
+    char username[SESSION_USER_MAX];
+    long expires_in;        /* seconds until the absolute TTL runs out */
+    long idle_expires_in;   /* seconds until idle expiry, counted from this lookup */
+} session_info_t;
+
+/*
+ * Allocate the session table and start the expiry thread. With a store
+ * path, sessions that were live in the file are served again immediately.
+ * Must be called once before any other session_* function.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int session_init(const session_config_t *cfg);
+
+/* Create a session for username — writes a NUL-terminated token into
+ * token_out (SESSION_TOKEN_LEN + 1 bytes). Returns 0, or -1 if the table is full */
+int session_create(const char *username, char *token_out);
+
+/* Look up a token and refresh its idle timer — fills *out (may be NULL)
+ * and returns 0, or -1 if not found or expired */
+int session_lookup(const char *token, session_info_t *out);
 
 /* Destroy a session */
 void session_destroy(const char *token);
 
+/* Live sessions across all shards — lock-free, may be a moment stale */
+size_t session_count(void);
+
 #endif
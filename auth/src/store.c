@@ -0,0 +1,56 @@
+#include "store.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define STORE_MAGIC   "CRIMSESS"
+#define STORE_VERSION 2
+#define HEADER_SIZE   4096   /* keep records page-aligned */
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t nrecords;
+} store_header_t;
+
+void *store_open(const char *path, size_t record_size, size_t nrecords, int *fresh)
+{
+    size_t size = HEADER_SIZE + record_size * nrecords;
+    store_header_t want = {
+        .magic       = STORE_MAGIC,
+        .version     = STORE_VERSION,
+        .record_size = (uint32_t)record_size,
+        .nrecords    = nrecords,
+    };
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) { perror(path); return NULL; }
+
+    store_header_t have;
+    struct stat st = {0};
+    *fresh = !(fstat(fd, &st) == 0 && (size_t)st.st_size == size &&
+               pread(fd, &have, sizeof(have), 0) == (ssize_t)sizeof(have) &&
+               memcmp(&have, &want, sizeof(want)) == 0);
+
+    if (*fresh) {
+        if (st.st_size > 0)
+            fprintf(stderr, "%s: layout changed, starting with an empty store\n", path);
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0 ||
+            pwrite(fd, &want, sizeof(want), 0) != (ssize_t)sizeof(want)) {
+            perror(path);
+            close(fd);
+            return NULL;
+        }
+    }
+
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) { perror(path); return NULL; }
+
+    return (char *)base + HEADER_SIZE;
+}
@@ -0,0 +1,14 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stddef.h>
+
+/*
+ * Map a fixed-layout record file at path with room for nrecords records of
+ * record_size bytes. An existing file is reused as-is when its header matches;
+ * otherwise it is recreated zero-filled and *fresh is set to 1.
+ * Returns the base of the record area, or NULL on error.
+ */
+void *store_open(const char *path, size_t record_size, size_t nrecords, int *fresh);
+
+#endif
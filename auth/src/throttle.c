@@ -0,0 +1,235 @@
+#include "throttle.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+
+#define MAX_BACKOFF 900.0   /* seconds — cap on the failure backoff */
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+/*
+ * Keys are stored as 64-bit hashes only, so a table entry is a fixed size
+ * whatever the username, and nothing the client typed is kept around.
+ */
+typedef struct entry {
+    uint64_t      key;
+    double        tokens;
+    double        last;            /* monotonic seconds of last refill */
+    double        blocked_until;   /* backoff deadline, 0 if none */
+    unsigned      failures;        /* consecutive failed logins */
+    struct entry *hnext;           /* bucket chain */
+    struct entry *prev, *next;     /* LRU list, head = most recent */
+} entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    double          rate;          /* tokens per second, 0 = disabled */
+    double          burst;
+    entry_t        *entries;
+    entry_t       **buckets;
+    size_t          mask;
+    size_t          used;
+    size_t          cap;
+    entry_t        *head, *tail;
+} table_t;
+
+static table_t  ip_table, user_table;
+static uint64_t seed;
+static uint64_t allowed, rejected_ip, rejected_user, evictions;
+
+static double now_mono(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* FNV-1a from a random offset, so bucket placement can't be predicted */
+static uint64_t key_hash(const char *s)
+{
+    uint64_t h = seed;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static int table_init(table_t *t, double per_minute, double burst, size_t cap)
+{
+    pthread_mutex_init(&t->lock, NULL);
+    t->rate  = per_minute / 60.0;
+    t->burst = burst < 1 ? 1 : burst;
+    t->cap   = cap;
+    if (t->rate <= 0) return 0;
+
+    size_t nbuckets = 1;
+    while (nbuckets < cap) nbuckets <<= 1;
+
+    t->entries = calloc(cap, sizeof(entry_t));
+    t->buckets = calloc(nbuckets, sizeof(entry_t *));
+    if (!t->entries || !t->buckets) return -1;
+    t->mask = nbuckets - 1;
+    return 0;
+}
+
+static void lru_unlink(table_t *t, entry_t *e)
+{
+    if (e->prev) e->prev->next = e->next; else t->head = e->next;
+    if (e->next) e->next->prev = e->prev; else t->tail = e->prev;
+}
+
+static void lru_push(table_t *t, entry_t *e)
+{
+    e->prev = NULL;
+    e->next = t->head;
+    if (t->head) t->head->prev = e; else t->tail = e;
+    t->head = e;
+}
+
+/* Entry for key, created with a full bucket if new — caller holds t->lock */
+static entry_t *table_get(table_t *t, uint64_t key, double now)
+{
+    entry_t **slot = &t->buckets[key & t->mask];
+
+    for (entry_t *e = *slot; e; e = e->hnext) {
+        if (e->key == key) {
+            lru_unlink(t, e);
+            lru_push(t, e);
+            return e;
+        }
+    }
+
+    entry_t *e;
+    if (t->used < t->cap) {
+        e = &t->entries[t->used++];
+    } else {
+        /* Full: recycle the least recently used key */
+        e = t->tail;
+        lru_unlink(t, e);
+        entry_t **pp = &t->buckets[e->key & t->mask];
+        while (*pp != e) pp = &(*pp)->hnext;
+        *pp = e->hnext;
+        __atomic_fetch_add(&evictions, 1, __ATOMIC_RELAXED);
+    }
+
+    e->key           = key;
+    e->tokens        = t->burst;
+    e->last          = now;
+    e->blocked_until = 0;
+    e->failures      = 0;
+    e->hnext         = *slot;
+    *slot = e;
+    lru_push(t, e);
+    return e;
+}
+
+/* Refill e and return the seconds until an attempt is allowed (0 = now) */
+static double entry_wait(const table_t *t, entry_t *e, double now)
+{
+    e->tokens = fmin(t->burst, e->tokens + (now - e->last) * t->rate);
+    e->last   = now;
+
+    if (now < e->blocked_until) return e->blocked_until - now;
+    if (e->tokens >= 1)         return 0;
+    return (1 - e->tokens) / t->rate;
+}
+
+int throttle_init(const throttle_config_t *cfg)
+{
+    if (getrandom(&seed, sizeof(seed), 0) != sizeof(seed))
+        seed = (uint64_t)time(NULL);
+    seed ^= FNV_OFFSET;
+
+    size_t cap = cfg->max_entries ? cfg->max_entries : 1;
+    if (table_init(&ip_table, cfg->ip_rate, cfg->ip_burst, cap) != 0) return -1;
+    if (table_init(&user_table, cfg->user_rate, cfg->user_burst, cap) != 0) return -1;
+    return 0;
+}
+
+unsigned throttle_check(const char *ip, const char *username)
+{
+    double   now = now_mono();
+    entry_t *ie  = NULL, *ue = NULL;
+    double   ip_wait = 0, user_wait = 0;
+
+    /* Lock order: ip table, then user table */
+    if (ip_table.rate > 0) {
+        pthread_mutex_lock(&ip_table.lock);
+        ie      = table_get(&ip_table, key_hash(ip), now);
+        ip_wait = entry_wait(&ip_table, ie, now);
+    }
+    if (user_table.rate > 0) {
+        pthread_mutex_lock(&user_table.lock);
+        ue        = table_get(&user_table, key_hash(username), now);
+        user_wait = entry_wait(&user_table, ue, now);
+    }
+
+    /* Only spend a token when both sides let the attempt through */
+    if (ip_wait == 0 && user_wait == 0) {
+        if (ie) ie->tokens -= 1;
+        if (ue) ue->tokens -= 1;
+    }
+
+    if (ue) pthread_mutex_unlock(&user_table.lock);
+    if (ie) pthread_mutex_unlock(&ip_table.lock);
+
+    if (ip_wait > 0) {
+        __atomic_fetch_add(&rejected_ip, 1, __ATOMIC_RELAXED);
+    } else if (user_wait > 0) {
+        __atomic_fetch_add(&rejected_user, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&allowed, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    double wait = fmax(ip_wait, user_wait);
+    return wait < 1 ? 1 : (unsigned)ceil(wait);
+}
+
+static void record(table_t *t, const char *key, int success, double now)
+{
+    if (t->rate <= 0) return;
+
+    pthread_mutex_lock(&t->lock);
+    entry_t *e = table_get(t, key_hash(key), now);
+    if (success) {
+        e->failures      = 0;
+        e->blocked_until = 0;
+    } else if (++e->failures > t->burst) {
+        /* 1 s, 2 s, 4 s … once the burst's worth of failures is used up */
+        int    shift = (int)(e->failures - t->burst) - 1;
+        double delay = ldexp(1.0, shift > 10 ? 10 : shift);
+        e->blocked_until = now + fmin(delay, MAX_BACKOFF);
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+void throttle_record(const char *ip, const char *username, int success)
+{
+    double now = now_mono();
+    record(&ip_table, ip, success, now);
+    record(&user_table, username, success, now);
+}
+
+void throttle_stats(throttle_stats_t *out)
+{
+    out->allowed       = __atomic_load_n(&allowed, __ATOMIC_RELAXED);
+    out->rejected_ip   = __atomic_load_n(&rejected_ip, __ATOMIC_RELAXED);
+    out->rejected_user = __atomic_load_n(&rejected_user, __ATOMIC_RELAXED);
+    out->evictions     = __atomic_load_n(&evictions, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&ip_table.lock);
+    out->ip_entries = ip_table.used;
+    pthread_mutex_unlock(&ip_table.lock);
+
+    pthread_mutex_lock(&user_table.lock);
+    out->user_entries = user_table.used;
+    pthread_mutex_unlock(&user_table.lock);
+
+    out->max_entries = ip_table.cap;
+}
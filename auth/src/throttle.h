@@ -0,0 +1,45 @@
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Login throttling in front of PAM: a token bucket per client IP and per
+ * username, plus exponential backoff once a key keeps failing. Each table
+ * holds at most max_entries keys and evicts the least recently used.
+ * A rate of 0 disables that table.
+ */
+typedef struct {
+    double ip_rate;       /* attempts per minute, refilled continuously */
+    double ip_burst;
+    double user_rate;
+    double user_burst;
+    size_t max_entries;   /* per table */
+} throttle_config_t;
+
+typedef struct {
+    uint64_t allowed;
+    uint64_t rejected_ip;
+    uint64_t rejected_user;
+    uint64_t evictions;
+    size_t   ip_entries;
+    size_t   user_entries;
+    size_t   max_entries;
+} throttle_stats_t;
+
+/* Allocate both tables. Returns 0 or -1 */
+int      throttle_init(const throttle_config_t *cfg);
+
+/*
+ * Take one attempt from both buckets. Returns 0 if the login may go ahead,
+ * otherwise the seconds to wait (nothing is consumed when rejecting).
+ */
+unsigned throttle_check(const char *ip, const char *username);
+
+/* Feed back the PAM outcome — failures build up backoff, success clears it */
+void     throttle_record(const char *ip, const char *username, int success);
+
+void     throttle_stats(throttle_stats_t *out);
+
+#endif
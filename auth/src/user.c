@@ -1,79 +1,348 @@
+#define _GNU_SOURCE   /* pipe2 */
 #include "user.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
+extern char **environ;
+
+#define USERADD  "/usr/sbin/useradd"
+#define CHPASSWD "/usr/sbin/chpasswd"
+
+#define MAX_JOBS 32   /* finished jobs are kept for status polls until reused */
+
 /*
- * Run a command with two arguments, writing optional stdin data to it.
- * Returns the exit code, or -1 on fork/exec failure.
+ * Run a command, writing optional stdin data to it.
+ * posix_spawn lets libc use vfork/clone(CLONE_VM), so the daemon's address
+ * space is never copied just to exec.
+ * Returns the exit code, or -1 on spawn failure.
  */
 static int run_cmd(const char *path, const char *const argv[],
-                   const char *stdin_data)
+                   const char *stdin_data, size_t stdin_len)
 {
     int pipefd[2] = {-1, -1};
+    posix_spawn_file_actions_t fa;
 
     if (stdin_data) {
-        if (pipe(pipefd) != 0) return -1;
+        if (pipe2(pipefd, O_CLOEXEC) != 0) return -1;
     }
 
-    pid_t pid = fork();
-    if (pid < 0) return -1;
+    posix_spawn_file_actions_init(&fa);
+    if (stdin_data)
+        posix_spawn_file_actions_adddup2(&fa, pipefd[0], STDIN_FILENO);
 
-    if (pid == 0) {
-        /* child */
-        if (stdin_data) {
-            close(pipefd[1]);
-            dup2(pipefd[0], STDIN_FILENO);
-            close(pipefd[0]);
-        }
-        execv(path, (char *const *)argv);
-        _exit(127);
+    pid_t pid;
+    int rc = posix_spawn(&pid, path, &fa, NULL, (char *const *)argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+
+    if (stdin_data) close(pipefd[0]);
+    if (rc != 0) {
+        if (stdin_data) close(pipefd[1]);
+        return -1;
     }
 
-    /* parent */
     if (stdin_data) {
-        close(pipefd[0]);
-        size_t len = strlen(stdin_data);
-        write(pipefd[1], stdin_data, len);
+        size_t off = 0;
+        while (off < stdin_len) {
+            ssize_t n = write(pipefd[1], stdin_data + off, stdin_len - off);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;   /* child went away; its exit status says why */
+            }
+            off += (size_t)n;
+        }
         close(pipefd[1]);
     }
 
     int status;
-    waitpid(pid, &status, 0);
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
     if (WIFEXITED(status)) return WEXITSTATUS(status);
     return -1;
 }
 
-int user_create(const char *username, const char *password)
+/* Username must be non-empty and only contain safe chars */
+static int username_valid(const char *username)
 {
-    /* Validate: username must be non-empty and only contain safe chars */
-    if (!username || !*username || !password || !*password) return -1;
+    if (!username || !*username) return 0;
     for (const char *p = username; *p; p++) {
         char c = *p;
         if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
               (c >= '0' && c <= '9') || c == '_' || c == '-'))
-            return -1;
+            return 0;
     }
+    return 1;
+}
 
-    /* useradd -m -s /bin/bash <username> */
-    const char *useradd_argv[] = {
-        "/usr/sbin/useradd", "-m", "-s", "/bin/bash", username, NULL
+/* chpasswd input is line-based, so a newline would start another user's entry */
+static int password_valid(const char *password)
+{
+    return password && *password && !strchr(password, '\n');
+}
+
+/* useradd -m -s /bin/bash <username> */
+static int useradd(const char *username)
+{
+    const char *argv[] = {
+        USERADD, "-m", "-s", "/bin/bash", username, NULL
     };
-    int rc = run_cmd("/usr/sbin/useradd", useradd_argv, NULL);
-    if (rc != 0) return -1;
+    return run_cmd(USERADD, argv, NULL, 0);
+}
+
+/* chpasswd reads "username:password\n" lines from stdin */
+static int chpasswd(const char *input, size_t len)
+{
+    const char *argv[] = { CHPASSWD, NULL };
+    return run_cmd(CHPASSWD, argv, input, len);
+}
 
-    /* chpasswd reads "username:password\n" from stdin */
-    char chpasswd_input[512];
-    snprintf(chpasswd_input, sizeof(chpasswd_input), "%s:%s\n", username, password);
+int user_create(const char *username, const char *password)
+{
+    if (!username_valid(username) || !password_valid(password)) return -1;
 
-    const char *chpasswd_argv[] = { "/usr/sbin/chpasswd", NULL };
-    rc = run_cmd("/usr/sbin/chpasswd", chpasswd_argv, chpasswd_input);
+    if (useradd(username) != 0) return -1;
+
+    char chpasswd_input[USER_NAME_MAX + USER_PASS_MAX + 2];
+    int len = snprintf(chpasswd_input, sizeof(chpasswd_input), "%s:%s\n", username, password);
+    int rc  = chpasswd(chpasswd_input, (size_t)len);
 
     /* Zero out the password from the stack before returning */
     memset(chpasswd_input, 0, sizeof(chpasswd_input));
 
     return (rc == 0) ? 0 : -1;
 }
+
+/* ── Batch jobs ───────────────────────────────────────────────────────────── */
+
+typedef enum { JOB_FREE, JOB_QUEUED, JOB_RUNNING, JOB_DONE } job_state_t;
+
+typedef struct {
+    user_spec_t spec;
+    const char *error;   /* NULL once created */
+    int         done;
+} job_user_t;
+
+typedef struct job {
+    long         id;
+    job_state_t  state;
+    time_t       submitted;
+    size_t       n;
+    size_t       processed;
+    job_user_t  *users;
+    struct job  *next;   /* run queue */
+} job_t;
+
+static job_t           jobs[MAX_JOBS];
+static job_t          *queue_head, *queue_tail;
+static long            next_id = 1;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  ready = PTHREAD_COND_INITIALIZER;
+static pthread_once_t  worker_once = PTHREAD_ONCE_INIT;
+static int             worker_ok;
+
+/* Record a per-user outcome; counted as processed under the lock */
+static void job_finish_user(job_t *job, job_user_t *u, const char *error)
+{
+    pthread_mutex_lock(&lock);
+    u->error = error;
+    u->done  = 1;
+    job->processed++;
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * One job: a useradd per user (there is no batch form), then a single
+ * chpasswd for every user that now exists. chpasswd only reports failure
+ * as a whole, so if it fails every user in the batch is marked failed.
+ */
+static void job_run(job_t *job)
+{
+    size_t cap = 0;
+    for (size_t i = 0; i < job->n; i++)
+        cap += strlen(job->users[i].spec.username) + strlen(job->users[i].spec.password) + 2;
+
+    char  *input = malloc(cap + 1);
+    size_t len   = 0;
+    size_t added = 0;
+
+    for (size_t i = 0; i < job->n; i++) {
+        job_user_t *u = &job->users[i];
+        if (!username_valid(u->spec.username) || !password_valid(u->spec.password)) {
+            job_finish_user(job, u, "invalid username or password");
+        } else if (!input) {
+            job_finish_user(job, u, "out of memory");
+        } else if (useradd(u->spec.username) != 0) {
+            job_finish_user(job, u, "useradd failed");
+        } else {
+            len += (size_t)sprintf(input + len, "%s:%s\n", u->spec.username, u->spec.password);
+            added++;
+        }
+        memset(u->spec.password, 0, sizeof(u->spec.password));
+    }
+
+    int rc = added ? chpasswd(input, len) : 0;
+    if (input) {
+        memset(input, 0, len);
+        free(input);
+    }
+
+    for (size_t i = 0; i < job->n; i++) {
+        job_user_t *u = &job->users[i];
+        if (!u->done) job_finish_user(job, u, rc == 0 ? NULL : "chpasswd failed");
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (!queue_head)
+            pthread_cond_wait(&ready, &lock);
+        job_t *job = queue_head;
+        queue_head = job->next;
+        if (!queue_head) queue_tail = NULL;
+        job->state = JOB_RUNNING;
+        pthread_mutex_unlock(&lock);
+
+        job_run(job);
+
+        pthread_mutex_lock(&lock);
+        job->state = JOB_DONE;
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+static void worker_start(void)
+{
+    pthread_t t;
+    if (pthread_create(&t, NULL, worker_main, NULL) == 0) {
+        pthread_detach(t);
+        worker_ok = 1;
+    }
+}
+
+/* Free slot, else the oldest finished job — caller holds lock */
+static job_t *job_slot(void)
+{
+    job_t *oldest = NULL;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (jobs[i].state == JOB_FREE) return &jobs[i];
+        if (jobs[i].state == JOB_DONE && (!oldest || jobs[i].id < oldest->id))
+            oldest = &jobs[i];
+    }
+    if (oldest) {
+        free(oldest->users);
+        oldest->users = NULL;
+    }
+    return oldest;
+}
+
+long user_batch_submit(const user_spec_t *users, size_t n)
+{
+    pthread_once(&worker_once, worker_start);
+    if (!worker_ok || n == 0) return -1;
+
+    job_user_t *copy = calloc(n, sizeof(*copy));
+    if (!copy) return -1;
+    for (size_t i = 0; i < n; i++)
+        copy[i].spec = users[i];
+
+    pthread_mutex_lock(&lock);
+    job_t *job = job_slot();
+    if (!job) {
+        pthread_mutex_unlock(&lock);
+        for (size_t i = 0; i < n; i++)
+            memset(copy[i].spec.password, 0, sizeof(copy[i].spec.password));
+        free(copy);
+        return -1;
+    }
+
+    job->id        = next_id++;
+    job->state     = JOB_QUEUED;
+    job->submitted = time(NULL);
+    job->n         = n;
+    job->processed = 0;
+    job->users     = copy;
+    job->next      = NULL;
+    if (queue_tail) queue_tail->next = job;
+    else            queue_head = job;
+    queue_tail = job;
+
+    long id = job->id;
+    pthread_cond_signal(&ready);
+    pthread_mutex_unlock(&lock);
+    return id;
+}
+
+static const char *state_name(job_state_t s)
+{
+    switch (s) {
+    case JOB_QUEUED:  return "queued";
+    case JOB_RUNNING: return "running";
+    case JOB_DONE:    return "done";
+    default:          return "unknown";
+    }
+}
+
+/*
+ * { id, state, total, processed, submitted,
+ *   created: [username...], failed: [{ username, error }...] }
+ */
+int user_batch_status(long id, jw_t *w)
+{
+    pthread_mutex_lock(&lock);
+
+    job_t *job = NULL;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (jobs[i].state != JOB_FREE && jobs[i].id == id) {
+            job = &jobs[i];
+            break;
+        }
+    }
+    if (!job) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    jw_object_begin(w);
+    jw_key(w, "id");        jw_int(w, job->id);
+    jw_key(w, "state");     jw_string(w, state_name(job->state));
+    jw_key(w, "total");     jw_uint(w, job->n);
+    jw_key(w, "processed"); jw_uint(w, job->processed);
+    jw_key(w, "submitted"); jw_int(w, (long long)job->submitted);
+
+    jw_key(w, "created");
+    jw_array_begin(w);
+    for (size_t i = 0; i < job->n; i++) {
+        if (job->users[i].done && !job->users[i].error)
+            jw_string(w, job->users[i].spec.username);
+    }
+    jw_array_end(w);
+
+    jw_key(w, "failed");
+    jw_array_begin(w);
+    for (size_t i = 0; i < job->n; i++) {
+        job_user_t *u = &job->users[i];
+        if (!u->done || !u->error) continue;
+        jw_object_begin(w);
+        jw_key(w, "username"); jw_string(w, u->spec.username);
+        jw_key(w, "error");    jw_string(w, u->error);
+        jw_object_end(w);
+    }
+    jw_array_end(w);
+    jw_object_end(w);
+
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
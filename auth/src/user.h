@@ -1,10 +1,32 @@
 #ifndef USER_H
 #define USER_H
 
+#include <stddef.h>
+#include "json.h"
+
+#define USER_NAME_MAX 256
+#define USER_PASS_MAX 256
+
+typedef struct {
+    char username[USER_NAME_MAX];
+    char password[USER_PASS_MAX];
+} user_spec_t;
+
 /*
  * Create a new Linux user with useradd + set password via chpasswd.
  * Returns 0 on success, -1 on error (user already exists, permission denied, etc.)
  */
 int user_create(const char *username, const char *password);
 
+/*
+ * Queue creation of n users as one background job: a useradd per user, then
+ * a single chpasswd fed every password line. The specs are copied, so the
+ * caller may wipe them straight away.
+ * Returns the job id (> 0), or -1 if too many jobs are still unfinished.
+ */
+long user_batch_submit(const user_spec_t *users, size_t n);
+
+/* Write the status of job id as a JSON object into w — 0, or -1 if unknown */
+int  user_batch_status(long id, jw_t *w);
+
 #endif
@@ -0,0 +1,297 @@
+/*
+ * jsonbench — libcrimata's JSON tokenizer and writer against the strstr
+ * helpers they replaced, copied below as they were: json_get from
+ * crimata-auth (crimata-dock's json_str was the same code), json_int and
+ * json_raw_value from crimata-dock.
+ *
+ *   login     pull username and password out of a POST /auth body
+ *   manifest  read every field the dock takes from a crimata.json
+ *   response  write the POST /auth answer: snprintf vs the writer
+ *
+ * The old helpers are not equivalent — they stop at the first escaped quote,
+ * match keys inside nested values and clip long values — so this measures
+ * what correctness costs, not a like-for-like swap. One JSON object per case
+ * is appended to --out, like loadgen's.
+ */
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "json.h"
+
+#define MAX_FILE_SIZE 16384
+
+static const char login_body[] = "{\"username\":\"bench\",\"password\":\"correct horse battery staple\"}";
+static const char token[]      = "0123456789abcdef0123456789abcdef";
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Keeps the compiler from dropping a result */
+static volatile size_t sink;
+
+/* ── The old helpers ──────────────────────────────────────────────────────── */
+
+static const char *json_get(const char *json, const char *key, char *out, size_t out_len)
+{
+    char search[128];
+    snprintf(search, sizeof(search), "\"%s\"", key);
+    const char *pos = strstr(json, search);
+    if (!pos) return NULL;
+
+    pos += strlen(search);
+    while (*pos == ' ' || *pos == ':') pos++;
+    if (*pos != '"') return NULL;
+    pos++;
+
+    size_t i = 0;
+    while (*pos && *pos != '"' && i < out_len - 1)
+        out[i++] = *pos++;
+    out[i] = '\0';
+    return out;
+}
+
+static int json_int(const char *json, const char *key, int *out)
+{
+    char search[128];
+    snprintf(search, sizeof(search), "\"%s\"", key);
+    const char *pos = strstr(json, search);
+    if (!pos) return 0;
+
+    pos += strlen(search);
+    while (*pos == ' ' || *pos == ':') pos++;
+    if (*pos < '0' || *pos > '9') return 0;
+
+    *out = atoi(pos);
+    return 1;
+}
+
+static int json_raw_value(const char *json, const char *key, char *out, size_t out_len)
+{
+    char search[128];
+    snprintf(search, sizeof(search), "\"%s\"", key);
+    const char *pos = strstr(json, search);
+    if (!pos) return 0;
+
+    pos += strlen(search);
+    while (*pos == ' ' || *pos == ':') pos++;
+    if (*pos != '[' && *pos != '{') return 0;
+
+    char open  = *pos;
+    char close = (open == '[') ? ']' : '}';
+    int  depth  = 0;
+    int  in_str = 0;
+    size_t i = 0;
+
+    while (*pos && i < out_len - 1) {
+        char c = *pos;
+        out[i++] = c;
+
+        if (in_str) {
+            if (c == '\\' && *(pos + 1)) {
+                pos++;
+                if (i < out_len - 1) out[i++] = *pos;
+            } else if (c == '"') {
+                in_str = 0;
+            }
+        } else {
+            if (c == '"')       in_str = 1;
+            else if (c == open)  depth++;
+            else if (c == close) {
+                depth--;
+                if (depth == 0) { pos++; break; }
+            }
+        }
+        pos++;
+    }
+
+    out[i] = '\0';
+    return (depth == 0 && i > 0) ? 1 : 0;
+}
+
+/* ── Cases ────────────────────────────────────────────────────────────────── */
+
+static char manifest[MAX_FILE_SIZE];
+static size_t manifest_len;
+
+static void login_old(void)
+{
+    char username[256], password[256];
+    if (json_get(login_body, "username", username, sizeof(username)) &&
+        json_get(login_body, "password", password, sizeof(password)))
+        sink += strlen(username) + strlen(password);
+}
+
+static void login_new(void)
+{
+    char       mem[2048];
+    arena_t    arena;
+    json_doc_t doc;
+    char       username[256], password[256];
+    arena_init(&arena, mem, sizeof(mem), 0);
+    if (json_parse_arena(&doc, login_body, sizeof(login_body) - 1, &arena) == 0 &&
+        json_get_string(&doc, 0, "username", username, sizeof(username)) >= 0 &&
+        json_get_string(&doc, 0, "password", password, sizeof(password)) >= 0)
+        sink += strlen(username) + strlen(password);
+    arena_free(&arena);
+}
+
+static void manifest_old(void)
+{
+    char id[256], name[256], icon[256], def[256];
+    char components[4096], api[8192];
+    int  port = 0;
+    json_get(manifest, "id",               id,   sizeof(id));
+    json_get(manifest, "name",             name, sizeof(name));
+    json_get(manifest, "icon",             icon, sizeof(icon));
+    json_get(manifest, "defaultComponent", def,  sizeof(def));
+    json_int(manifest, "port", &port);
+    json_raw_value(manifest, "components", components, sizeof(components));
+    json_raw_value(manifest, "api",        api,        sizeof(api));
+    sink += strlen(id) + strlen(api) + (size_t)port;
+}
+
+static void manifest_new(void)
+{
+    static char mem[MAX_FILE_SIZE * 2];
+    arena_t     arena;
+    json_doc_t  doc;
+    char        id[256], name[256], icon[256], def[256];
+    long        port = 0;
+    arena_init(&arena, mem, sizeof(mem), 0);
+    if (json_parse_arena(&doc, manifest, manifest_len, &arena) == 0) {
+        json_get_string(&doc, 0, "id",               id,   sizeof(id));
+        json_get_string(&doc, 0, "name",             name, sizeof(name));
+        json_get_string(&doc, 0, "icon",             icon, sizeof(icon));
+        json_get_string(&doc, 0, "defaultComponent", def,  sizeof(def));
+        json_get_int(&doc, 0, "port", &port);
+        int components = json_object_get(&doc, 0, "components");
+        int api        = json_object_get(&doc, 0, "api");
+        if (components >= 0 && api >= 0)
+            sink += json_slice(&doc, components).len + json_slice(&doc, api).len;
+        sink += strlen(id) + (size_t)port;
+    }
+    arena_free(&arena);
+}
+
+static void response_old(void)
+{
+    char resp[320];
+    sink += (size_t)snprintf(resp, sizeof(resp),
+                             "{\"success\":true,\"token\":\"%s\",\"username\":\"%s\"}",
+                             token, "bench");
+}
+
+static void response_new(void)
+{
+    char    mem[512];
+    arena_t arena;
+    jw_t    w;
+    size_t  len;
+    arena_init(&arena, mem, sizeof(mem), 0);
+    jw_init(&w, &arena, 0);
+    jw_object_begin(&w);
+    jw_key(&w, "success");  jw_bool(&w, 1);
+    jw_key(&w, "token");    jw_string(&w, token);
+    jw_key(&w, "username"); jw_string(&w, "bench");
+    jw_object_end(&w);
+    if (jw_finish(&w, &len)) sink += len;
+    arena_free(&arena);
+}
+
+/* Mean ns per call over iterations, after a short warmup */
+static double time_it(void (*fn)(void), unsigned long iterations)
+{
+    for (unsigned long i = 0; i < iterations / 10; i++) fn();
+    uint64_t t0 = now_ns();
+    for (unsigned long i = 0; i < iterations; i++) fn();
+    return (double)(now_ns() - t0) / (double)iterations;
+}
+
+static int report(const char *out, const char *name, double old_ns, double new_ns)
+{
+    printf("json     %-9s  old %8.0f ns  new %8.0f ns  (%.2fx)\n",
+           name, old_ns, new_ns, old_ns / new_ns);
+    if (!out) return 0;
+
+    char    mem[512];
+    arena_t arena;
+    jw_t    w;
+    arena_init(&arena, mem, sizeof(mem), 0);
+    jw_init(&w, &arena, 0);
+    jw_object_begin(&w);
+    jw_key(&w, "label"); jw_string(&w, "json");
+    jw_key(&w, "case");  jw_string(&w, name);
+    jw_key(&w, "oldNs"); jw_double(&w, old_ns);
+    jw_key(&w, "newNs"); jw_double(&w, new_ns);
+    jw_object_end(&w);
+
+    const char *line = jw_finish(&w, NULL);
+    FILE *f = fopen(out, "a");
+    if (!f || !line) {
+        fprintf(stderr, "cannot write %s\n", out);
+        if (f) fclose(f);
+        arena_free(&arena);
+        return 1;
+    }
+    fprintf(f, "%s\n", line);
+    fclose(f);
+    arena_free(&arena);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] MANIFEST\n"
+            "  -i N          iterations per case (default 1000000)\n"
+            "  --out FILE    append a JSON results line per case to FILE\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = 1000000;
+    const char   *out        = NULL;
+
+    static const struct option opts[] = {
+        { "out",  required_argument, NULL, 'o' },
+        { "help", no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "hi:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'i': iterations = strtoul(optarg, NULL, 10); break;
+        case 'o': out        = optarg;                    break;
+        case 'h': usage(argv[0]); return 0;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc - 1 || iterations == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[optind], "r");
+    if (!f) {
+        perror(argv[optind]);
+        return 1;
+    }
+    manifest_len = fread(manifest, 1, sizeof(manifest) - 1, f);
+    fclose(f);
+    manifest[manifest_len] = '\0';
+
+    int rc = 0;
+    rc |= report(out, "login",    time_it(login_old, iterations),    time_it(login_new, iterations));
+    rc |= report(out, "manifest", time_it(manifest_old, iterations), time_it(manifest_new, iterations));
+    rc |= report(out, "response", time_it(response_old, iterations), time_it(response_new, iterations));
+    return rc;
+}
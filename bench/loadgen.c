@@ -0,0 +1,544 @@
+/*
+ * loadgen — closed-loop HTTP/1.1 load generator for the crimata daemons.
+ *
+ * Each of -c threads holds one keep-alive connection and sends the same
+ * request back to back for -d seconds after a warmup. Latency goes into a
+ * log-linear histogram per thread (merged at the end), and one JSON object
+ * per run is appended to --out so results can be diffed between releases.
+ *
+ * The server's /metrics is scraped either side of the measured window, and
+ * the response objects and arena chunks it allocated are reported per
+ * request (when the daemon exports them).
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "json.h"
+
+/* Power-of-two ns buckets split 8 ways — under 12.5% error per percentile */
+#define HIST_SUB_BITS 3
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  (64 * HIST_SUB)
+
+#define MAX_REQUEST   8192
+
+typedef struct {
+    const char *host;
+    const char *port;
+    const char *method;
+    const char *path;
+    const char *body;
+    const char *label;
+    const char *out;
+    char        auth[512];       /* "Authorization: Bearer …\r\n" or "" */
+    unsigned    conns;
+    unsigned    server_threads;  /* recorded in the results line, if set */
+    double      duration;
+    double      warmup;
+} config_t;
+
+typedef struct {
+    pthread_t   tid;
+    uint64_t    requests;
+    uint64_t    errors;
+    uint64_t    max_ns;
+    uint64_t    hist[HIST_BUCKETS];
+} worker_t;
+
+static config_t cfg = {
+    .host = "127.0.0.1", .port = "7700", .method = "GET", .path = "/health",
+    .label = "", .conns = 4, .duration = 10, .warmup = 1,
+};
+
+static char   request[MAX_REQUEST];
+static size_t request_len;
+static volatile int measuring, stopping;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int hist_bucket(uint64_t v)
+{
+    if (v < HIST_SUB) return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int sub = (int)((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    int b   = (msb - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+    return b < HIST_BUCKETS ? b : HIST_BUCKETS - 1;
+}
+
+static uint64_t hist_upper(int b)
+{
+    if (b < HIST_SUB) return (uint64_t)b + 1;
+    int msb = b / HIST_SUB + HIST_SUB_BITS - 1;
+    int sub = b % HIST_SUB;
+    return ((uint64_t)(HIST_SUB + sub + 1)) << (msb - HIST_SUB_BITS);
+}
+
+static double percentile_ms(const uint64_t *hist, uint64_t n, uint64_t max_ns, double p)
+{
+    if (n == 0) return 0;
+    uint64_t rank = (uint64_t)(p * (double)n + 0.5);
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen >= rank) {
+            uint64_t ns = hist_upper(b);
+            return (double)(ns < max_ns ? ns : max_ns) / 1e6;
+        }
+    }
+    return (double)max_ns / 1e6;
+}
+
+/* ── Connection ───────────────────────────────────────────────────────────── */
+
+static int dial(void)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res;
+    if (getaddrinfo(cfg.host, cfg.port, &hints, &res) != 0) return -1;
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char *p, size_t n)
+{
+    while (n) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* Case-insensitive header lookup in the head block — value or NULL */
+static const char *header(const char *head, const char *name)
+{
+    size_t nlen = strlen(name);
+    for (const char *p = strstr(head, "\r\n"); p && p[2] != '\r'; p = strstr(p + 2, "\r\n")) {
+        if (strncasecmp(p + 2, name, nlen) == 0 && p[2 + nlen] == ':') {
+            const char *v = p + 3 + nlen;
+            while (*v == ' ') v++;
+            return v;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Read one response into *buf (grown as needed). Returns the status code,
+ * or -1 on a broken connection; *keep is cleared if the server closes.
+ * Only Content-Length framing is handled — all the daemons send it.
+ */
+static int read_response(int fd, char **buf, size_t *cap, int *keep, char **body, size_t *body_len)
+{
+    size_t len = 0, need = 0, head_len = 0;
+    int    status = -1;
+
+    for (;;) {
+        if (len + 1 >= *cap) {
+            char *p = realloc(*buf, *cap * 2);
+            if (!p) return -1;
+            *buf = p;
+            *cap *= 2;
+        }
+
+        ssize_t r = recv(fd, *buf + len, *cap - len - 1, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        len += (size_t)r;
+        (*buf)[len] = '\0';
+
+        if (!head_len) {
+            char *end = strstr(*buf, "\r\n\r\n");
+            if (!end) continue;
+            head_len = (size_t)(end - *buf) + 4;
+
+            if (sscanf(*buf, "HTTP/1.%*d %d", &status) != 1) return -1;
+            const char *cl = header(*buf, "Content-Length");
+            need = head_len + (cl ? strtoul(cl, NULL, 10) : 0);
+            const char *conn = header(*buf, "Connection");
+            *keep = !(conn && strncasecmp(conn, "close", 5) == 0);
+        }
+        if (len >= need) break;
+    }
+
+    if (body) {
+        *body     = *buf + head_len;
+        *body_len = need - head_len;
+    }
+    return status;
+}
+
+/* ── Workers ──────────────────────────────────────────────────────────────── */
+
+static void *worker_main(void *arg)
+{
+    worker_t *w   = arg;
+    size_t    cap = 65536;
+    char     *buf = malloc(cap);
+    int       fd  = -1;
+
+    while (!stopping && buf) {
+        if (fd < 0 && (fd = dial()) < 0) {
+            if (measuring) w->errors++;
+            usleep(1000);
+            continue;
+        }
+
+        int      keep  = 1;
+        uint64_t start = now_ns();
+        int      status = send_all(fd, request, request_len) == 0
+                        ? read_response(fd, &buf, &cap, &keep, NULL, NULL) : -1;
+        uint64_t took  = now_ns() - start;
+
+        if (measuring) {
+            if (status < 200 || status >= 400) {
+                w->errors++;
+            } else {
+                w->requests++;
+                w->hist[hist_bucket(took)]++;
+                if (took > w->max_ns) w->max_ns = took;
+            }
+        }
+
+        if (status < 0 || !keep) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    if (fd >= 0) close(fd);
+    free(buf);
+    return NULL;
+}
+
+/* POST /auth once and keep the token for the Authorization header */
+static int login(const char *creds)
+{
+    const char *colon = strchr(creds, ':');
+    if (!colon) return -1;
+
+    char    mem[1024];
+    arena_t arena;
+    jw_t    w;
+    arena_init(&arena, mem, sizeof(mem), 0);
+    jw_init(&w, &arena, 0);
+    jw_object_begin(&w);
+    jw_key(&w, "username"); jw_string_n(&w, creds, (size_t)(colon - creds));
+    jw_key(&w, "password"); jw_string(&w, colon + 1);
+    jw_object_end(&w);
+    size_t      blen;
+    const char *b = jw_finish(&w, &blen);
+
+    char req[MAX_REQUEST];
+    int  n = snprintf(req, sizeof(req),
+                      "POST /auth HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
+                      "Content-Length: %zu\r\n\r\n%s", cfg.host, blen, b ? b : "");
+    arena_free(&arena);
+
+    int fd = dial();
+    if (fd < 0 || !b || n >= (int)sizeof(req)) return -1;
+
+    size_t cap  = 4096;
+    char  *buf  = malloc(cap);
+    char  *body = NULL;
+    size_t body_len = 0;
+    int    keep, status = -1;
+    if (buf && send_all(fd, req, (size_t)n) == 0)
+        status = read_response(fd, &buf, &cap, &keep, &body, &body_len);
+    close(fd);
+
+    int rc = -1;
+    json_tok_t toks[16];
+    json_doc_t doc;
+    char       token[256];
+    if (status == 200 && json_parse(&doc, body, body_len, toks, 16) == 0 &&
+        json_get_string(&doc, 0, "token", token, sizeof(token)) > 0) {
+        snprintf(cfg.auth, sizeof(cfg.auth), "Authorization: Bearer %s\r\n", token);
+        rc = 0;
+    }
+    free(buf);
+    return rc;
+}
+
+/* Server-side allocation counters from /metrics */
+typedef struct {
+    double built;    /* crimata_http_responses_total{kind="built"} */
+    double chunks;   /* crimata_http_arena_chunks_total */
+} allocs_t;
+
+static double sample(const char *text, const char *name)
+{
+    size_t      n = strlen(name);
+    const char *p = text;
+    while ((p = strstr(p, name)) != NULL) {
+        if ((p == text || p[-1] == '\n') && p[n] == ' ')
+            return strtod(p + n + 1, NULL);
+        p += n;
+    }
+    return -1;
+}
+
+/* GET /metrics once — -1 if the server doesn't export the counters */
+static int scrape(allocs_t *out)
+{
+    char req[512];
+    int  n = snprintf(req, sizeof(req), "GET /metrics HTTP/1.1\r\nHost: %s\r\n\r\n", cfg.host);
+
+    int fd = dial();
+    if (fd < 0) return -1;
+
+    size_t cap  = 65536;
+    char  *buf  = malloc(cap);
+    char  *body = NULL;
+    size_t body_len = 0;
+    int    keep, status = -1;
+    if (buf && send_all(fd, req, (size_t)n) == 0)
+        status = read_response(fd, &buf, &cap, &keep, &body, &body_len);
+    close(fd);
+
+    int rc = -1;
+    if (status == 200) {
+        char *text = malloc(body_len + 1);
+        if (text) {
+            memcpy(text, body, body_len);
+            text[body_len] = '\0';
+            out->built  = sample(text, "crimata_http_responses_total{kind=\"built\"}");
+            out->chunks = sample(text, "crimata_http_arena_chunks_total");
+            if (out->built >= 0 && out->chunks >= 0) rc = 0;
+            free(text);
+        }
+    }
+    free(buf);
+    return rc;
+}
+
+/* Poll until the server accepts a connection — for freshly started daemons */
+static int wait_ready(double secs)
+{
+    uint64_t deadline = now_ns() + (uint64_t)(secs * 1e9);
+    while (now_ns() < deadline) {
+        int fd = dial();
+        if (fd >= 0) {
+            close(fd);
+            return 0;
+        }
+        usleep(50000);
+    }
+    return -1;
+}
+
+static void sleep_secs(double s)
+{
+    struct timespec ts = { (time_t)s, (long)((s - (time_t)s) * 1e9) };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --host HOST      server (default 127.0.0.1)\n"
+            "  -p PORT          port (default 7700)\n"
+            "  -m METHOD        request method (default GET)\n"
+            "  -u PATH          request path (default /health)\n"
+            "  -b BODY          JSON request body\n"
+            "  -c N             concurrent connections, one thread each (default 4)\n"
+            "  -d SECS          measured duration (default 10)\n"
+            "  -w SECS          warmup before measuring (default 1)\n"
+            "  --login U:P      POST /auth first and send the token as a Bearer header\n"
+            "  --wait SECS      wait up to SECS for the server to accept connections\n"
+            "  --label NAME     tag for the results line\n"
+            "  --server-threads N  record the server's thread count in the results line\n"
+            "  --out FILE       append a JSON results line to FILE\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *creds = NULL;
+    double      wait  = 0;
+
+    static const struct option opts[] = {
+        { "host",  required_argument, NULL, 's' },
+        { "login", required_argument, NULL, 'L' },
+        { "wait",  required_argument, NULL, 'W' },
+        { "label", required_argument, NULL, 'l' },
+        { "server-threads", required_argument, NULL, 'T' },
+        { "out",   required_argument, NULL, 'o' },
+        { "help",  no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "hp:m:u:b:c:d:w:", opts, NULL)) != -1) {
+        switch (c) {
+        case 's': cfg.host     = optarg;                    break;
+        case 'p': cfg.port     = optarg;                    break;
+        case 'm': cfg.method   = optarg;                    break;
+        case 'u': cfg.path     = optarg;                    break;
+        case 'b': cfg.body     = optarg;                    break;
+        case 'c': cfg.conns    = strtoul(optarg, NULL, 10); break;
+        case 'd': cfg.duration = strtod(optarg, NULL);      break;
+        case 'w': cfg.warmup   = strtod(optarg, NULL);      break;
+        case 'L': creds        = optarg;                    break;
+        case 'W': wait         = strtod(optarg, NULL);      break;
+        case 'l': cfg.label    = optarg;                    break;
+        case 'T': cfg.server_threads = strtoul(optarg, NULL, 10); break;
+        case 'o': cfg.out      = optarg;                    break;
+        case 'h': usage(argv[0]); return 0;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    if (cfg.conns == 0 || cfg.duration <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (wait > 0 && wait_ready(wait) != 0) {
+        fprintf(stderr, "%s:%s not accepting connections\n", cfg.host, cfg.port);
+        return 1;
+    }
+    if (creds && login(creds) != 0) {
+        fprintf(stderr, "login as %s failed\n", creds);
+        return 1;
+    }
+
+    size_t blen = cfg.body ? strlen(cfg.body) : 0;
+    int n = snprintf(request, sizeof(request),
+                     "%s %s HTTP/1.1\r\nHost: %s\r\n%s%s",
+                     cfg.method, cfg.path, cfg.host, cfg.auth,
+                     cfg.body ? "Content-Type: application/json\r\n" : "");
+    if (n > 0 && (size_t)n < sizeof(request))
+        n += snprintf(request + n, sizeof(request) - (size_t)n,
+                      "Content-Length: %zu\r\n\r\n%s", blen, cfg.body ? cfg.body : "");
+    if (n <= 0 || (size_t)n >= sizeof(request)) {
+        fprintf(stderr, "request too large\n");
+        return 1;
+    }
+    request_len = (size_t)n;
+
+    worker_t *workers = calloc(cfg.conns, sizeof(worker_t));
+    if (!workers) return 1;
+    for (unsigned i = 0; i < cfg.conns; i++)
+        pthread_create(&workers[i].tid, NULL, worker_main, &workers[i]);
+
+    allocs_t before, after;
+    sleep_secs(cfg.warmup);
+    int have_allocs = scrape(&before) == 0;
+    measuring = 1;
+    uint64_t t0 = now_ns();
+    sleep_secs(cfg.duration);
+    measuring = 0;
+    double elapsed = (double)(now_ns() - t0) / 1e9;
+    have_allocs = have_allocs && scrape(&after) == 0;
+    stopping = 1;
+
+    /* Merge per-thread results */
+    worker_t total = {0};
+    for (unsigned i = 0; i < cfg.conns; i++) {
+        pthread_join(workers[i].tid, NULL);
+        total.requests += workers[i].requests;
+        total.errors   += workers[i].errors;
+        if (workers[i].max_ns > total.max_ns) total.max_ns = workers[i].max_ns;
+        for (int b = 0; b < HIST_BUCKETS; b++) total.hist[b] += workers[i].hist[b];
+    }
+    free(workers);
+
+    double rps  = (double)total.requests / elapsed;
+    double p50  = percentile_ms(total.hist, total.requests, total.max_ns, 0.50);
+    double p99  = percentile_ms(total.hist, total.requests, total.max_ns, 0.99);
+    double p999 = percentile_ms(total.hist, total.requests, total.max_ns, 0.999);
+    double max  = (double)total.max_ns / 1e6;
+
+    double built_per_req = 0, chunks_per_req = 0;
+    if (have_allocs && total.requests) {
+        built_per_req  = (after.built - before.built) / (double)total.requests;
+        chunks_per_req = (after.chunks - before.chunks) / (double)total.requests;
+    }
+
+    if (cfg.server_threads) printf("t=%-3u ", cfg.server_threads);
+    printf("%-8s %-6s %-24s %10.0f req/s  p50 %8.3f ms  p99 %8.3f ms  p999 %8.3f ms  errors %llu",
+           cfg.label, cfg.method, cfg.path, rps, p50, p99, p999,
+           (unsigned long long)total.errors);
+    if (have_allocs)
+        printf("  built/req %.3f  chunks/req %.3f", built_per_req, chunks_per_req);
+    printf("\n");
+
+    if (cfg.out) {
+        char    mem[2048];
+        arena_t arena;
+        jw_t    w;
+        arena_init(&arena, mem, sizeof(mem), 0);
+        jw_init(&w, &arena, 0);
+        jw_object_begin(&w);
+        jw_key(&w, "label");       jw_string(&w, cfg.label);
+        jw_key(&w, "method");      jw_string(&w, cfg.method);
+        jw_key(&w, "path");        jw_string(&w, cfg.path);
+        jw_key(&w, "connections"); jw_uint(&w, cfg.conns);
+        if (cfg.server_threads) {
+            jw_key(&w, "serverThreads"); jw_uint(&w, cfg.server_threads);
+        }
+        jw_key(&w, "seconds");     jw_double(&w, elapsed);
+        jw_key(&w, "requests");    jw_uint(&w, total.requests);
+        jw_key(&w, "errors");      jw_uint(&w, total.errors);
+        jw_key(&w, "rps");         jw_double(&w, rps);
+        jw_key(&w, "p50Ms");       jw_double(&w, p50);
+        jw_key(&w, "p99Ms");       jw_double(&w, p99);
+        jw_key(&w, "p999Ms");      jw_double(&w, p999);
+        jw_key(&w, "maxMs");       jw_double(&w, max);
+        if (have_allocs) {
+            jw_key(&w, "builtPerReq");       jw_double(&w, built_per_req);
+            jw_key(&w, "arenaChunksPerReq"); jw_double(&w, chunks_per_req);
+        }
+        jw_object_end(&w);
+
+        const char *line = jw_finish(&w, NULL);
+        FILE *f = fopen(cfg.out, "a");
+        if (!f || !line) {
+            fprintf(stderr, "cannot write %s\n", cfg.out);
+            if (f) fclose(f);
+            arena_free(&arena);
+            return 1;
+        }
+        fprintf(f, "%s\n", line);
+        fclose(f);
+        arena_free(&arena);
+    }
+
+    return total.errors && !total.requests ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+#!/bin/sh
+# Benchmark crimata-auth and crimata-dock against local stand-ins:
+#   auth — PAM service bench/pam/crimata-bench (pam_permit), throttling off
+#   dock — BENCH_APPS copies of the contacts manifest in a temp tree, and
+#          the in-memory systemd stub linked into crimata-dock-bench
+#   session — crimata-auth's session table in-process, at each of
+#          BENCH_SESSIONS live sessions
+#   json — libcrimata's JSON tokenizer and writer against the helpers they
+#          replaced, on the contacts manifest
+#
+# usage: run.sh [--threads] auth|dock|session|json ...
+#        (run via `make bench` in auth/, dock/ or common/)
+#
+#   --threads      run auth and dock at 1, 2, 4 … nproc event-loop threads;
+#                  each results line records its serverThreads
+#
+#   BENCH_SECONDS  measured seconds per endpoint (default 10)
+#   BENCH_CONNS    concurrent connections (default 16)
+#   BENCH_THREADS  daemon event-loop thread counts, space-separated
+#                  (default: all cores)
+#   BENCH_APPS     fake manifests for the dock (default 20)
+#   BENCH_SESSIONS table sizes for session (default "1000 10000 100000 1000000")
+#   BENCH_OUT      results file (default bench/results-<git rev>.jsonl)
+set -eu
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+rev=$(git -C "$root" describe --always --dirty 2>/dev/null || echo unknown)
+
+out=${BENCH_OUT:-$here/results-$rev.jsonl}
+secs=${BENCH_SECONDS:-10}
+conns=${BENCH_CONNS:-16}
+cores=$(nproc)
+sweep=${BENCH_THREADS:-$cores}
+
+if [ "${1:-}" = "--threads" ]; then
+    shift
+    sweep=""
+    t=1
+    while [ "$t" -lt "$cores" ]; do
+        sweep="$sweep $t"
+        t=$((t * 2))
+    done
+    sweep="$sweep $cores"
+fi
+napps=${BENCH_APPS:-20}
+sessions=${BENCH_SESSIONS:-1000 10000 100000 1000000}
+
+tmp=$(mktemp -d)
+pid=""
+
+stop() {
+    if [ -n "$pid" ]; then
+        kill "$pid" 2>/dev/null || true
+        wait "$pid" 2>/dev/null || true
+        pid=""
+    fi
+}
+trap 'stop; rm -rf "$tmp"' EXIT
+trap 'exit 1' INT TERM
+
+# Older daemons block on stdin until killed — hand them a FIFO that never
+# delivers data (opened read-write, so nothing waits for a writer)
+mkfifo "$tmp/stdin"
+exec 9<>"$tmp/stdin"
+
+start() {
+    "$@" <&9 >>"$tmp/daemon.log" 2>&1 &
+    pid=$!
+}
+
+load() {
+    "$here/loadgen" -d "$secs" -c "$conns" --wait 5 --out "$out" \
+        --server-threads "$threads" "$@" || {
+        echo "loadgen failed; daemon log:" >&2
+        cat "$tmp/daemon.log" >&2
+        exit 1
+    }
+}
+
+# Run bench_$1 once per thread count in $sweep
+per_thread() {
+    for threads in $sweep; do
+        "bench_$1"
+    done
+}
+
+bench_auth() {
+    auth="$root/auth/crimata-auth"
+    common="--port 17700 --threads $threads --pam-service crimata-bench
+            --pam-confdir $here/pam --pam-workers $threads --pam-queue 4096
+            --ip-rate 0 --user-rate 0"
+
+    # Lookups against one long-lived session
+    start $auth $common
+    load --port 17700 --label auth -u /health
+    load --port 17700 --label auth -u /me     --login bench:bench
+    load --port 17700 --label auth -u /verify --login bench:bench
+    stop
+
+    # Every login creates a session; a short TTL keeps the table from filling
+    start $auth $common --session-ttl 1 --max-sessions 262144
+    load --port 17700 --label auth -m POST -u /auth \
+         -b '{"username":"bench","password":"bench"}'
+    stop
+}
+
+bench_dock() {
+    i=0
+    while [ "$i" -lt "$napps" ]; do
+        mkdir -p "$tmp/apps/crimata-bench$i"
+        sed "s/\"contacts\"/\"bench$i\"/; s/\"port\": 3001/\"port\": $((4000 + i))/" \
+            "$root/apps/contacts/crimata.json" > "$tmp/apps/crimata-bench$i/crimata.json"
+        i=$((i + 1))
+    done
+
+    # On-demand units are written but never loaded: the stub has no systemd
+    mkdir -p "$tmp/units"
+    start "$root/dock/crimata-dock-bench" --port 17701 --threads "$threads" --apps-dir "$tmp/apps" \
+          --unit-dir "$tmp/units"
+    load --port 17701 --label dock -u /health
+    load --port 17701 --label dock -u /apps
+    load --port 17701 --label dock -m POST -u /apps/bench0/start
+    stop
+}
+
+bench_session() {
+    for n in $sessions; do
+        "$here/sessionbench" -n "$n" --out "$out"
+    done
+}
+
+bench_json() {
+    "$here/jsonbench" --out "$out" "$root/apps/contacts/crimata.json"
+}
+
+[ $# -gt 0 ] || set -- auth dock session json
+for target in "$@"; do
+    case "$target" in
+    auth) per_thread auth ;;
+    dock) per_thread dock ;;
+    session) bench_session ;;
+    json) bench_json ;;
+    *)    echo "unknown target: $target" >&2; exit 1 ;;
+    esac
+done
+
+echo "results appended to $out"
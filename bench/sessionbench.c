@@ -0,0 +1,181 @@
+/*
+ * sessionbench — crimata-auth's session table in-process, without HTTP.
+ *
+ * Fills a table of -n live sessions, then times session_lookup() two ways:
+ *
+ *   hot    the same 1024 tokens over and over, so the table's own work is
+ *          measured with everything in cache
+ *   random tokens drawn uniformly from all -n sessions, as a busy server
+ *          sees them; past the CPU caches each lookup pays a few cache misses
+ *
+ * Hot lookups should stay flat from 1k to 1M sessions. Random ones grow with
+ * the working set until it is out of cache and then level off. One JSON object
+ * per run is appended to --out, like loadgen's.
+ */
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "json.h"
+#include "session.h"
+
+#define HOT_TOKENS 1024
+
+typedef char token_t[SESSION_TOKEN_LEN + 1];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Look up every token in stream once — mean ns per lookup, or 0 if one failed */
+static double run_stream(const token_t *stream, size_t n)
+{
+    session_info_t info;
+    uint64_t t0 = now_ns();
+    for (size_t i = 0; i < n; i++)
+        if (session_lookup(stream[i], &info) != 0) return 0;
+    return (double)(now_ns() - t0) / (double)n;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s -n SESSIONS [options]\n"
+            "  -n N          live sessions in the table\n"
+            "  -l N          lookups per pattern (default 2000000)\n"
+            "  --out FILE    append a JSON results line to FILE\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    size_t      nsessions = 0;
+    size_t      nlookups  = 2000000;
+    const char *out       = NULL;
+
+    static const struct option opts[] = {
+        { "out",  required_argument, NULL, 'o' },
+        { "help", no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "hn:l:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'n': nsessions = strtoul(optarg, NULL, 10); break;
+        case 'l': nlookups  = strtoul(optarg, NULL, 10); break;
+        case 'o': out       = optarg;                    break;
+        case 'h': usage(argv[0]); return 0;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    if (nsessions == 0 || nlookups == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    session_config_t config = { .max_sessions = nsessions, .ttl = 86400, .idle_ttl = 86400 };
+    if (session_init(&config) != 0) {
+        fprintf(stderr, "cannot allocate %zu sessions\n", nsessions);
+        return 1;
+    }
+
+    token_t  *tokens = malloc(nsessions * sizeof(token_t));
+    token_t  *stream = malloc(nlookups * sizeof(token_t));
+    uint32_t *lat    = malloc(nlookups * sizeof(uint32_t));
+    if (!tokens || !stream || !lat) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    /* Every slot must be usable: a full table is the capacity being measured */
+    uint64_t t0 = now_ns();
+    for (size_t i = 0; i < nsessions; i++) {
+        if (session_create("bench", tokens[i]) != 0) {
+            fprintf(stderr, "table full after %zu of %zu sessions\n", i, nsessions);
+            return 1;
+        }
+    }
+    double create_ns = (double)(now_ns() - t0) / (double)nsessions;
+
+    /* Lay the tokens out in lookup order, so reading them is sequential */
+    size_t hot = nsessions < HOT_TOKENS ? nsessions : HOT_TOKENS;
+    for (size_t i = 0; i < nlookups; i++)
+        memcpy(stream[i], tokens[next_rand() % hot], sizeof(token_t));
+    double hot_ns = run_stream(stream, nlookups);
+
+    for (size_t i = 0; i < nlookups; i++)
+        memcpy(stream[i], tokens[next_rand() % nsessions], sizeof(token_t));
+    double random_ns = run_stream(stream, nlookups);
+
+    /* Timed one by one for percentiles; each includes a clock read */
+    session_info_t info;
+    for (size_t i = 0; i < nlookups; i++) {
+        uint64_t s = now_ns();
+        session_lookup(stream[i], &info);
+        lat[i] = (uint32_t)(now_ns() - s);
+    }
+    qsort(lat, nlookups, sizeof(uint32_t), cmp_u32);
+    uint32_t p50 = lat[nlookups / 2];
+    uint32_t p99 = lat[(size_t)((double)nlookups * 0.99)];
+
+    if (hot_ns == 0 || random_ns == 0) {
+        fprintf(stderr, "a live session was not found\n");
+        return 1;
+    }
+
+    printf("session  %8zu sessions  create %7.0f ns  hot %6.0f ns  random %6.0f ns  "
+           "p50 %6u ns  p99 %6u ns\n", nsessions, create_ns, hot_ns, random_ns, p50, p99);
+
+    if (out) {
+        char    mem[1024];
+        arena_t arena;
+        jw_t    w;
+        arena_init(&arena, mem, sizeof(mem), 0);
+        jw_init(&w, &arena, 0);
+        jw_object_begin(&w);
+        jw_key(&w, "label");       jw_string(&w, "session");
+        jw_key(&w, "sessions");    jw_uint(&w, nsessions);
+        jw_key(&w, "lookups");     jw_uint(&w, nlookups);
+        jw_key(&w, "createNs");    jw_double(&w, create_ns);
+        jw_key(&w, "hotNs");       jw_double(&w, hot_ns);
+        jw_key(&w, "randomNs");    jw_double(&w, random_ns);
+        jw_key(&w, "randomP50Ns"); jw_uint(&w, p50);
+        jw_key(&w, "randomP99Ns"); jw_uint(&w, p99);
+        jw_object_end(&w);
+
+        const char *line = jw_finish(&w, NULL);
+        FILE *f = fopen(out, "a");
+        if (!f || !line) {
+            fprintf(stderr, "cannot write %s\n", out);
+            if (f) fclose(f);
+            arena_free(&arena);
+            return 1;
+        }
+        fprintf(f, "%s\n", line);
+        fclose(f);
+        arena_free(&arena);
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * Link-time stand-in for dock/src/systemd.c used by `make bench`: units
+ * live in a table in memory, so the dock can be benchmarked without a
+ * system bus. CRIMATA_BENCH_SYSTEMD_US adds a fixed delay to start/stop to
+ * approximate a D-Bus round trip.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "events.h"
+#include "systemd.h"
+
+#define MAX_UNITS 256
+
+static struct {
+    char name[300];
+    int  active;
+} units[MAX_UNITS];
+
+static int             nunits;
+static unsigned        generation;
+static void          (*state_hook)(const char *id, event_type_t state);
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void delay(void)
+{
+    static int us = -1;
+    if (us < 0) {
+        const char *v = getenv("CRIMATA_BENCH_SYSTEMD_US");
+        us = v ? atoi(v) : 0;
+    }
+    if (us > 0) usleep((useconds_t)us);
+}
+
+/* Caller holds lock */
+static int find(const char *unit, int create)
+{
+    for (int i = 0; i < nunits; i++)
+        if (strcmp(units[i].name, unit) == 0) return i;
+    if (!create || nunits == MAX_UNITS || strlen(unit) >= sizeof(units[0].name)) return -1;
+    strcpy(units[nunits].name, unit);
+    units[nunits].active = 0;
+    return nunits++;
+}
+
+int systemd_init(void)
+{
+    return 0;
+}
+
+unsigned systemd_generation(void)
+{
+    return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}
+
+/* Served from memory in the real dock too, so no delay */
+int systemd_is_active(const char *unit)
+{
+    pthread_mutex_lock(&lock);
+    int i = find(unit, 0);
+    int r = i >= 0 ? units[i].active : 0;
+    pthread_mutex_unlock(&lock);
+    return r;
+}
+
+static int set_active(const char *unit, int active)
+{
+    delay();
+    pthread_mutex_lock(&lock);
+    int i = find(unit, 1);
+    int changed = i >= 0 && units[i].active != active;
+    if (changed) {
+        units[i].active = active;
+        __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&lock);
+
+    /* crimata-<id>.service → <id>, as the real dock reports it */
+    size_t n = strlen(unit);
+    if (changed && n > 16 && n - 16 < 256) {
+        char id[256];
+        memcpy(id, unit + 8, n - 16);
+        id[n - 16] = '\0';
+        events_publish(active ? EV_ACTIVE : EV_STOPPED, id);
+        if (state_hook) state_hook(id, active ? EV_ACTIVE : EV_STOPPED);
+    }
+    return i >= 0 ? 0 : -1;
+}
+
+int systemd_start(const char *unit)
+{
+    return set_active(unit, 1);
+}
+
+int systemd_stop(const char *unit)
+{
+    return set_active(unit, 0);
+}
+
+typedef struct {
+    int            start;   /* -1: daemon-reload */
+    systemd_job_fn fn;
+    void          *arg;
+    char           unit[300];
+} job_t;
+
+/* The real jobs finish on the loop thread; here each gets its own */
+static void *job_main(void *p)
+{
+    job_t *job = p;
+    int    r   = job->start < 0 ? 0 : set_active(job->unit, job->start);
+    job->fn(job->arg, r == 0 ? "done" : NULL);
+    free(job);
+    return NULL;
+}
+
+int systemd_submit(int start, const char *unit, systemd_job_fn fn, void *arg)
+{
+    job_t *job = malloc(sizeof(*job));
+    if (!job || strlen(unit) >= sizeof(job->unit)) {
+        free(job);
+        return -1;
+    }
+    job->start = start;
+    job->fn    = fn;
+    job->arg   = arg;
+    strcpy(job->unit, unit);
+
+    pthread_t t;
+    if (pthread_create(&t, NULL, job_main, job) != 0) {
+        free(job);
+        return -1;
+    }
+    pthread_detach(t);
+    return 0;
+}
+
+int systemd_reload(systemd_job_fn fn, void *arg)
+{
+    return systemd_submit(-1, "", fn, arg);
+}
+
+void systemd_set_state_hook(void (*fn)(const char *id, event_type_t state))
+{
+    state_hook = fn;
+}
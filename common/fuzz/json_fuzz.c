@@ -0,0 +1,252 @@
+/*
+ * json_fuzz — fuzz target for the JSON tokenizer, accessors and writer.
+ *
+ * Every input is tokenized, each token is checked against the source and
+ * its neighbours, every string is unescaped and written back out through
+ * the writer, and the result must tokenize to the same string again.
+ * Anything that breaks an invariant aborts, so the sanitizers and the
+ * fuzzer treat it like a crash.
+ *
+ * Built two ways:
+ *   make fuzz (in common/)   gcc with ASan/UBSan and the mutation loop in
+ *                            main() below, seeded from corpus/
+ *   -DLIBFUZZER              just LLVMFuzzerTestOneInput, for
+ *                            clang -fsanitize=fuzzer,address,undefined
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+            abort();                                                       \
+        }                                                                  \
+    } while (0)
+
+/* A string must survive unescape → jw_string → tokenize → unescape unchanged */
+static void check_round_trip(const char *s)
+{
+    arena_t arena;
+    jw_t    w;
+    arena_init(&arena, NULL, 0, 4096);
+    jw_init(&w, &arena, 0);
+    jw_string(&w, s);
+
+    size_t      len;
+    const char *out = jw_finish(&w, &len);
+    CHECK(out);
+
+    json_doc_t doc;
+    CHECK(json_parse_arena(&doc, out, len, &arena) == 0);
+    CHECK(doc.count == 1 && doc.toks[0].type == JSON_STRING);
+
+    char *back = json_string_dup(&doc, 0, &arena);
+    CHECK(back && strcmp(back, s) == 0);
+    arena_free(&arena);
+}
+
+/* Walk the value at idx, checking its children line up with size and next */
+static void check_value(const json_doc_t *doc, size_t len, unsigned idx, arena_t *arena)
+{
+    const json_tok_t *t = &doc->toks[idx];
+    CHECK((size_t)t->start + t->len <= len);
+    CHECK(t->next > idx && t->next <= doc->count);
+
+    if (t->type == JSON_STRING) {
+        char *s = json_string_dup(doc, (int)idx, arena);
+        CHECK(s);
+        check_round_trip(s);
+        return;
+    }
+    if (t->type != JSON_OBJECT && t->type != JSON_ARRAY) {
+        CHECK(t->next == idx + 1);
+        return;
+    }
+
+    unsigned child = idx + 1;
+    for (uint32_t m = 0; m < t->size; m++) {
+        if (t->type == JSON_OBJECT) {
+            const json_tok_t *key = &doc->toks[child];
+            CHECK(key->type == JSON_STRING && key->next == child + 1);
+
+            /* An unescaped key finds a member (the first of that name) */
+            if (!key->escaped && key->len < 256) {
+                char name[256];
+                memcpy(name, doc->src + key->start, key->len);
+                name[key->len] = '\0';
+                int v = json_object_get(doc, (int)idx, name);
+                CHECK(v > (int)idx && v < (int)t->next && v <= (int)child + 1);
+
+                long n;
+                char buf[64];
+                json_get_int(doc, (int)idx, name, &n);
+                json_get_string(doc, (int)idx, name, buf, sizeof(buf));
+            }
+            check_value(doc, len, child, arena);
+            child++;
+        }
+        CHECK(child < t->next);
+        check_value(doc, len, child, arena);
+        child = doc->toks[child].next;
+    }
+    CHECK(child == t->next);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    const char *src = (const char *)data;
+    arena_t     arena;
+    json_doc_t  doc;
+    arena_init(&arena, NULL, 0, 16384);
+
+    int rc = json_parse_arena(&doc, src, size, &arena);
+    CHECK(rc == 0 || rc == JSON_ERR_SYNTAX || rc == JSON_ERR_DEPTH);
+    if (rc == 0) {
+        CHECK(doc.count > 0 && doc.toks[0].next == doc.count);
+        check_value(&doc, size, 0, &arena);
+
+        /* Too small a token array fails cleanly, never overruns */
+        json_tok_t few[4];
+        json_doc_t part;
+        rc = json_parse(&part, src, size, few, 4);
+        CHECK(doc.count <= 4 ? rc == 0 : rc == JSON_ERR_NOMEM);
+    }
+
+    arena_free(&arena);
+    return 0;
+}
+
+#ifndef LIBFUZZER
+
+/* ── Standalone mutation loop ─────────────────────────────────────────────── */
+
+#define MAX_INPUT 65536
+
+static uint64_t rng = 0x2545f4914f6cdd1dULL;
+
+static uint64_t next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+/* Fragments that tend to reach the tokenizer's edge cases */
+static const char *const dict[] = {
+    "{", "}", "[", "]", "\"", ":", ",", "\\", "\\u", "\\ud83d\\ude00", "\\ud800",
+    "\\u0000", "0", "-", "1e", ".5", "true", "false", "null", "\"a\":", " ",
+    "[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[",
+};
+
+static size_t mutate(char *buf, size_t len)
+{
+    int rounds = 1 + (int)(next_rand() % 4);
+    while (rounds--) {
+        size_t at = len ? next_rand() % (len + 1) : 0;
+        switch (next_rand() % 5) {
+        case 0:   /* flip a bit */
+            if (at < len) buf[at] ^= (char)(1u << (next_rand() % 8));
+            break;
+        case 1:   /* random byte */
+            if (at < len) buf[at] = (char)next_rand();
+            break;
+        case 2: { /* delete a run */
+            size_t n = 1 + next_rand() % 8;
+            if (at + n > len) n = len - at;
+            memmove(buf + at, buf + at + n, len - at - n);
+            len -= n;
+            break;
+        }
+        case 3: { /* insert a dictionary fragment */
+            const char *f = dict[next_rand() % (sizeof(dict) / sizeof(dict[0]))];
+            size_t      n = strlen(f);
+            if (len + n > MAX_INPUT) break;
+            memmove(buf + at + n, buf + at, len - at);
+            memcpy(buf + at, f, n);
+            len += n;
+            break;
+        }
+        default: { /* duplicate a run elsewhere */
+            if (!len) break;
+            size_t from = next_rand() % len;
+            size_t n    = 1 + next_rand() % 16;
+            if (from + n > len) n = len - from;
+            if (len + n > MAX_INPUT) break;
+            char tmp[16];
+            memcpy(tmp, buf + from, n);
+            memmove(buf + at + n, buf + at, len - at);
+            memcpy(buf + at, tmp, n);
+            len += n;
+            break;
+        }
+        }
+    }
+    return len;
+}
+
+static size_t read_file(const char *path, char *buf)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    size_t n = fread(buf, 1, MAX_INPUT, f);
+    fclose(f);
+    return n;
+}
+
+/*
+ * json_fuzz [-n ITERATIONS] [-s SEED] FILE...
+ * Runs every file as-is (a crash reproducer replays this way), then mutates
+ * them for ITERATIONS more inputs.
+ */
+int main(int argc, char **argv)
+{
+    unsigned long iterations = 100000;
+    int           first      = 1;
+
+    for (; first < argc && argv[first][0] == '-'; first += 2) {
+        if (first + 1 >= argc) break;
+        if (strcmp(argv[first], "-n") == 0) iterations = strtoul(argv[first + 1], NULL, 10);
+        else if (strcmp(argv[first], "-s") == 0) rng = strtoull(argv[first + 1], NULL, 10) | 1;
+    }
+    int nseeds = argc - first;
+    if (nseeds <= 0) {
+        fprintf(stderr, "usage: %s [-n ITERATIONS] [-s SEED] FILE...\n", argv[0]);
+        return 1;
+    }
+
+    static char seeds[16][MAX_INPUT];
+    static size_t seed_len[16];
+    if (nseeds > 16) nseeds = 16;
+    for (int i = 0; i < nseeds; i++) {
+        seed_len[i] = read_file(argv[first + i], seeds[i]);
+        LLVMFuzzerTestOneInput((const uint8_t *)seeds[i], seed_len[i]);
+    }
+
+    /* Each input lives in its own allocation, so ASan catches reads past its end */
+    static char buf[MAX_INPUT];
+    for (unsigned long it = 0; it < iterations; it++) {
+        int    s   = (int)(next_rand() % (unsigned)nseeds);
+        size_t len = seed_len[s];
+        memcpy(buf, seeds[s], len);
+        len = mutate(buf, len);
+
+        char *input = malloc(len ? len : 1);
+        if (!input) return 1;
+        memcpy(input, buf, len);
+        LLVMFuzzerTestOneInput((const uint8_t *)input, len);
+        free(input);
+    }
+
+    printf("json_fuzz: %lu inputs ok\n", iterations + (unsigned long)nseeds);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define ALIGN 16
+
+static size_t align_up(size_t n)
+{
+    return (n + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+void arena_init(arena_t *a, void *buf, size_t buf_size, size_t chunk_size)
+{
+    a->head       = NULL;
+    a->cur        = NULL;
+    a->chunk_size = chunk_size ? chunk_size : 4096;
+    a->mallocs    = 0;
+
+    /* Carve an aligned chunk header out of the caller's buffer */
+    if (buf) {
+        uintptr_t p   = ((uintptr_t)buf + ALIGN - 1) & ~(uintptr_t)(ALIGN - 1);
+        size_t    pad = p - (uintptr_t)buf;
+        if (buf_size > pad + sizeof(arena_chunk_t) + ALIGN) {
+            arena_chunk_t *c = (arena_chunk_t *)p;
+            c->next  = NULL;
+            c->size  = buf_size - pad - sizeof(arena_chunk_t);
+            c->used  = 0;
+            c->owned = 0;
+            a->head = a->cur = c;
+        }
+    }
+}
+
+void *arena_alloc(arena_t *a, size_t n)
+{
+    n = align_up(n ? n : 1);
+
+    /* Walk forward through chunks kept from before the last reset */
+    for (arena_chunk_t *c = a->cur; c; c = c->next) {
+        if (c->size - c->used >= n) {
+            void *p = c->data + c->used;
+            c->used += n;
+            a->cur = c;
+            return p;
+        }
+    }
+
+    size_t size = n > a->chunk_size ? n : a->chunk_size;
+    arena_chunk_t *c = malloc(sizeof(arena_chunk_t) + size);
+    if (!c) return NULL;
+    c->size  = size;
+    c->used  = n;
+    c->owned = 1;
+    a->mallocs++;
+
+    /* Append after cur so reset can replay chunks in order */
+    if (a->cur) {
+        c->next = a->cur->next;
+        a->cur->next = c;
+    } else {
+        c->next = a->head;
+        a->head = c;
+    }
+    a->cur = c;
+    return c->data;
+}
+
+char *arena_strndup(arena_t *a, const char *s, size_t n)
+{
+    char *p = arena_alloc(a, n + 1);
+    if (!p) return NULL;
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+void arena_reset(arena_t *a)
+{
+    for (arena_chunk_t *c = a->head; c; c = c->next)
+        c->used = 0;
+    a->cur = a->head;
+}
+
+void arena_free(arena_t *a)
+{
+    arena_chunk_t *c = a->head;
+    while (c) {
+        arena_chunk_t *next = c->next;
+        if (c->owned) free(c);
+        c = next;
+    }
+    a->head = a->cur = NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator over a list of chunks. Nothing is freed individually;
+ * arena_reset() rewinds every chunk for reuse, arena_free() releases them.
+ */
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t              size;   /* usable bytes in data[] */
+    size_t              used;
+    int                 owned;  /* malloc'd by the arena (vs. caller buffer) */
+    _Alignas(16) char   data[];  /* arena_alloc() hands out 16-byte aligned blocks */
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t *head;
+    arena_chunk_t *cur;
+    size_t         chunk_size;  /* minimum size of heap chunks */
+    size_t         mallocs;     /* heap chunks allocated over the arena's life */
+} arena_t;
+
+/*
+ * Initialise an arena. buf (may be NULL) becomes the first chunk, so small
+ * workloads never touch the heap; larger ones grow in chunk_size steps.
+ */
+void  arena_init(arena_t *a, void *buf, size_t buf_size, size_t chunk_size);
+
+/* Allocate n bytes, 16-byte aligned — NULL on out-of-memory */
+void *arena_alloc(arena_t *a, size_t n);
+
+/* Copy n bytes (plus a NUL) into the arena */
+char *arena_strndup(arena_t *a, const char *s, size_t n);
+
+/* Forget every allocation but keep the chunks for reuse */
+void  arena_reset(arena_t *a);
+
+/* Release heap chunks */
+void  arena_free(arena_t *a);
+
+#endif
@@ -0,0 +1,301 @@
+#include "httpd.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <systemd/sd-daemon.h>
+
+#define MAX_EXTRA_OPTIONS 16
+
+#define CONN_ARENA_INLINE 2048    /* covers typical JSON bodies without a chunk */
+#define CONN_ARENA_CHUNK  16384
+
+/*
+ * The daemon's handler and completion callback are wrapped so requests can
+ * be counted in and out; a request is in flight from the first handler call
+ * until MHD reports it completed. The flag lives in a per-connection
+ * socket context, since con_cls belongs to the daemon's own handler.
+ *
+ * The same context carries the connection's arena. It is rewound after each
+ * request, so keep-alive traffic reuses the same memory.
+ */
+typedef struct {
+    int     in_request;
+    size_t  chunks_seen;   /* arena.mallocs already counted */
+    arena_t arena;
+    char    mem[CONN_ARENA_INLINE];
+} conn_state_t;
+
+static metric_t m_arena_chunks = METRIC_COUNTER_DEF(
+    "crimata_http_arena_chunks_total", NULL,
+    "Heap chunks allocated by per-connection arenas");
+
+static MHD_AccessHandlerCallback    app_handler;
+static void                        *app_handler_cls;
+static MHD_RequestCompletedCallback app_completed;
+static void                        *app_completed_cls;
+static unsigned                     inflight;
+static void                       (*drain_hook)(void);
+static void                       (*expire_hook)(void);
+
+static void env_unsigned(const char *prefix, const char *name, unsigned *out)
+{
+    char key[128];
+    snprintf(key, sizeof(key), "%s_%s", prefix, name);
+    const char *v = getenv(key);
+    if (v && *v) *out = (unsigned)strtoul(v, NULL, 10);
+}
+
+void httpd_config_env(httpd_config_t *cfg, const char *prefix)
+{
+    unsigned mem  = (unsigned)cfg->conn_memory;
+    unsigned port = cfg->port;
+
+    env_unsigned(prefix, "PORT",         &port);
+    env_unsigned(prefix, "THREADS",      &cfg->threads);
+    env_unsigned(prefix, "CONN_LIMIT",   &cfg->conn_limit);
+    env_unsigned(prefix, "PER_IP_LIMIT", &cfg->per_ip_limit);
+    env_unsigned(prefix, "CONN_TIMEOUT", &cfg->conn_timeout);
+    env_unsigned(prefix, "CONN_MEMORY",  &mem);
+    env_unsigned(prefix, "BACKLOG",      &cfg->backlog);
+    env_unsigned(prefix, "DRAIN_TIMEOUT", &cfg->drain_timeout);
+
+    cfg->conn_memory = mem;
+    cfg->port        = (uint16_t)port;
+}
+
+int httpd_config_set(httpd_config_t *cfg, int opt, const char *arg)
+{
+    unsigned long v = strtoul(arg, NULL, 10);
+
+    switch (opt) {
+    case HTTPD_OPT_PORT:         cfg->port         = (uint16_t)v; return 0;
+    case HTTPD_OPT_THREADS:      cfg->threads      = (unsigned)v; return 0;
+    case HTTPD_OPT_CONN_LIMIT:   cfg->conn_limit   = (unsigned)v; return 0;
+    case HTTPD_OPT_PER_IP_LIMIT: cfg->per_ip_limit = (unsigned)v; return 0;
+    case HTTPD_OPT_CONN_TIMEOUT: cfg->conn_timeout = (unsigned)v; return 0;
+    case HTTPD_OPT_CONN_MEMORY:  cfg->conn_memory  = (size_t)v;   return 0;
+    case HTTPD_OPT_BACKLOG:      cfg->backlog      = (unsigned)v; return 0;
+    case HTTPD_OPT_DRAIN_TIMEOUT: cfg->drain_timeout = (unsigned)v; return 0;
+    }
+    return -1;
+}
+
+void httpd_config_usage(FILE *out)
+{
+    fprintf(out,
+            "  --port N           listen port\n"
+            "  --threads N        epoll event-loop threads (default 1)\n"
+            "  --conn-limit N     max concurrent connections\n"
+            "  --per-ip-limit N   max concurrent connections per client address\n"
+            "  --conn-timeout S   close idle connections after S seconds\n"
+            "  --conn-memory B    per-connection memory pool in bytes\n"
+            "  --backlog N        listen backlog\n"
+            "  --drain-timeout S  on SIGTERM, wait up to S seconds for requests (default %d)\n",
+            HTTPD_DRAIN_TIMEOUT);
+}
+
+void httpd_block_signals(void)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+static void notify_connection(void *cls, struct MHD_Connection *conn,
+                              void **socket_context, enum MHD_ConnectionNotificationCode code)
+{
+    (void)cls; (void)conn;
+    conn_state_t *st = *socket_context;
+
+    if (code == MHD_CONNECTION_NOTIFY_STARTED) {
+        st = malloc(sizeof(*st));
+        if (st) {
+            st->in_request  = 0;
+            st->chunks_seen = 0;
+            arena_init(&st->arena, st->mem, sizeof(st->mem), CONN_ARENA_CHUNK);
+        }
+        *socket_context = st;
+    } else if (st) {
+        arena_free(&st->arena);
+        free(st);
+        *socket_context = NULL;
+    }
+}
+
+static conn_state_t *conn_state(struct MHD_Connection *conn)
+{
+    const union MHD_ConnectionInfo *ci =
+        MHD_get_connection_info(conn, MHD_CONNECTION_INFO_SOCKET_CONTEXT);
+    return ci ? ci->socket_context : NULL;
+}
+
+static enum MHD_Result track_handler(void *cls, struct MHD_Connection *conn,
+                                     const char *url, const char *method,
+                                     const char *version, const char *upload_data,
+                                     size_t *upload_data_size, void **con_cls)
+{
+    (void)cls;
+    conn_state_t *st = conn_state(conn);
+    if (!st) return MHD_NO;   /* no memory for the connection's state */
+    if (!st->in_request) {
+        st->in_request = 1;
+        __atomic_add_fetch(&inflight, 1, __ATOMIC_RELAXED);
+    }
+    return app_handler(app_handler_cls, conn, url, method, version,
+                       upload_data, upload_data_size, con_cls);
+}
+
+static void track_completed(void *cls, struct MHD_Connection *conn,
+                            void **con_cls, enum MHD_RequestTerminationCode toe)
+{
+    (void)cls;
+    if (app_completed) app_completed(app_completed_cls, conn, con_cls, toe);
+
+    conn_state_t *st = conn_state(conn);
+    if (!st) return;
+    if (st->in_request) {
+        st->in_request = 0;
+        __atomic_sub_fetch(&inflight, 1, __ATOMIC_RELAXED);
+    }
+
+    /* The response is gone, so nothing points into the arena any more */
+    if (st->arena.mallocs != st->chunks_seen) {
+        metrics_add(&m_arena_chunks, st->arena.mallocs - st->chunks_seen);
+        st->chunks_seen = st->arena.mallocs;
+    }
+    arena_reset(&st->arena);
+}
+
+arena_t *httpd_arena(struct MHD_Connection *conn)
+{
+    return &conn_state(conn)->arena;
+}
+
+struct MHD_Daemon *httpd_start(const httpd_config_t *cfg, unsigned int flags,
+                               MHD_AccessHandlerCallback handler, void *handler_cls,
+                               const struct MHD_OptionItem *extra)
+{
+    struct MHD_OptionItem opts[MAX_EXTRA_OPTIONS + 12];
+    size_t n = 0;
+
+    app_handler     = handler;
+    app_handler_cls = handler_cls;
+
+    for (; extra && extra->option != MHD_OPTION_END && n < MAX_EXTRA_OPTIONS; extra++) {
+        if (extra->option == MHD_OPTION_NOTIFY_COMPLETED) {
+            app_completed     = (MHD_RequestCompletedCallback)extra->value;
+            app_completed_cls = extra->ptr_value;
+            continue;
+        }
+        opts[n++] = *extra;
+    }
+
+#define OPT(o, v) opts[n++] = (struct MHD_OptionItem){ (o), (intptr_t)(v), NULL }
+    if (cfg->threads > 1)    OPT(MHD_OPTION_THREAD_POOL_SIZE,        cfg->threads);
+    if (cfg->conn_limit)     OPT(MHD_OPTION_CONNECTION_LIMIT,        cfg->conn_limit);
+    if (cfg->per_ip_limit)   OPT(MHD_OPTION_PER_IP_CONNECTION_LIMIT, cfg->per_ip_limit);
+    if (cfg->conn_timeout)   OPT(MHD_OPTION_CONNECTION_TIMEOUT,      cfg->conn_timeout);
+    if (cfg->conn_memory)    OPT(MHD_OPTION_CONNECTION_MEMORY_LIMIT, cfg->conn_memory);
+    if (cfg->backlog)        OPT(MHD_OPTION_LISTEN_BACKLOG_SIZE,     cfg->backlog);
+
+    /* Socket activation: systemd owns the listening socket across restarts */
+    int nfds = sd_listen_fds(1);
+    if (nfds > 0) {
+        if (nfds > 1) fprintf(stderr, "got %d sockets from systemd, using the first\n", nfds);
+        OPT(MHD_OPTION_LISTEN_SOCKET, SD_LISTEN_FDS_START);
+    }
+
+    metrics_register(&m_arena_chunks);
+
+    opts[n++] = (struct MHD_OptionItem){ MHD_OPTION_NOTIFY_CONNECTION,
+                                         (intptr_t)notify_connection, NULL };
+    opts[n++] = (struct MHD_OptionItem){ MHD_OPTION_NOTIFY_COMPLETED,
+                                         (intptr_t)track_completed, NULL };
+    OPT(MHD_OPTION_END, 0);
+#undef OPT
+
+    /* MHD_USE_ITC lets httpd_serve() quiesce the listener while threads run */
+    return MHD_start_daemon(flags | MHD_USE_EPOLL_INTERNAL_THREAD | MHD_USE_ITC,
+                            cfg->port, NULL, NULL, track_handler, NULL,
+                            MHD_OPTION_ARRAY, opts,
+                            MHD_OPTION_END);
+}
+
+void httpd_set_drain_hook(void (*fn)(void))
+{
+    drain_hook = fn;
+}
+
+void httpd_set_expire_hook(void (*fn)(void))
+{
+    expire_hook = fn;
+}
+
+static void wait_inflight(time_t until)
+{
+    while (__atomic_load_n(&inflight, __ATOMIC_RELAXED) > 0 && time(NULL) < until) {
+        struct timespec ts = { 0, 10 * 1000 * 1000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+void httpd_serve(const httpd_config_t *cfg, struct MHD_Daemon *daemon)
+{
+    sigset_t set;
+    int      sig;
+    sigemptyset(&set);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+
+    sd_notify(0, "READY=1");
+    while (sigwait(&set, &sig) != 0) {}
+    sd_notify(0, "STOPPING=1");
+
+    /* Stop accepting; an inherited socket stays open in systemd for the next start */
+    int fd = MHD_quiesce_daemon(daemon);
+    if (fd >= 0) close(fd);
+    if (drain_hook) drain_hook();
+
+    unsigned timeout = cfg->drain_timeout ? cfg->drain_timeout : HTTPD_DRAIN_TIMEOUT;
+    wait_inflight(time(NULL) + timeout);
+
+    unsigned left = __atomic_load_n(&inflight, __ATOMIC_RELAXED);
+    if (left) fprintf(stderr, "drain timed out with %u requests in flight\n", left);
+
+    /* MHD_stop_daemon() aborts on a suspended connection: resume them, let them answer */
+    if (left && expire_hook) {
+        expire_hook();
+        wait_inflight(time(NULL) + 2);
+    }
+
+    MHD_stop_daemon(daemon);
+}
+
+double httpd_connections(void *daemon)
+{
+    const union MHD_DaemonInfo *info =
+        MHD_get_daemon_info(daemon, MHD_DAEMON_INFO_CURRENT_CONNECTIONS);
+    return info ? info->num_connections : 0;
+}
+
+enum MHD_Result httpd_send_metrics(struct MHD_Connection *conn)
+{
+    size_t      len  = 0;
+    const char *body = metrics_render(httpd_arena(conn), &len);
+
+    struct MHD_Response *resp =
+        MHD_create_response_from_buffer(len, (void *)body, MHD_RESPMEM_PERSISTENT);
+    if (!resp) return MHD_NO;
+    MHD_add_response_header(resp, "Content-Type", "text/plain; version=0.0.4");
+
+    enum MHD_Result ret = MHD_queue_response(
+        conn, body ? MHD_HTTP_OK : MHD_HTTP_INTERNAL_SERVER_ERROR, resp);
+    MHD_destroy_response(resp);
+    return ret;
+}
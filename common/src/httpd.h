@@ -0,0 +1,115 @@
+#ifndef HTTPD_H
+#define HTTPD_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <microhttpd.h>
+#include "arena.h"
+
+/*
+ * Concurrency and connection settings shared by the C daemons.
+ * Zero for any limit means "leave libmicrohttpd's default".
+ */
+typedef struct {
+    uint16_t port;          /* listen port */
+    unsigned threads;       /* epoll event-loop threads (1 = single loop) */
+    unsigned conn_limit;    /* total concurrent connections */
+    unsigned per_ip_limit;  /* concurrent connections per client address */
+    unsigned conn_timeout;  /* idle connection timeout, seconds */
+    size_t   conn_memory;   /* per-connection memory pool, bytes */
+    unsigned backlog;       /* listen() backlog */
+    unsigned drain_timeout; /* seconds to let in-flight requests finish on SIGTERM */
+} httpd_config_t;
+
+#define HTTPD_DRAIN_TIMEOUT 10
+
+/* getopt_long codes — keep clear of any short option character */
+enum {
+    HTTPD_OPT_PORT = 0x100,
+    HTTPD_OPT_THREADS,
+    HTTPD_OPT_CONN_LIMIT,
+    HTTPD_OPT_PER_IP_LIMIT,
+    HTTPD_OPT_CONN_TIMEOUT,
+    HTTPD_OPT_CONN_MEMORY,
+    HTTPD_OPT_BACKLOG,
+    HTTPD_OPT_DRAIN_TIMEOUT,
+};
+
+/* Entries to splice into a daemon's struct option table */
+#define HTTPD_LONG_OPTIONS \
+    { "port",         required_argument, NULL, HTTPD_OPT_PORT         }, \
+    { "threads",      required_argument, NULL, HTTPD_OPT_THREADS      }, \
+    { "conn-limit",   required_argument, NULL, HTTPD_OPT_CONN_LIMIT   }, \
+    { "per-ip-limit", required_argument, NULL, HTTPD_OPT_PER_IP_LIMIT }, \
+    { "conn-timeout", required_argument, NULL, HTTPD_OPT_CONN_TIMEOUT }, \
+    { "conn-memory",  required_argument, NULL, HTTPD_OPT_CONN_MEMORY  }, \
+    { "backlog",      required_argument, NULL, HTTPD_OPT_BACKLOG      }, \
+    { "drain-timeout", required_argument, NULL, HTTPD_OPT_DRAIN_TIMEOUT }
+
+/*
+ * Override cfg from <prefix>_PORT, <prefix>_THREADS, <prefix>_CONN_LIMIT, ... so a systemd
+ * EnvironmentFile= can act as the config file. Flags parsed afterwards win.
+ */
+void httpd_config_env(httpd_config_t *cfg, const char *prefix);
+
+/* Apply one getopt_long result — returns 0 if opt was an HTTPD_OPT_*, -1 otherwise */
+int  httpd_config_set(httpd_config_t *cfg, int opt, const char *arg);
+
+/* Print the HTTPD_LONG_OPTIONS help lines */
+void httpd_config_usage(FILE *out);
+
+/*
+ * Block SIGTERM and SIGINT. Call first thing in main(), before any thread
+ * exists, so every thread inherits the mask and only httpd_serve() sees them.
+ */
+void httpd_block_signals(void);
+
+/*
+ * Start an MHD daemon with cfg applied on top of flags. extra is an
+ * MHD_OPTION_END-terminated option array (or NULL) for daemon-specific options.
+ *
+ * Under systemd socket activation the inherited socket (sd_listen_fds) is
+ * used and cfg->port is ignored, so connections queue in the kernel while
+ * the daemon restarts. Only one daemon per process: in-flight requests are
+ * tracked in file-level state for httpd_serve().
+ */
+struct MHD_Daemon *httpd_start(const httpd_config_t *cfg, unsigned int flags,
+                               MHD_AccessHandlerCallback handler, void *handler_cls,
+                               const struct MHD_OptionItem *extra);
+
+/*
+ * Report READY=1 to systemd, then block until SIGTERM or SIGINT. On either,
+ * stop accepting (MHD_quiesce_daemon), give in-flight requests up to
+ * cfg->drain_timeout seconds to finish, and stop the daemon.
+ */
+void httpd_serve(const httpd_config_t *cfg, struct MHD_Daemon *daemon);
+
+/*
+ * Called by httpd_serve() once the listener is closed, to end requests that
+ * would otherwise never finish (long-lived streams) before the drain wait.
+ */
+void httpd_set_drain_hook(void (*fn)(void));
+
+/*
+ * Called by httpd_serve() if requests are left when the drain wait runs
+ * out, just before MHD_stop_daemon(). A daemon that suspends connections
+ * must resume every one here: MHD aborts on any still suspended.
+ */
+void httpd_set_expire_hook(void (*fn)(void));
+
+/*
+ * Arena for the current request on conn, rewound once MHD reports the
+ * request completed — response bodies built here need no copy (see
+ * response.h). Only valid inside a handler started by httpd_start().
+ */
+arena_t *httpd_arena(struct MHD_Connection *conn);
+
+/* Gauge reader for metrics_gauge(): open connections on the daemon passed as arg */
+double httpd_connections(void *daemon);
+
+/* Queue a 200 with every metric in Prometheus text format (500 on out-of-memory) */
+enum MHD_Result httpd_send_metrics(struct MHD_Connection *conn);
+
+#endif
@@ -0,0 +1,559 @@
+#include "json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* ── Tokenizer ────────────────────────────────────────────────────────────── */
+
+typedef struct {
+    const char *s;
+    size_t      len;
+    size_t      pos;
+    json_tok_t *toks;
+    unsigned    cap;
+    unsigned    n;
+} parser_t;
+
+static void skip_ws(parser_t *p)
+{
+    const char *s = p->s;
+    size_t      i = p->pos, n = p->len;
+    while (i < n && (s[i] == ' ' || s[i] == '\n' || s[i] == '\t' || s[i] == '\r')) i++;
+    p->pos = i;
+}
+
+static int new_tok(parser_t *p, json_type_t type, size_t start)
+{
+    if (p->n >= p->cap) return JSON_ERR_NOMEM;
+    json_tok_t *t = &p->toks[p->n];
+    t->type    = type;
+    t->start   = (uint32_t)start;
+    t->len     = 0;
+    t->size    = 0;
+    t->next    = 0;
+    t->escaped = 0;
+    return (int)p->n++;
+}
+
+/* Bytes that end a plain run inside a string: controls, '"' and '\\' */
+static const unsigned char special[256] = { [0 ... 0x1f] = 1, ['"'] = 1, ['\\'] = 1 };
+
+static int is_hex(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static int parse_string(parser_t *p)
+{
+    int idx = new_tok(p, JSON_STRING, ++p->pos);   /* skip opening quote */
+    if (idx < 0) return idx;
+
+    const char *s = p->s;
+    size_t      i = p->pos, n = p->len;
+
+    for (;;) {
+        /* Plain characters are the common case: scan them without the switch */
+        while (i < n && !special[(unsigned char)s[i]]) i++;
+        if (i >= n) return JSON_ERR_SYNTAX;   /* unterminated */
+
+        char c = s[i];
+        if (c == '"') break;
+        if (c != '\\') return JSON_ERR_SYNTAX;
+
+        p->toks[idx].escaped = 1;
+        if (++i >= n) return JSON_ERR_SYNTAX;
+        switch (s[i]) {
+        case '"': case '\\': case '/': case 'b':
+        case 'f': case 'n':  case 'r': case 't':
+            break;
+        case 'u':
+            if (i + 4 >= n) return JSON_ERR_SYNTAX;
+            for (int k = 1; k <= 4; k++)
+                if (!is_hex(s[i + k])) return JSON_ERR_SYNTAX;
+            i += 4;
+            break;
+        default:
+            return JSON_ERR_SYNTAX;
+        }
+        i++;
+    }
+
+    p->toks[idx].len  = (uint32_t)(i - p->toks[idx].start);
+    p->toks[idx].next = p->n;
+    p->pos = i + 1;
+    return 0;
+}
+
+static int parse_number(parser_t *p)
+{
+    size_t start = p->pos;
+    int idx = new_tok(p, JSON_NUMBER, start);
+    if (idx < 0) return idx;
+
+    const char *s = p->s;
+    size_t      i = p->pos, n = p->len;
+
+    if (i < n && s[i] == '-') i++;
+    if (i < n && s[i] == '0') {
+        i++;
+    } else if (i < n && is_digit(s[i])) {
+        while (i < n && is_digit(s[i])) i++;
+    } else {
+        return JSON_ERR_SYNTAX;
+    }
+    if (i < n && s[i] == '.') {
+        i++;
+        if (i >= n || !is_digit(s[i])) return JSON_ERR_SYNTAX;
+        while (i < n && is_digit(s[i])) i++;
+    }
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+        if (i < n && (s[i] == '+' || s[i] == '-')) i++;
+        if (i >= n || !is_digit(s[i])) return JSON_ERR_SYNTAX;
+        while (i < n && is_digit(s[i])) i++;
+    }
+
+    p->pos = i;
+    p->toks[idx].len  = (uint32_t)(i - start);
+    p->toks[idx].next = p->n;
+    return 0;
+}
+
+static int parse_literal(parser_t *p, const char *word, json_type_t type)
+{
+    size_t n = strlen(word);
+    if (p->len - p->pos < n || memcmp(p->s + p->pos, word, n) != 0)
+        return JSON_ERR_SYNTAX;
+
+    int idx = new_tok(p, type, p->pos);
+    if (idx < 0) return idx;
+    p->toks[idx].len  = (uint32_t)n;
+    p->toks[idx].next = p->n;
+    p->pos += n;
+    return 0;
+}
+
+static int parse_value(parser_t *p, int depth);
+
+static int parse_container(parser_t *p, int depth, int is_object)
+{
+    if (depth >= JSON_MAX_DEPTH) return JSON_ERR_DEPTH;
+
+    char close = is_object ? '}' : ']';
+    int  idx   = new_tok(p, is_object ? JSON_OBJECT : JSON_ARRAY, p->pos);
+    if (idx < 0) return idx;
+    p->pos++;
+
+    skip_ws(p);
+    if (p->pos < p->len && p->s[p->pos] == close) {
+        p->pos++;
+    } else {
+        for (;;) {
+            int rc;
+            if (is_object) {
+                skip_ws(p);
+                if (p->pos >= p->len || p->s[p->pos] != '"') return JSON_ERR_SYNTAX;
+                if ((rc = parse_string(p)) != 0) return rc;
+                skip_ws(p);
+                if (p->pos >= p->len || p->s[p->pos] != ':') return JSON_ERR_SYNTAX;
+                p->pos++;
+            }
+            if ((rc = parse_value(p, depth + 1)) != 0) return rc;
+            p->toks[idx].size++;
+
+            skip_ws(p);
+            if (p->pos >= p->len) return JSON_ERR_SYNTAX;
+            char c = p->s[p->pos++];
+            if (c == close) break;
+            if (c != ',')   return JSON_ERR_SYNTAX;
+        }
+    }
+
+    p->toks[idx].len  = (uint32_t)(p->pos - p->toks[idx].start);
+    p->toks[idx].next = p->n;
+    return 0;
+}
+
+static int parse_value(parser_t *p, int depth)
+{
+    skip_ws(p);
+    if (p->pos >= p->len) return JSON_ERR_SYNTAX;
+
+    switch (p->s[p->pos]) {
+    case '{': return parse_container(p, depth, 1);
+    case '[': return parse_container(p, depth, 0);
+    case '"': return parse_string(p);
+    case 't': return parse_literal(p, "true",  JSON_TRUE);
+    case 'f': return parse_literal(p, "false", JSON_FALSE);
+    case 'n': return parse_literal(p, "null",  JSON_NULL);
+    default:  return parse_number(p);
+    }
+}
+
+int json_parse(json_doc_t *doc, const char *src, size_t len, json_tok_t *toks, unsigned cap)
+{
+    parser_t p = { .s = src, .len = len, .toks = toks, .cap = cap };
+
+    doc->src   = src;
+    doc->toks  = toks;
+    doc->count = 0;
+
+    if (len >= UINT32_MAX) return JSON_ERR_SYNTAX;
+
+    int rc = parse_value(&p, 0);
+    if (rc != 0) return rc;
+
+    skip_ws(&p);
+    if (p.pos != len) return JSON_ERR_SYNTAX;
+
+    doc->count = p.n;
+    return 0;
+}
+
+int json_parse_arena(json_doc_t *doc, const char *src, size_t len, arena_t *arena)
+{
+    /*
+     * Every token of a valid document but the last needs at least two bytes
+     * of source, so running out of tokens means the input is malformed
+     * (a run of '[' say) — report it as such, not as out of memory.
+     */
+    unsigned    cap  = (unsigned)(len / 2 + 2);
+    json_tok_t *toks = arena_alloc(arena, (size_t)cap * sizeof(json_tok_t));
+    if (!toks) return JSON_ERR_NOMEM;
+    int rc = json_parse(doc, src, len, toks, cap);
+    return rc == JSON_ERR_NOMEM ? JSON_ERR_SYNTAX : rc;
+}
+
+/* ── Accessors ────────────────────────────────────────────────────────────── */
+
+static void put_utf8(char *out, size_t *o, unsigned cp)
+{
+    if (cp < 0x80) {
+        out[(*o)++] = (char)cp;
+    } else if (cp < 0x800) {
+        out[(*o)++] = (char)(0xc0 | (cp >> 6));
+        out[(*o)++] = (char)(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        out[(*o)++] = (char)(0xe0 | (cp >> 12));
+        out[(*o)++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[(*o)++] = (char)(0x80 | (cp & 0x3f));
+    } else {
+        out[(*o)++] = (char)(0xf0 | (cp >> 18));
+        out[(*o)++] = (char)(0x80 | ((cp >> 12) & 0x3f));
+        out[(*o)++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[(*o)++] = (char)(0x80 | (cp & 0x3f));
+    }
+}
+
+static unsigned hex4(const char *s)
+{
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = s[i];
+        v = (v << 4) | (unsigned)(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+    return v;
+}
+
+/*
+ * Decode a validated string body into out (NUL-terminated). Decoded text is
+ * never longer than its source, so out_len >= len + 1 always suffices.
+ * Returns the length, or -1 if it does not fit.
+ */
+static int unescape(const char *s, size_t len, char *out, size_t out_len)
+{
+    size_t o = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] != '\\') {
+            if (o + 1 >= out_len) return -1;
+            out[o++] = s[i];
+            continue;
+        }
+
+        char   tmp[4];
+        size_t tn = 0;
+        char   e  = s[++i];
+        switch (e) {
+        case 'b': tmp[tn++] = '\b'; break;
+        case 'f': tmp[tn++] = '\f'; break;
+        case 'n': tmp[tn++] = '\n'; break;
+        case 'r': tmp[tn++] = '\r'; break;
+        case 't': tmp[tn++] = '\t'; break;
+        case 'u': {
+            unsigned cp = hex4(s + i + 1);
+            i += 4;
+            if (cp >= 0xd800 && cp <= 0xdbff && i + 6 < len &&
+                s[i + 1] == '\\' && s[i + 2] == 'u') {
+                unsigned lo = hex4(s + i + 3);
+                if (lo >= 0xdc00 && lo <= 0xdfff) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    i += 6;
+                }
+            }
+            if (cp >= 0xd800 && cp <= 0xdfff) cp = 0xfffd;  /* lone surrogate */
+            put_utf8(tmp, &tn, cp);
+            break;
+        }
+        default: tmp[tn++] = e; break;   /* " \ / */
+        }
+
+        if (o + tn >= out_len) return -1;
+        memcpy(out + o, tmp, tn);
+        o += tn;
+    }
+
+    if (o >= out_len) return -1;
+    out[o] = '\0';
+    return (int)o;
+}
+
+static int key_equals(const json_doc_t *doc, const json_tok_t *t, const char *key, size_t key_len)
+{
+    const char *s = doc->src + t->start;
+
+    if (!t->escaped)
+        return t->len == key_len && memcmp(s, key, key_len) == 0;
+
+    char buf[256];
+    int  n = unescape(s, t->len, buf, sizeof(buf));
+    return n >= 0 && (size_t)n == key_len && memcmp(buf, key, key_len) == 0;
+}
+
+int json_object_get(const json_doc_t *doc, int obj, const char *key)
+{
+    if (obj < 0 || (unsigned)obj >= doc->count) return -1;
+    const json_tok_t *o = &doc->toks[obj];
+    if (o->type != JSON_OBJECT) return -1;
+
+    size_t   key_len = strlen(key);
+    unsigned i       = (unsigned)obj + 1;
+
+    for (uint32_t m = 0; m < o->size; m++) {
+        if (key_equals(doc, &doc->toks[i], key, key_len))
+            return (int)i + 1;
+        i = doc->toks[i + 1].next;
+    }
+    return -1;
+}
+
+json_slice_t json_slice(const json_doc_t *doc, int idx)
+{
+    json_slice_t sl = { doc->src + doc->toks[idx].start, doc->toks[idx].len };
+    return sl;
+}
+
+int json_get_string(const json_doc_t *doc, int obj, const char *key, char *out, size_t out_len)
+{
+    int idx = json_object_get(doc, obj, key);
+    if (idx < 0 || doc->toks[idx].type != JSON_STRING) return -1;
+    return unescape(doc->src + doc->toks[idx].start, doc->toks[idx].len, out, out_len);
+}
+
+int json_get_int(const json_doc_t *doc, int obj, const char *key, long *out)
+{
+    int idx = json_object_get(doc, obj, key);
+    if (idx < 0 || doc->toks[idx].type != JSON_NUMBER) return -1;
+
+    json_slice_t sl = json_slice(doc, idx);
+    char buf[32];
+    if (sl.len >= sizeof(buf) || memchr(sl.ptr, '.', sl.len) ||
+        memchr(sl.ptr, 'e', sl.len) || memchr(sl.ptr, 'E', sl.len))
+        return -1;
+
+    memcpy(buf, sl.ptr, sl.len);
+    buf[sl.len] = '\0';
+    *out = strtol(buf, NULL, 10);
+    return 0;
+}
+
+char *json_string_dup(const json_doc_t *doc, int idx, arena_t *arena)
+{
+    if (idx < 0 || doc->toks[idx].type != JSON_STRING) return NULL;
+
+    size_t len = doc->toks[idx].len;
+    char  *out = arena_alloc(arena, len + 1);
+    if (!out) return NULL;
+    if (unescape(doc->src + doc->toks[idx].start, len, out, len + 1) < 0) return NULL;
+    return out;
+}
+
+/* ── Writer ───────────────────────────────────────────────────────────────── */
+
+static int jw_reserve(jw_t *w, size_t n)
+{
+    if (w->err) return 0;
+    if (w->len + n + 1 <= w->cap) return 1;
+
+    size_t cap = w->cap ? w->cap * 2 : 256;
+    while (cap < w->len + n + 1) cap *= 2;
+
+    char *buf = arena_alloc(w->arena, cap);
+    if (!buf) { w->err = 1; return 0; }
+    if (w->len) memcpy(buf, w->buf, w->len);
+    w->buf = buf;
+    w->cap = cap;
+    return 1;
+}
+
+static void jw_put(jw_t *w, const char *s, size_t n)
+{
+    if (!jw_reserve(w, n)) return;
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+static void jw_putc(jw_t *w, char c)
+{
+    if (!jw_reserve(w, 1)) return;
+    w->buf[w->len++] = c;
+}
+
+/* Emit the separator owed before the next value or key */
+static void jw_sep(jw_t *w)
+{
+    if (w->after_key) { w->after_key = 0; return; }
+    if (w->depth == 0) return;
+
+    uint64_t bit = 1ULL << w->depth;
+    if (w->first & bit) w->first &= ~bit;
+    else                jw_putc(w, ',');
+}
+
+static void jw_open(jw_t *w, char c)
+{
+    jw_sep(w);
+    if (w->depth + 1 >= JSON_MAX_DEPTH) { w->err = 1; return; }
+    jw_putc(w, c);
+    w->depth++;
+    w->first |= 1ULL << w->depth;
+}
+
+static void jw_close(jw_t *w, char c)
+{
+    if (w->depth == 0) { w->err = 1; return; }
+    jw_putc(w, c);
+    w->depth--;
+}
+
+static void jw_escaped(jw_t *w, const char *s, size_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    /* Room for the common case, a string with nothing to escape, up front */
+    if (!jw_reserve(w, n + 2)) return;
+    w->buf[w->len++] = '"';
+
+    size_t run = 0;
+    for (size_t i = 0;; i++) {
+        while (i < n && !special[(unsigned char)s[i]]) i++;
+        if (i == n) break;
+
+        unsigned char c = (unsigned char)s[i];
+        jw_put(w, s + run, i - run);
+        run = i + 1;
+
+        switch (c) {
+        case '"':  jw_put(w, "\\\"", 2); break;
+        case '\\': jw_put(w, "\\\\", 2); break;
+        case '\n': jw_put(w, "\\n", 2);  break;
+        case '\r': jw_put(w, "\\r", 2);  break;
+        case '\t': jw_put(w, "\\t", 2);  break;
+        case '\b': jw_put(w, "\\b", 2);  break;
+        case '\f': jw_put(w, "\\f", 2);  break;
+        default: {
+            char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+            jw_put(w, u, sizeof(u));
+        }
+        }
+    }
+    jw_put(w, s + run, n - run);
+    jw_putc(w, '"');
+}
+
+void jw_init(jw_t *w, arena_t *arena, size_t initial_cap)
+{
+    memset(w, 0, sizeof(*w));
+    w->arena = arena;
+    if (initial_cap) jw_reserve(w, initial_cap);
+}
+
+void jw_object_begin(jw_t *w) { jw_open(w, '{'); }
+void jw_object_end(jw_t *w)   { jw_close(w, '}'); }
+void jw_array_begin(jw_t *w)  { jw_open(w, '['); }
+void jw_array_end(jw_t *w)    { jw_close(w, ']'); }
+
+void jw_key(jw_t *w, const char *key)
+{
+    jw_sep(w);
+    jw_escaped(w, key, strlen(key));
+    jw_putc(w, ':');
+    w->after_key = 1;
+}
+
+void jw_string(jw_t *w, const char *s)
+{
+    jw_string_n(w, s, strlen(s));
+}
+
+void jw_string_n(jw_t *w, const char *s, size_t n)
+{
+    jw_sep(w);
+    jw_escaped(w, s, n);
+}
+
+void jw_int(jw_t *w, long long v)
+{
+    char buf[24];
+    jw_sep(w);
+    jw_put(w, buf, (size_t)snprintf(buf, sizeof(buf), "%lld", v));
+}
+
+void jw_uint(jw_t *w, unsigned long long v)
+{
+    char buf[24];
+    jw_sep(w);
+    jw_put(w, buf, (size_t)snprintf(buf, sizeof(buf), "%llu", v));
+}
+
+void jw_double(jw_t *w, double v)
+{
+    if (!isfinite(v)) { jw_null(w); return; }
+    char buf[32];
+    jw_sep(w);
+    jw_put(w, buf, (size_t)snprintf(buf, sizeof(buf), "%.15g", v));
+}
+
+void jw_bool(jw_t *w, int v)
+{
+    jw_sep(w);
+    if (v) jw_put(w, "true", 4);
+    else   jw_put(w, "false", 5);
+}
+
+void jw_null(jw_t *w)
+{
+    jw_sep(w);
+    jw_put(w, "null", 4);
+}
+
+void jw_raw(jw_t *w, const char *json, size_t n)
+{
+    jw_sep(w);
+    jw_put(w, json, n);
+}
+
+const char *jw_finish(jw_t *w, size_t *len)
+{
+    if (w->depth != 0) w->err = 1;
+    if (!jw_reserve(w, 0)) return NULL;
+    w->buf[w->len] = '\0';
+    if (len) *len = w->len;
+    return w->buf;
+}
@@ -0,0 +1,120 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+/* ── Tokenizer ────────────────────────────────────────────────────────────── */
+
+typedef enum {
+    JSON_OBJECT = 1,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL,
+} json_type_t;
+
+#define JSON_ERR_SYNTAX (-1)
+#define JSON_ERR_NOMEM  (-2)   /* more tokens than the caller's array holds */
+#define JSON_ERR_DEPTH  (-3)   /* nested deeper than JSON_MAX_DEPTH */
+
+#define JSON_MAX_DEPTH  64
+
+/*
+ * One token per value, in document order. Slices point into the source:
+ * strings exclude their quotes and keep escapes as written; containers span
+ * from the opening to the closing bracket.
+ */
+typedef struct {
+    json_type_t type;
+    uint32_t    start;
+    uint32_t    len;
+    uint32_t    size;     /* object: members, array: elements */
+    uint32_t    next;     /* index of the token after this whole value */
+    uint8_t     escaped;  /* string contains backslash escapes */
+} json_tok_t;
+
+typedef struct {
+    const char *src;
+    json_tok_t *toks;
+    unsigned    count;
+} json_doc_t;
+
+typedef struct {
+    const char *ptr;
+    size_t      len;
+} json_slice_t;
+
+/*
+ * Tokenize src[0..len) in a single pass into toks[0..cap). The whole input
+ * must be exactly one JSON value (surrounding whitespace allowed).
+ * Returns 0 or a JSON_ERR_* code.
+ */
+int json_parse(json_doc_t *doc, const char *src, size_t len, json_tok_t *toks, unsigned cap);
+
+/* json_parse with a token array sized for the worst case, taken from arena */
+int json_parse_arena(json_doc_t *doc, const char *src, size_t len, arena_t *arena);
+
+/* Token index of member key in object obj (direct members only), or -1 */
+int json_object_get(const json_doc_t *doc, int obj, const char *key);
+
+/* Raw source slice of token idx (a complete value for containers) */
+json_slice_t json_slice(const json_doc_t *doc, int idx);
+
+/*
+ * Unescape string member key of object obj into out (NUL-terminated).
+ * Returns the length, or -1 if missing, not a string, or longer than out_len - 1.
+ */
+int json_get_string(const json_doc_t *doc, int obj, const char *key, char *out, size_t out_len);
+
+/* Integer member key of object obj — returns 0, or -1 if missing or not an integer */
+int json_get_int(const json_doc_t *doc, int obj, const char *key, long *out);
+
+/* Unescape string token idx into the arena — NULL on error */
+char *json_string_dup(const json_doc_t *doc, int idx, arena_t *arena);
+
+/* ── Writer ───────────────────────────────────────────────────────────────── */
+
+/*
+ * Streaming writer into a buffer grown from an arena. Commas and key/value
+ * separators are placed automatically; strings are escaped. Any failure
+ * (out of memory, nesting past JSON_MAX_DEPTH) latches and makes
+ * jw_finish() return NULL, so output is never silently truncated.
+ */
+typedef struct {
+    arena_t *arena;
+    char    *buf;
+    size_t   len;
+    size_t   cap;
+    uint64_t first;       /* bit per depth: no member written yet */
+    int      depth;
+    int      after_key;
+    int      err;
+} jw_t;
+
+void jw_init(jw_t *w, arena_t *arena, size_t initial_cap);
+
+void jw_object_begin(jw_t *w);
+void jw_object_end(jw_t *w);
+void jw_array_begin(jw_t *w);
+void jw_array_end(jw_t *w);
+
+void jw_key(jw_t *w, const char *key);
+void jw_string(jw_t *w, const char *s);
+void jw_string_n(jw_t *w, const char *s, size_t n);
+void jw_int(jw_t *w, long long v);
+void jw_uint(jw_t *w, unsigned long long v);
+void jw_double(jw_t *w, double v);
+void jw_bool(jw_t *w, int v);
+void jw_null(jw_t *w);
+
+/* Insert an already-encoded JSON value verbatim */
+void jw_raw(jw_t *w, const char *json, size_t n);
+
+/* NUL-terminate and return the document (length in *len), or NULL on error */
+const char *jw_finish(jw_t *w, size_t *len);
+
+#endif
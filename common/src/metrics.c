@@ -0,0 +1,295 @@
+#include "metrics.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_GAUGES 16
+
+/* Bucket upper bounds in ns: 10 µs … 10 s in 1-2.5-5 steps, then +Inf */
+static const uint64_t bounds[] = {
+    10000, 25000, 50000,
+    100000, 250000, 500000,
+    1000000, 2500000, 5000000,
+    10000000, 25000000, 50000000,
+    100000000, 250000000, 500000000,
+    1000000000, 2500000000ULL, 5000000000ULL,
+    10000000000ULL,
+};
+#define NBOUNDS  (sizeof(bounds) / sizeof(bounds[0]))
+#define NBUCKETS (NBOUNDS + 1)
+
+typedef struct {
+    uint64_t count;               /* counter value, or observations */
+    uint64_t sum_ns;
+    uint64_t buckets[NBUCKETS];   /* non-cumulative */
+} slot_t;
+
+typedef struct block {
+    struct block *next;
+    slot_t        slots[METRICS_MAX];
+} block_t;
+
+typedef struct {
+    const char *name;
+    const char *help;
+    double    (*read)(void *arg);
+    void       *arg;
+} gauge_t;
+
+static metric_t       *defs[METRICS_MAX];
+static int             ndefs;
+static gauge_t         gauges[MAX_GAUGES];
+static int             ngauges;
+static block_t        *blocks;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread block_t *mine;
+
+uint64_t metrics_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int metrics_register(metric_t *m)
+{
+    if (__atomic_load_n(&m->slot, __ATOMIC_ACQUIRE)) return 0;
+
+    pthread_mutex_lock(&lock);
+    int rc = 0;
+    if (!m->slot) {
+        if (ndefs < METRICS_MAX) {
+            defs[ndefs] = m;
+            __atomic_store_n(&m->slot, ++ndefs, __ATOMIC_RELEASE);
+        } else {
+            rc = -1;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return rc;
+}
+
+/* This thread's slot for m, or NULL if metrics are full or out of memory */
+static slot_t *slot_for(metric_t *m)
+{
+    int slot = __atomic_load_n(&m->slot, __ATOMIC_ACQUIRE);
+    if (!slot) {
+        if (metrics_register(m) != 0) return NULL;
+        slot = m->slot;
+    }
+
+    if (!mine) {
+        block_t *b = calloc(1, sizeof(*b));
+        if (!b) return NULL;
+        pthread_mutex_lock(&lock);
+        b->next = blocks;
+        blocks  = b;
+        pthread_mutex_unlock(&lock);
+        mine = b;
+    }
+    return &mine->slots[slot - 1];
+}
+
+/* Owner-only increment; relaxed atomics so a concurrent scrape reads whole values */
+static inline void bump(uint64_t *p, uint64_t n)
+{
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+void metrics_add(metric_t *m, uint64_t n)
+{
+    slot_t *s = slot_for(m);
+    if (s) bump(&s->count, n);
+}
+
+void metrics_inc(metric_t *m)
+{
+    metrics_add(m, 1);
+}
+
+void metrics_observe(metric_t *m, uint64_t ns)
+{
+    slot_t *s = slot_for(m);
+    if (!s) return;
+
+    unsigned b = 0;
+    while (b < NBOUNDS && ns > bounds[b]) b++;
+
+    bump(&s->buckets[b], 1);
+    bump(&s->sum_ns, ns);
+    bump(&s->count, 1);
+}
+
+uint64_t metrics_quantile(metric_t *const *ms, int n, double p)
+{
+    uint64_t buckets[NBUCKETS] = {0};
+    uint64_t count = 0;
+
+    pthread_mutex_lock(&lock);
+    for (block_t *b = blocks; b; b = b->next) {
+        for (int i = 0; i < n; i++) {
+            int slot = __atomic_load_n(&ms[i]->slot, __ATOMIC_ACQUIRE);
+            if (!slot) continue;
+            const slot_t *s = &b->slots[slot - 1];
+            for (unsigned k = 0; k < NBUCKETS; k++) {
+                uint64_t c = __atomic_load_n(&s->buckets[k], __ATOMIC_RELAXED);
+                buckets[k] += c;
+                count      += c;
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (count == 0) return 0;
+    double rank = p * (double)count;
+
+    uint64_t seen = 0;
+    for (unsigned k = 0; k < NBOUNDS; k++) {
+        if (buckets[k] && (double)(seen + buckets[k]) >= rank) {
+            uint64_t lo = k ? bounds[k - 1] : 0;
+            double   in = (rank - (double)seen) / (double)buckets[k];
+            return lo + (uint64_t)(in * (double)(bounds[k] - lo));
+        }
+        seen += buckets[k];
+    }
+    return bounds[NBOUNDS - 1];
+}
+
+int metrics_gauge(const char *name, const char *help, double (*read)(void *arg), void *arg)
+{
+    pthread_mutex_lock(&lock);
+    int rc = -1;
+    if (ngauges < MAX_GAUGES) {
+        gauges[ngauges++] = (gauge_t){ name, help, read, arg };
+        rc = 0;
+    }
+    pthread_mutex_unlock(&lock);
+    return rc;
+}
+
+/* ── Rendering ────────────────────────────────────────────────────────────── */
+
+typedef struct {
+    arena_t *arena;
+    char    *buf;
+    size_t   len;
+    size_t   cap;
+    int      err;
+} out_t;
+
+static void out_printf(out_t *o, const char *fmt, ...)
+{
+    if (o->err) return;
+
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) { o->err = 1; return; }
+        if ((size_t)n < o->cap - o->len) {
+            o->len += (size_t)n;
+            return;
+        }
+
+        size_t cap = o->cap * 2;
+        while (cap < o->len + (size_t)n + 1) cap *= 2;
+        char *p = arena_alloc(o->arena, cap);
+        if (!p) { o->err = 1; return; }
+        memcpy(p, o->buf, o->len);
+        o->buf = p;
+        o->cap = cap;
+    }
+}
+
+/* "{labels,extra}" / "{labels}" / "{extra}" / "" */
+static void out_labels(out_t *o, const char *labels, const char *extra)
+{
+    int has_l = labels && *labels;
+    int has_e = extra  && *extra;
+    if (!has_l && !has_e) return;
+    out_printf(o, "{%s%s%s}", has_l ? labels : "", has_l && has_e ? "," : "", has_e ? extra : "");
+}
+
+const char *metrics_render(arena_t *arena, size_t *len)
+{
+    out_t o = { .arena = arena, .cap = 8192 };
+    o.buf = arena_alloc(arena, o.cap);
+    if (!o.buf) return NULL;
+    o.buf[0] = '\0';
+
+    pthread_mutex_lock(&lock);
+
+    /* Sum every thread's block, metric by metric */
+    static slot_t total[METRICS_MAX];
+    memset(total, 0, sizeof(slot_t) * (size_t)ndefs);
+    for (block_t *b = blocks; b; b = b->next) {
+        for (int i = 0; i < ndefs; i++) {
+            const slot_t *s = &b->slots[i];
+            total[i].count  += __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+            total[i].sum_ns += __atomic_load_n(&s->sum_ns, __ATOMIC_RELAXED);
+            for (unsigned k = 0; k < NBUCKETS; k++)
+                total[i].buckets[k] += __atomic_load_n(&s->buckets[k], __ATOMIC_RELAXED);
+        }
+    }
+
+    /* Samples sharing a name must be contiguous, under one HELP/TYPE */
+    char done[METRICS_MAX] = {0};
+    for (int i = 0; i < ndefs; i++) {
+        if (done[i]) continue;
+        const metric_t *m = defs[i];
+        out_printf(&o, "# HELP %s %s\n# TYPE %s %s\n", m->name, m->help, m->name,
+                   m->kind == METRIC_COUNTER ? "counter" : "histogram");
+
+        for (int j = i; j < ndefs; j++) {
+            const metric_t *d = defs[j];
+            if (done[j] || strcmp(d->name, m->name) != 0) continue;
+            done[j] = 1;
+
+            const slot_t *t = &total[j];
+            if (d->kind == METRIC_COUNTER) {
+                out_printf(&o, "%s", d->name);
+                out_labels(&o, d->labels, NULL);
+                out_printf(&o, " %llu\n", (unsigned long long)t->count);
+                continue;
+            }
+
+            uint64_t cum = 0;
+            for (unsigned k = 0; k < NBUCKETS; k++) {
+                char le[32];
+                cum += t->buckets[k];
+                if (k < NBOUNDS) snprintf(le, sizeof(le), "le=\"%g\"", bounds[k] / 1e9);
+                else             snprintf(le, sizeof(le), "le=\"+Inf\"");
+                out_printf(&o, "%s_bucket", d->name);
+                out_labels(&o, d->labels, le);
+                out_printf(&o, " %llu\n", (unsigned long long)cum);
+            }
+            out_printf(&o, "%s_sum", d->name);
+            out_labels(&o, d->labels, NULL);
+            out_printf(&o, " %.9f\n", t->sum_ns / 1e9);
+            out_printf(&o, "%s_count", d->name);
+            out_labels(&o, d->labels, NULL);
+            out_printf(&o, " %llu\n", (unsigned long long)t->count);
+        }
+    }
+
+    gauge_t snap[MAX_GAUGES];
+    int     nsnap = ngauges;
+    memcpy(snap, gauges, sizeof(gauge_t) * (size_t)nsnap);
+    pthread_mutex_unlock(&lock);
+
+    /* Gauge callbacks may take their own locks — never under ours */
+    for (int i = 0; i < nsnap; i++) {
+        const gauge_t *g = &snap[i];
+        out_printf(&o, "# HELP %s %s\n# TYPE %s gauge\n%s %.17g\n",
+                   g->name, g->help, g->name, g->name, g->read(g->arg));
+    }
+
+    if (o.err) return NULL;
+    if (len) *len = o.len;
+    return o.buf;
+}
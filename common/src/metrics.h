@@ -0,0 +1,63 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arena.h"
+
+/*
+ * Prometheus-style counters and latency histograms.
+ *
+ * Each thread records into its own block of slots, so the hot path is a
+ * few relaxed stores with no lock and no shared cache line. A scrape sums
+ * the blocks of every thread that has ever recorded. Blocks are never
+ * freed, so totals don't go backwards when a thread exits.
+ *
+ * Metrics are declared as statics next to the code they measure and get a
+ * slot on first use; metrics_register() makes one show up before that.
+ */
+
+typedef enum {
+    METRIC_COUNTER = 1,
+    METRIC_HISTOGRAM,
+} metric_kind_t;
+
+typedef struct {
+    const char   *name;
+    const char   *labels;   /* e.g. "route=\"/auth\"" — NULL for none */
+    const char   *help;
+    metric_kind_t kind;
+    int           slot;     /* slot + 1 once registered, 0 before */
+} metric_t;
+
+#define METRIC_COUNTER_DEF(name, labels, help)   { name, labels, help, METRIC_COUNTER, 0 }
+#define METRIC_HISTOGRAM_DEF(name, labels, help) { name, labels, help, METRIC_HISTOGRAM, 0 }
+
+#define METRICS_MAX 128   /* counters + histograms per process */
+
+/* Monotonic clock in nanoseconds, for timing observations */
+uint64_t metrics_now(void);
+
+/* Give m a slot now. Returns 0, or -1 once METRICS_MAX is reached */
+int  metrics_register(metric_t *m);
+
+void metrics_add(metric_t *m, uint64_t n);
+void metrics_inc(metric_t *m);
+
+/* Record a duration in nanoseconds (exported in seconds) */
+void metrics_observe(metric_t *m, uint64_t ns);
+
+/*
+ * The p quantile (0 < p <= 1) of the n histograms in ms taken together, in
+ * ns, interpolated within its bucket as Prometheus' histogram_quantile()
+ * does. 0 with no observations; past the last bound it reports that bound.
+ */
+uint64_t metrics_quantile(metric_t *const *ms, int n, double p);
+
+/* Gauge read at scrape time, e.g. live sessions or open connections */
+int  metrics_gauge(const char *name, const char *help, double (*read)(void *arg), void *arg);
+
+/* Render every metric in Prometheus text format — NULL on out-of-memory */
+const char *metrics_render(arena_t *arena, size_t *len);
+
+#endif
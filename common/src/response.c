@@ -0,0 +1,66 @@
+#include "response.h"
+#include "metrics.h"
+#include <string.h>
+
+static metric_t m_shared = METRIC_COUNTER_DEF(
+    "crimata_http_responses_total", "kind=\"shared\"", "HTTP responses by how they were built");
+static metric_t m_built = METRIC_COUNTER_DEF(
+    "crimata_http_responses_total", "kind=\"built\"", "HTTP responses by how they were built");
+
+static struct MHD_Response *json_headers(struct MHD_Response *resp)
+{
+    if (!resp) return NULL;
+    MHD_add_response_header(resp, "Content-Type", "application/json");
+    MHD_add_response_header(resp, "Access-Control-Allow-Origin", "*");
+    return resp;
+}
+
+struct MHD_Response *response_static(const char *body)
+{
+    metrics_register(&m_shared);
+    metrics_register(&m_built);
+    return json_headers(MHD_create_response_from_buffer(
+        strlen(body), (void *)body, MHD_RESPMEM_PERSISTENT));
+}
+
+enum MHD_Result response_queue(struct MHD_Connection *conn, unsigned int status,
+                               struct MHD_Response *resp)
+{
+    metrics_inc(&m_shared);
+    return MHD_queue_response(conn, status, resp);
+}
+
+struct MHD_Response *response_json(const char *body, size_t len)
+{
+    metrics_inc(&m_built);
+    return json_headers(MHD_create_response_from_buffer(
+        len, (void *)body, MHD_RESPMEM_PERSISTENT));
+}
+
+struct MHD_Response *response_empty(void)
+{
+    metrics_inc(&m_built);
+    return MHD_create_response_from_buffer(0, NULL, MHD_RESPMEM_PERSISTENT);
+}
+
+enum MHD_Result response_send(struct MHD_Connection *conn, unsigned int status,
+                              const char *body, size_t len)
+{
+    struct MHD_Response *resp = response_json(body, len);
+    if (!resp) return MHD_NO;
+    enum MHD_Result ret = MHD_queue_response(conn, status, resp);
+    MHD_destroy_response(resp);
+    return ret;
+}
+
+enum MHD_Result response_send_jw(struct MHD_Connection *conn, unsigned int status, jw_t *w)
+{
+    static const char too_large[] = "{\"error\":\"response too large\"}";
+
+    size_t      len;
+    const char *body = jw_finish(w, &len);
+    if (!body)
+        return response_send(conn, MHD_HTTP_INTERNAL_SERVER_ERROR,
+                             too_large, sizeof(too_large) - 1);
+    return response_send(conn, status, body, len);
+}
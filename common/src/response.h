@@ -0,0 +1,45 @@
+#ifndef RESPONSE_H
+#define RESPONSE_H
+
+#include <stddef.h>
+#include <microhttpd.h>
+#include "json.h"
+
+/*
+ * JSON responses without per-request copies.
+ *
+ * Constant bodies (health, 404, fixed errors) are built once at startup
+ * into immutable responses and queued by reference; MHD counts the
+ * references, so every connection can share one. Dynamic bodies are
+ * written into the connection's arena (httpd_arena()) and handed to MHD
+ * as-is, to be rewound when the request completes.
+ *
+ * crimata_http_responses_total{kind="shared"|"built"} counts each path,
+ * so the per-request allocations can be checked under load.
+ */
+
+/* Immutable JSON response for a constant body. Add headers before first use */
+struct MHD_Response *response_static(const char *body);
+
+/* Queue a response from response_static() */
+enum MHD_Result response_queue(struct MHD_Connection *conn, unsigned int status,
+                               struct MHD_Response *resp);
+
+/*
+ * JSON response over body without copying it, so body must outlive the
+ * request: a literal or httpd_arena() memory. The caller queues and
+ * destroys it, and may add headers first.
+ */
+struct MHD_Response *response_json(const char *body, size_t len);
+
+/* Bodiless response for per-request headers, e.g. 204 with X-Crimata-User */
+struct MHD_Response *response_empty(void);
+
+/* response_json(), queued and released */
+enum MHD_Result response_send(struct MHD_Connection *conn, unsigned int status,
+                              const char *body, size_t len);
+
+/* Finish w (over httpd_arena(conn)) and send it, or a 500 if it failed */
+enum MHD_Result response_send_jw(struct MHD_Connection *conn, unsigned int status, jw_t *w);
+
+#endif
@@ -1,128 +1,558 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <glob.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 #include "apps.h"
+#include "events.h"
+#include "json.h"
+#include "loop.h"
+#include "metrics.h"
 
-#define MANIFEST_GLOB "/usr/lib/crimata-*/crimata.json"
-#define MAX_FILE_SIZE 16384
+#define MANIFEST_NAME "crimata.json"
+#define PKG_PREFIX    "crimata-"
 
-/* Pull a string value out of a flat JSON object */
-static int json_str(const char *json, const char *key, char *out, size_t out_len)
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+/* Package directories and manifests are swapped in by rename under dpkg/rpm */
+#define DIR_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM | IN_ONLYDIR)
+#define PKG_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
+static char apps_dir[4096] = APPS_DIR_DEFAULT;
+
+static metric_t m_scan = METRIC_HISTOGRAM_DEF("crimata_dock_apps_scan_seconds", NULL,
+                                              "Time to load every app manifest at startup or after an inotify overflow");
+static metric_t m_reload = METRIC_COUNTER_DEF("crimata_dock_manifest_reloads_total", NULL,
+                                              "Single-package registry updates from inotify");
+static metric_t m_errors = METRIC_COUNTER_DEF("crimata_dock_manifest_errors_total", NULL,
+                                              "Manifests skipped as unreadable or invalid");
+
+static apps_snapshot_t *current;
+static pthread_mutex_t  lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* inotify watch descriptor of each package directory — loop thread only */
+typedef struct {
+    int  wd;
+    char pkg[MAX_STR];
+} pkg_watch_t;
+
+static int          ifd = -1;
+static int          dir_wd = -1;
+static pkg_watch_t *pkg_watches;
+static size_t       npkg_watches, pkg_watches_cap;
+
+/* Whole file into a heap buffer, NUL-terminated — NULL if it can't be read */
+static char *read_file(const char *path, size_t *len)
 {
-    char search[128];
-    snprintf(search, sizeof(search), "\"%s\"", key);
-    const char *pos = strstr(json, search);
-    if (!pos) return 0;
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
 
-    pos += strlen(search);
-    while (*pos == ' ' || *pos == ':') pos++;
-    if (*pos != '"') return 0;
-    pos++;
+    struct stat st;
+    size_t cap = fstat(fileno(f), &st) == 0 && st.st_size > 0 ? (size_t)st.st_size + 1 : 4096;
+    size_t n   = 0;
+    char  *buf = malloc(cap);
 
-    size_t i = 0;
-    while (*pos && *pos != '"' && i < out_len - 1)
-        out[i++] = *pos++;
-    out[i] = '\0';
-    return 1;
+    /* The size is only a hint: a package manager may still be writing it */
+    while (buf) {
+        n += fread(buf + n, 1, cap - n, f);
+        if (n < cap) break;
+        char *p = realloc(buf, cap * 2);
+        if (!p) { free(buf); buf = NULL; break; }
+        buf  = p;
+        cap *= 2;
+    }
+    int err = ferror(f);
+    fclose(f);
+
+    if (!buf || err) {
+        free(buf);
+        return NULL;
+    }
+    buf[n] = '\0';
+    *len   = n;
+    return buf;
 }
 
-static int json_int(const char *json, const char *key, int *out)
+/* A manifest field on its way into the record */
+typedef struct {
+    const char *ptr;
+    size_t      len;
+} field_t;
+
+/* String member key, unescaped into the arena — 0, or -1 if present but not a string */
+static int string_field(const json_doc_t *doc, const char *key, arena_t *arena, field_t *out)
 {
-    char search[128];
-    snprintf(search, sizeof(search), "\"%s\"", key);
-    const char *pos = strstr(json, search);
-    if (!pos) return 0;
+    int idx = json_object_get(doc, 0, key);
+    out->ptr = "";
+    out->len = 0;
+    if (idx < 0) return 0;
+    if (doc->toks[idx].type != JSON_STRING) return -1;
 
-    pos += strlen(search);
-    while (*pos == ' ' || *pos == ':') pos++;
-    if (*pos < '0' || *pos > '9') return 0;
+    char *s = json_string_dup(doc, idx, arena);
+    if (!s) return -1;
+    out->ptr = s;
+    out->len = strlen(s);
+    return 0;
+}
 
-    *out = atoi(pos);
-    return 1;
+/* Raw source of array member key — 0, or -1 if present but not an array */
+static int array_field(const json_doc_t *doc, const char *key, field_t *out)
+{
+    int idx = json_object_get(doc, 0, key);
+    out->ptr = "";
+    out->len = 0;
+    if (idx < 0) return 0;
+    if (doc->toks[idx].type != JSON_ARRAY) return -1;
+
+    json_slice_t sl = json_slice(doc, idx);
+    out->ptr = sl.ptr;
+    out->len = sl.len;
+    return 0;
 }
 
-/* Extract a raw JSON array or object value (string-aware bracket matching) */
-static int json_raw_value(const char *json, const char *key, char *out, size_t out_len)
+enum { F_PKG, F_ID, F_NAME, F_ICON, F_DEFAULT, F_COMPONENTS, F_API, F_AFTER, F_HEALTH, F_COUNT };
+
+/* One allocation holding the record and a copy of each field */
+static app_t *app_new(const field_t *f, int port, int idle_timeout)
 {
-    char search[128];
-    snprintf(search, sizeof(search), "\"%s\"", key);
-    const char *pos = strstr(json, search);
-    if (!pos) return 0;
+    size_t size = sizeof(app_t);
+    for (int i = 0; i < F_COUNT; i++) size += f[i].len + 1;
 
-    pos += strlen(search);
-    while (*pos == ' ' || *pos == ':') pos++;
-    if (*pos != '[' && *pos != '{') return 0;
+    app_t *app = malloc(size);
+    if (!app) return NULL;
+
+    const char **dst[F_COUNT] = {
+        [F_PKG]        = &app->pkg,
+        [F_ID]         = &app->id,
+        [F_NAME]       = &app->name,
+        [F_ICON]       = &app->icon,
+        [F_DEFAULT]    = &app->default_component,
+        [F_COMPONENTS] = &app->components_json,
+        [F_API]        = &app->api_json,
+        [F_AFTER]      = &app->after_json,
+        [F_HEALTH]     = &app->health,
+    };
+    char *p = (char *)(app + 1);
+    for (int i = 0; i < F_COUNT; i++) {
+        memcpy(p, f[i].ptr, f[i].len);
+        p[f[i].len] = '\0';
+        *dst[i] = p;
+        p += f[i].len + 1;
+    }
 
-    char open  = *pos;
-    char close = (open == '[') ? ']' : '}';
-    int  depth  = 0;
-    int  in_str = 0;
-    size_t i = 0;
+    app->refs = 1;
+    app->port = port;
+    app->idle_timeout = idle_timeout;
+    return app;
+}
 
-    while (*pos && i < out_len - 1) {
-        char c = *pos;
-        out[i++] = c;
+static void app_release(app_t *app)
+{
+    if (__atomic_sub_fetch(&app->refs, 1, __ATOMIC_ACQ_REL) == 0) free(app);
+}
 
-        if (in_str) {
-            if (c == '\\' && *(pos + 1)) {
-                /* escaped char — copy next byte too */
-                pos++;
-                if (i < out_len - 1) out[i++] = *pos;
-            } else if (c == '"') {
-                in_str = 0;
-            }
-        } else {
-            if (c == '"')       in_str = 1;
-            else if (c == open)  depth++;
-            else if (c == close) {
-                depth--;
-                if (depth == 0) { pos++; break; }
+/*
+ * Parse <pkg>'s manifest at path into a new record, or NULL. Every field is
+ * kept whole, whatever its size; a manifest that can't be used as written
+ * is skipped with the reason on stderr.
+ */
+static app_t *parse_manifest(const char *path, const char *pkg)
+{
+    size_t len;
+    char  *buf = read_file(path, &len);
+    if (!buf) {
+        if (errno != ENOENT) {   /* removed, or not installed yet */
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            metrics_inc(&m_errors);
+        }
+        return NULL;
+    }
+
+    char        mem[4096];
+    arena_t     arena;
+    json_doc_t  doc;
+    field_t     f[F_COUNT];
+    long        port  = 0;
+    long        idle  = -1;
+    const char *error = NULL;
+    app_t      *app   = NULL;
+
+    arena_init(&arena, mem, sizeof(mem), len + 1024);
+
+    if (json_parse_arena(&doc, buf, len, &arena) != 0 || doc.toks[0].type != JSON_OBJECT)
+        error = "invalid JSON";
+    else if (string_field(&doc, "id", &arena, &f[F_ID]) != 0 || f[F_ID].len == 0)
+        error = "id must be a non-empty string";
+    else if (!apps_valid_id(f[F_ID].ptr))
+        error = "id must be 1-255 characters of [A-Za-z0-9:_.-]";
+    else if (string_field(&doc, "name", &arena, &f[F_NAME]) != 0 || f[F_NAME].len == 0)
+        error = "name must be a non-empty string";
+    else if (string_field(&doc, "icon", &arena, &f[F_ICON]) != 0)
+        error = "icon must be a string";
+    else if (string_field(&doc, "defaultComponent", &arena, &f[F_DEFAULT]) != 0)
+        error = "defaultComponent must be a string";
+    else if (json_object_get(&doc, 0, "port") >= 0 && json_get_int(&doc, 0, "port", &port) != 0)
+        error = "port must be an integer";
+    else if (json_object_get(&doc, 0, "idleTimeout") >= 0 &&
+             (json_get_int(&doc, 0, "idleTimeout", &idle) != 0 || idle < 0 || idle > INT_MAX))
+        error = "idleTimeout must be a non-negative integer";
+    else if (array_field(&doc, "components", &f[F_COMPONENTS]) != 0)
+        error = "components must be an array";
+    else if (array_field(&doc, "api", &f[F_API]) != 0)
+        error = "api must be an array";
+    else if (array_field(&doc, "after", &f[F_AFTER]) != 0)
+        error = "after must be an array";
+    else if (string_field(&doc, "health", &arena, &f[F_HEALTH]) != 0 ||
+             (f[F_HEALTH].len && f[F_HEALTH].ptr[0] != '/') || strpbrk(f[F_HEALTH].ptr, " \r\n"))
+        error = "health must be a path starting with '/'";
+
+    if (!error) {
+        f[F_PKG].ptr = pkg;
+        f[F_PKG].len = strlen(pkg);
+        app = app_new(f, (int)port, (int)idle);
+        if (!app) error = "out of memory";
+    }
+
+    if (error) {
+        fprintf(stderr, "%s: %s, skipping\n", path, error);
+        metrics_inc(&m_errors);
+    }
+
+    arena_free(&arena);
+    free(buf);
+    return app;
+}
+
+int apps_valid_id(const char *id)
+{
+    size_t n = strspn(id, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789:_.-");
+    return n > 0 && n < MAX_STR && id[n] == '\0';
+}
+
+void apps_set_dir(const char *dir)
+{
+    snprintf(apps_dir, sizeof(apps_dir), "%s", dir);
+}
+
+/* ── Snapshots ────────────────────────────────────────────────────────────── */
+
+static uint64_t id_hash(const char *s)
+{
+    uint64_t h = FNV_OFFSET;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static void snapshot_free(apps_snapshot_t *snap)
+{
+    for (int i = 0; i < snap->count; i++) app_release(snap->apps[i]);
+    free(snap->apps);
+    free(snap->index);
+    free(snap);
+}
+
+/* Snapshot over apps (array and references taken over, already sorted), with one reference */
+static apps_snapshot_t *snapshot_new(app_t **apps, int count)
+{
+    apps_snapshot_t *snap = calloc(1, sizeof(*snap));
+    size_t slots = 8;
+    while (slots < (size_t)count * 2) slots <<= 1;
+
+    int *index = calloc(slots, sizeof(int));
+    if (!snap || !index) {
+        free(snap);
+        free(index);
+        for (int i = 0; i < count; i++) app_release(apps[i]);
+        free(apps);
+        return NULL;
+    }
+
+    snap->refs  = 1;
+    snap->count = count;
+    snap->apps  = apps;
+    snap->index = index;
+    snap->mask  = slots - 1;
+
+    /* Linear probing; on a duplicate id the first package wins */
+    for (int i = 0; i < count; i++) {
+        size_t h = id_hash(apps[i]->id) & snap->mask;
+        while (index[h] && strcmp(apps[index[h] - 1]->id, apps[i]->id) != 0)
+            h = (h + 1) & snap->mask;
+        if (index[h]) {
+            fprintf(stderr, "%s: app id %s already provided by %s\n",
+                    apps[i]->pkg, apps[i]->id, apps[index[h] - 1]->pkg);
+            continue;
+        }
+        index[h] = i + 1;
+    }
+    return snap;
+}
+
+/* Apps in snap (by id, as apps_find() resolves it) that other lacks */
+static void announce(const apps_snapshot_t *snap, const apps_snapshot_t *other,
+                     event_type_t type)
+{
+    for (int i = 0; i < snap->count; i++) {
+        const app_t *app = snap->apps[i];
+        if (apps_find(snap, app->id) == app && !apps_find(other, app->id))
+            events_publish(type, app->id);
+    }
+}
+
+static void publish(apps_snapshot_t *snap)
+{
+    pthread_mutex_lock(&lock);
+    apps_snapshot_t *old = current;
+    snap->version = old ? old->version + 1 : 1;
+    current = snap;
+    pthread_mutex_unlock(&lock);
+
+    /* Nothing to announce for the startup scan */
+    if (old) {
+        announce(old, snap, EV_REMOVED);
+        announce(snap, old, EV_INSTALLED);
+        apps_release(old);
+    }
+}
+
+const apps_snapshot_t *apps_acquire(void)
+{
+    pthread_mutex_lock(&lock);
+    apps_snapshot_t *snap = current;
+    __atomic_add_fetch(&snap->refs, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lock);
+    return snap;
+}
+
+void apps_release(const apps_snapshot_t *snap)
+{
+    apps_snapshot_t *s = (apps_snapshot_t *)snap;
+    if (__atomic_sub_fetch(&s->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        snapshot_free(s);
+}
+
+unsigned apps_current_version(void)
+{
+    pthread_mutex_lock(&lock);
+    unsigned version = current->version;
+    pthread_mutex_unlock(&lock);
+    return version;
+}
+
+const app_t *apps_find(const apps_snapshot_t *snap, const char *id)
+{
+    size_t h = id_hash(id) & snap->mask;
+    while (snap->index[h]) {
+        const app_t *app = snap->apps[snap->index[h] - 1];
+        if (strcmp(app->id, id) == 0) return app;
+        h = (h + 1) & snap->mask;
+    }
+    return NULL;
+}
+
+/* ── Loading ──────────────────────────────────────────────────────────────── */
+
+/* Record for <dir>/<pkg>/crimata.json, or NULL if it holds no valid manifest */
+static app_t *load_pkg(const char *pkg)
+{
+    char path[4096 + 2 * MAX_STR];
+    snprintf(path, sizeof(path), "%s/%s/" MANIFEST_NAME, apps_dir, pkg);
+    return parse_manifest(path, pkg);
+}
+
+static void watch_pkg(const char *pkg)
+{
+    if (ifd < 0) return;
+
+    char path[4096 + MAX_STR];
+    snprintf(path, sizeof(path), "%s/%s", apps_dir, pkg);
+    int wd = inotify_add_watch(ifd, path, PKG_EVENTS | IN_ONLYDIR);
+    if (wd < 0) return;
+
+    /* The same directory gets the same wd back */
+    for (size_t i = 0; i < npkg_watches; i++)
+        if (pkg_watches[i].wd == wd) return;
+
+    if (npkg_watches == pkg_watches_cap) {
+        size_t cap = pkg_watches_cap ? pkg_watches_cap * 2 : 32;
+        pkg_watch_t *p = realloc(pkg_watches, cap * sizeof(*p));
+        if (!p) { inotify_rm_watch(ifd, wd); return; }
+        pkg_watches     = p;
+        pkg_watches_cap = cap;
+    }
+    pkg_watches[npkg_watches].wd = wd;
+    snprintf(pkg_watches[npkg_watches].pkg, MAX_STR, "%s", pkg);
+    npkg_watches++;
+}
+
+static void unwatch_pkg(size_t i)
+{
+    pkg_watches[i] = pkg_watches[--npkg_watches];
+}
+
+/* Glob every package and replace the whole registry */
+static int load_all(void)
+{
+    uint64_t start = metrics_now();
+    char     pattern[4096 + 32];
+    glob_t   g;
+    int      count = 0, cap = 0;
+    app_t  **apps  = NULL;
+
+    snprintf(pattern, sizeof(pattern), "%s/" PKG_PREFIX "*/" MANIFEST_NAME, apps_dir);
+    if (glob(pattern, 0, NULL, &g) == 0) {
+        for (size_t i = 0; i < g.gl_pathc; i++) {
+            /* <dir>/<pkg>/crimata.json → <pkg> */
+            char *path = g.gl_pathv[i];
+            char *end  = strrchr(path, '/');
+            *end = '\0';
+            const char *pkg = strrchr(path, '/') + 1;
+
+            watch_pkg(pkg);
+
+            /* glob sorts, so apps come out in package order */
+            app_t *app = load_pkg(pkg);
+            if (!app) continue;
+            if (count == cap) {
+                int     ncap = cap ? cap * 2 : 32;
+                app_t **p    = realloc(apps, (size_t)ncap * sizeof(*apps));
+                if (!p) {
+                    app_release(app);
+                    continue;
+                }
+                apps = p;
+                cap  = ncap;
             }
+            apps[count++] = app;
         }
-        pos++;
+        globfree(&g);
     }
 
-    out[i] = '\0';
-    return (depth == 0 && i > 0) ? 1 : 0;
+    apps_snapshot_t *snap = snapshot_new(apps, count);
+    if (!snap) return -1;
+    publish(snap);
+
+    metrics_observe(&m_scan, metrics_now() - start);
+    return 0;
 }
 
-static int parse_manifest(const char *path, app_t *app)
+/* Re-read one package and publish a snapshot with it added, replaced or gone */
+static void reload_pkg(const char *pkg)
 {
-    FILE *f = fopen(path, "r");
-    if (!f) return 0;
+    app_t *fresh = load_pkg(pkg);
 
-    char buf[MAX_FILE_SIZE];
-    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
-    fclose(f);
-    buf[n] = '\0';
+    const apps_snapshot_t *old = apps_acquire();
+    app_t **apps  = malloc(((size_t)old->count + 1) * sizeof(*apps));
+    int     count = 0, placed = 0;
+
+    if (!apps) {
+        apps_release(old);
+        if (fresh) app_release(fresh);
+        return;
+    }
 
-    if (!json_str(buf, "id",   app->id,   sizeof(app->id)))   return 0;
-    if (!json_str(buf, "name", app->name, sizeof(app->name))) return 0;
+    /* Copy everything else, slotting the package into its sorted place */
+    int had = 0;
+    for (int i = 0; i < old->count; i++) {
+        int cmp = strcmp(old->apps[i]->pkg, pkg);
+        if (cmp == 0) { had = 1; continue; }
+        if (cmp > 0 && fresh && !placed) {
+            apps[count++] = fresh;
+            placed = 1;
+        }
+        apps[count++] = old->apps[i];
+    }
+    if (fresh && !placed) apps[count++] = fresh;
 
-    json_str(buf, "icon",             app->icon,             sizeof(app->icon));
-    json_str(buf, "defaultComponent", app->default_component, sizeof(app->default_component));
-    json_int(buf, "port", &app->port);
-    json_raw_value(buf, "components", app->components_json, sizeof(app->components_json));
-    json_raw_value(buf, "api",        app->api_json,        sizeof(app->api_json));
+    /* e.g. a package directory created before its manifest */
+    if (!fresh && !had) {
+        apps_release(old);
+        free(apps);
+        return;
+    }
 
-    app->running = 0;
-    return 1;
+    /* The new snapshot shares every record it kept */
+    for (int i = 0; i < count; i++)
+        if (apps[i] != fresh) __atomic_add_fetch(&apps[i]->refs, 1, __ATOMIC_RELAXED);
+    apps_release(old);
+
+    apps_snapshot_t *snap = snapshot_new(apps, count);
+    if (!snap) return;
+    publish(snap);
+    metrics_inc(&m_reload);
 }
 
-int apps_scan(app_t *apps)
+/* ── inotify ──────────────────────────────────────────────────────────────── */
+
+static void on_inotify(int fd, uint32_t events, void *arg)
 {
-    glob_t g;
-    int count = 0;
+    (void)events; (void)arg;
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) return;   /* EAGAIN: drained */
+
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
 
-    if (glob(MANIFEST_GLOB, 0, NULL, &g) != 0)
-        return 0;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                fprintf(stderr, "inotify queue overflowed, rescanning %s\n", apps_dir);
+                load_all();
+                continue;
+            }
+
+            /* A package directory appeared or went away */
+            if (ev->wd == dir_wd) {
+                if (!(ev->mask & IN_ISDIR) ||
+                    strncmp(ev->name, PKG_PREFIX, strlen(PKG_PREFIX)) != 0)
+                    continue;
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO)) watch_pkg(ev->name);
+                reload_pkg(ev->name);
+                continue;
+            }
 
-    for (size_t i = 0; i < g.gl_pathc && count < MAX_APPS; i++) {
-        if (parse_manifest(g.gl_pathv[i], &apps[count]))
-            count++;
+            for (size_t i = 0; i < npkg_watches; i++) {
+                if (pkg_watches[i].wd != ev->wd) continue;
+                if (ev->mask & IN_IGNORED) {
+                    unwatch_pkg(i);   /* directory deleted or moved out */
+                } else if (ev->len && strcmp(ev->name, MANIFEST_NAME) == 0) {
+                    reload_pkg(pkg_watches[i].pkg);
+                }
+                break;
+            }
+        }
+    }
+}
+
+int apps_init(void)
+{
+    metrics_register(&m_scan);
+    metrics_register(&m_reload);
+    metrics_register(&m_errors);
+
+    ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ifd >= 0) {
+        dir_wd = inotify_add_watch(ifd, apps_dir, DIR_EVENTS);
+        if (dir_wd < 0 || loop_add(ifd, EPOLLIN, on_inotify, NULL) != 0) {
+            perror(apps_dir);
+            close(ifd);
+            ifd = -1;
+        }
     }
+    if (ifd < 0)
+        fprintf(stderr, "not watching %s — new apps need a restart\n", apps_dir);
 
-    globfree(&g);
-    return count;
+    return load_all();
 }
@@ -1,21 +1,73 @@
 #ifndef APPS_H
 #define APPS_H
 
-#define MAX_APPS  32
-#define MAX_STR   256
+#include <stddef.h>
 
+#define MAX_STR   256   /* longest app id, with its NUL — it becomes a unit name */
+
+/*
+ * One installed app, sized to its manifest: the struct and every string it
+ * points at are a single allocation. Records are immutable and shared by
+ * every snapshot that contains them, so a reload copies only pointers.
+ * Optional fields are "" when the manifest leaves them out.
+ */
 typedef struct {
-    char id[MAX_STR];
-    char name[MAX_STR];
-    char icon[MAX_STR];
-    int  port;
-    int  running;             /* populated at request time via systemd check */
-    char default_component[MAX_STR];
-    char components_json[2048]; /* raw JSON array, e.g. ["contacts.list","contacts.card"] */
-    char api_json[8192];        /* raw JSON array of ApiEndpoint objects */
+    unsigned    refs;
+    int         port;
+    int         idle_timeout;      /* "idleTimeout" seconds, 0 = always on, -1 = not set */
+    const char *pkg;               /* package directory it was loaded from, "crimata-<id>" */
+    const char *id;
+    const char *name;
+    const char *icon;
+    const char *default_component;
+    const char *components_json;   /* raw JSON array, e.g. ["contacts.list","contacts.card"] */
+    const char *api_json;          /* raw JSON array of ApiEndpoint objects */
+    const char *after_json;        /* raw JSON array of app ids to start before this one */
+    const char *health;            /* path answering 2xx once the app can serve, e.g. /health */
 } app_t;
 
-/* Scan /usr/lib/crimata-*/crimata.json — returns app count */
-int apps_scan(app_t *apps);
+/*
+ * Immutable view of the registry. Requests hold a reference while they
+ * read it; a manifest change publishes a new snapshot and the old one is
+ * freed when its last reader lets go.
+ */
+typedef struct {
+    unsigned refs;
+    unsigned version;         /* bumped on every change */
+    int      count;
+    app_t  **apps;            /* sorted by package directory */
+    int     *index;           /* by id hash: app index + 1, 0 = empty slot */
+    size_t   mask;
+} apps_snapshot_t;
+
+#define APPS_DIR_DEFAULT "/usr/lib"
+
+/* Look for <dir>/crimata-<id>/crimata.json instead of under APPS_DIR_DEFAULT */
+void apps_set_dir(const char *dir);
+
+/*
+ * Load every manifest and watch the directory with inotify (on the event
+ * loop — call after loop_init(), before loop_start()). Installs, upgrades
+ * and removals then update the registry one package at a time.
+ * Returns 0, or -1 if the registry could not be built.
+ */
+int  apps_init(void);
+
+/*
+ * 1 if id may appear in a unit name (crimata-<id>.service) as it is:
+ * 1 to 255 characters from [A-Za-z0-9:_.-]. Manifests with any other id
+ * are rejected, so every id in the registry passes.
+ */
+int  apps_valid_id(const char *id);
+
+/* Current snapshot, never NULL after apps_init() — pair with apps_release() */
+const apps_snapshot_t *apps_acquire(void);
+void apps_release(const apps_snapshot_t *snap);
+
+/* Version of the current snapshot, without taking a reference */
+unsigned apps_current_version(void);
+
+/* App with this id, or NULL */
+const app_t *apps_find(const apps_snapshot_t *snap, const char *id);
 
 #endif
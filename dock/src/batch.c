@@ -0,0 +1,385 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "batch.h"
+#include "httpd.h"
+#include "loop.h"
+#include "metrics.h"
+#include "systemd.h"
+
+#define MAX_JOBS 32   /* finished jobs are kept for status polls until reused */
+
+#define BATCH_SECONDS "crimata_dock_batch_seconds"
+static metric_t m_start = METRIC_HISTOGRAM_DEF(BATCH_SECONDS, "action=\"start\"", "Time for a bulk start/stop to finish every app");
+static metric_t m_stop  = METRIC_HISTOGRAM_DEF(BATCH_SECONDS, "action=\"stop\"",  "Time for a bulk start/stop to finish every app");
+
+typedef enum { JOB_FREE, JOB_RUNNING, JOB_DONE } job_state_t;
+typedef enum { APP_WAITING, APP_QUEUED, APP_DONE, APP_FAILED } app_state_t;
+
+struct job;
+
+typedef struct {
+    struct job *job;
+    const char *id;
+    app_state_t state;
+    const char *result;   /* systemd's job result, once finished */
+    int        *after;    /* indexes in the job of the apps it starts after */
+    size_t      nafter;
+} job_app_t;
+
+/* A request parked in batch_wait(), in its connection's arena */
+typedef struct waiter {
+    struct waiter         *next;
+    struct MHD_Connection *conn;
+    time_t                 deadline;
+} waiter_t;
+
+typedef struct job {
+    long        id;
+    job_state_t state;
+    int         start;
+    time_t      submitted;
+    uint64_t    began;      /* metrics_now() at submit */
+    size_t      n;
+    size_t      processed;
+    size_t      queued;     /* on the bus right now */
+    job_app_t  *apps;
+    arena_t     arena;      /* apps and their after lists */
+    waiter_t   *waiters;
+} job_t;
+
+static job_t           jobs[MAX_JOBS];
+static long            next_id = 1;
+static int             timer_fd = -1;
+static int             timer_armed;
+static int             closing;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Results systemd reports, so job_app_t can point at them after the message is gone */
+static const char *const results[] = {
+    "done", "canceled", "timeout", "failed", "dependency", "skipped", "invalid",
+};
+
+static const char *result_name(const char *result)
+{
+    if (!result) return "bus error";
+    for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++)
+        if (strcmp(results[i], result) == 0) return results[i];
+    return "failed";
+}
+
+/* ── Ordering ─────────────────────────────────────────────────────────────── */
+
+/* App a has to finish before app b may be queued */
+static int precedes(const job_t *job, size_t a, size_t b)
+{
+    /* "after" orders starts; stops run the other way round */
+    size_t first  = job->start ? a : b;
+    size_t second = job->start ? b : a;
+    for (size_t i = 0; i < job->apps[second].nafter; i++)
+        if ((size_t)job->apps[second].after[i] == first) return 1;
+    return 0;
+}
+
+/* Indexes of the job's apps that app lists under "after" — others are ignored */
+static void load_after(job_t *job, size_t idx, const char *after_json)
+{
+    json_doc_t doc;
+    size_t     len = strlen(after_json);
+    job_app_t *app = &job->apps[idx];
+
+    if (len == 0 || json_parse_arena(&doc, after_json, len, &job->arena) != 0) return;
+
+    app->after = arena_alloc(&job->arena, doc.toks[0].size * sizeof(int) + 1);
+    if (!app->after) return;
+
+    for (unsigned t = 1; t < doc.count; t = doc.toks[t].next) {
+        if (doc.toks[t].type != JSON_STRING) continue;
+        char *id = json_string_dup(&doc, (int)t, &job->arena);
+        for (size_t i = 0; id && i < job->n; i++) {
+            if (i != idx && strcmp(job->apps[i].id, id) == 0) {
+                app->after[app->nafter++] = (int)i;
+                break;
+            }
+        }
+    }
+}
+
+/* ── Progress ─────────────────────────────────────────────────────────────── */
+
+static void app_finished(job_app_t *app, const char *result)
+{
+    app->result = result_name(result);
+    app->state  = strcmp(app->result, "done") == 0 ? APP_DONE : APP_FAILED;
+    app->job->processed++;
+}
+
+static void on_job_done(void *arg, const char *result);
+
+/* Queue every app whose predecessors are through; finish the job when all are — lock held */
+static void advance(job_t *job)
+{
+    for (int progress = 1; progress; ) {
+        progress = 0;
+        for (size_t i = 0; i < job->n; i++) {
+            job_app_t *app = &job->apps[i];
+            if (app->state != APP_WAITING) continue;
+
+            int blocked = 0, failed = 0;
+            for (size_t j = 0; j < job->n; j++) {
+                if (j == i || !precedes(job, j, i)) continue;
+                if (job->apps[j].state == APP_FAILED)      failed = 1;
+                else if (job->apps[j].state != APP_DONE)   blocked = 1;
+            }
+            if (blocked) continue;
+
+            progress = 1;
+            if (failed) {
+                app_finished(app, "dependency");
+                continue;
+            }
+
+            char unit[MAX_STR + 16];
+            snprintf(unit, sizeof(unit), "crimata-%s.service", app->id);
+            app->state = APP_QUEUED;
+            job->queued++;
+            if (systemd_submit(job->start, unit, on_job_done, app) != 0) {
+                job->queued--;
+                app_finished(app, NULL);
+            }
+        }
+    }
+
+    /* Nothing on the bus but apps still waiting: their "after" lists loop */
+    if (job->queued == 0) {
+        for (size_t i = 0; i < job->n; i++)
+            if (job->apps[i].state == APP_WAITING) app_finished(&job->apps[i], "dependency");
+    }
+
+    if (job->processed < job->n || job->state == JOB_DONE) return;
+
+    job->state = JOB_DONE;
+    metrics_observe(job->start ? &m_start : &m_stop, metrics_now() - job->began);
+
+    for (waiter_t *w = job->waiters; w; w = w->next) MHD_resume_connection(w->conn);
+    job->waiters = NULL;
+}
+
+/* Loop thread: systemd has finished one app's job */
+static void on_job_done(void *arg, const char *result)
+{
+    job_app_t *app = arg;
+
+    pthread_mutex_lock(&lock);
+    app->job->queued--;
+    app_finished(app, result);
+    advance(app->job);
+    pthread_mutex_unlock(&lock);
+}
+
+/* ── Jobs ─────────────────────────────────────────────────────────────────── */
+
+/* Free slot, else the oldest finished job — caller holds lock */
+static job_t *job_slot(void)
+{
+    job_t *oldest = NULL;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (jobs[i].state == JOB_FREE) return &jobs[i];
+        if (jobs[i].state == JOB_DONE && (!oldest || jobs[i].id < oldest->id))
+            oldest = &jobs[i];
+    }
+    if (oldest) arena_free(&oldest->arena);
+    return oldest;
+}
+
+long batch_submit(int start, const app_t *const *apps, size_t n)
+{
+    pthread_mutex_lock(&lock);
+    job_t *job = job_slot();
+    if (!job) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    memset(job, 0, sizeof(*job));
+    arena_init(&job->arena, NULL, 0, 16384);
+    job->apps = arena_alloc(&job->arena, n * sizeof(job_app_t) + 1);
+    if (!job->apps) {
+        arena_free(&job->arena);
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    job->id        = next_id++;
+    job->state     = JOB_RUNNING;
+    job->start     = start;
+    job->submitted = time(NULL);
+    job->began     = metrics_now();
+    job->n         = n;
+    for (size_t i = 0; i < n; i++) {
+        memset(&job->apps[i], 0, sizeof(job_app_t));
+        job->apps[i].job = job;
+        job->apps[i].id  = arena_strndup(&job->arena, apps[i]->id, strlen(apps[i]->id));
+        if (!job->apps[i].id) {
+            job->state = JOB_FREE;
+            arena_free(&job->arena);
+            pthread_mutex_unlock(&lock);
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < n; i++) load_after(job, i, apps[i]->after_json);
+
+    long id = job->id;
+    advance(job);
+    pthread_mutex_unlock(&lock);
+    return id;
+}
+
+/* Caller holds lock */
+static job_t *job_find(long id)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+        if (jobs[i].state != JOB_FREE && jobs[i].id == id) return &jobs[i];
+    return NULL;
+}
+
+/*
+ * { id, action, state, total, processed, submitted,
+ *   completed: [id...], failed: [{ id, error }...] }
+ */
+int batch_status(long id, jw_t *w)
+{
+    pthread_mutex_lock(&lock);
+
+    job_t *job = job_find(id);
+    if (!job) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    jw_object_begin(w);
+    jw_key(w, "id");        jw_int(w, job->id);
+    jw_key(w, "action");    jw_string(w, job->start ? "start" : "stop");
+    jw_key(w, "state");     jw_string(w, job->state == JOB_DONE ? "done" : "running");
+    jw_key(w, "total");     jw_uint(w, job->n);
+    jw_key(w, "processed"); jw_uint(w, job->processed);
+    jw_key(w, "submitted"); jw_int(w, (long long)job->submitted);
+
+    jw_key(w, "completed");
+    jw_array_begin(w);
+    for (size_t i = 0; i < job->n; i++) {
+        if (job->apps[i].state == APP_DONE) jw_string(w, job->apps[i].id);
+    }
+    jw_array_end(w);
+
+    jw_key(w, "failed");
+    jw_array_begin(w);
+    for (size_t i = 0; i < job->n; i++) {
+        job_app_t *app = &job->apps[i];
+        if (app->state != APP_FAILED) continue;
+        jw_object_begin(w);
+        jw_key(w, "id");    jw_string(w, app->id);
+        jw_key(w, "error"); jw_string(w, app->result);
+        jw_object_end(w);
+    }
+    jw_array_end(w);
+
+    jw_object_end(w);
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+/* ── Waiting ──────────────────────────────────────────────────────────────── */
+
+int batch_wait(long id, struct MHD_Connection *conn, unsigned seconds)
+{
+    if (seconds == 0) return 0;
+    if (seconds > BATCH_MAX_WAIT) seconds = BATCH_MAX_WAIT;
+
+    waiter_t *w = arena_alloc(httpd_arena(conn), sizeof(*w));
+    if (!w) return 0;
+
+    pthread_mutex_lock(&lock);
+    job_t *job = job_find(id);
+    if (closing || !job || job->state == JOB_DONE) {
+        pthread_mutex_unlock(&lock);
+        return 0;
+    }
+
+    w->conn     = conn;
+    w->deadline = time(NULL) + seconds;
+    w->next     = job->waiters;
+    job->waiters = w;
+    MHD_suspend_connection(conn);
+
+    /* Deadlines are checked once a second while anyone waits */
+    if (!timer_armed) {
+        struct itimerspec its = { { 1, 0 }, { 1, 0 } };
+        timer_armed = timerfd_settime(timer_fd, 0, &its, NULL) == 0;
+    }
+    pthread_mutex_unlock(&lock);
+    return 1;
+}
+
+/* Resume waiters past their deadline, or all of them — caller holds lock */
+static int expire_waiters(time_t now, int all)
+{
+    int left = 0;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        waiter_t **pp = &jobs[i].waiters;
+        while (*pp) {
+            waiter_t *w = *pp;
+            if (all || w->deadline <= now) {
+                *pp = w->next;
+                MHD_resume_connection(w->conn);
+            } else {
+                pp = &w->next;
+                left++;
+            }
+        }
+    }
+    return left;
+}
+
+static void on_timer(int fd, uint32_t events, void *arg)
+{
+    (void)events; (void)arg;
+    uint64_t n;
+    if (read(fd, &n, sizeof(n)) != sizeof(n)) return;
+
+    pthread_mutex_lock(&lock);
+    if (expire_waiters(time(NULL), 0) == 0) {
+        struct itimerspec off = { { 0, 0 }, { 0, 0 } };
+        timerfd_settime(timer_fd, 0, &off, NULL);
+        timer_armed = 0;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void batch_close(void)
+{
+    pthread_mutex_lock(&lock);
+    closing = 1;
+    expire_waiters(0, 1);
+    pthread_mutex_unlock(&lock);
+}
+
+int batch_init(void)
+{
+    metrics_register(&m_start);
+    metrics_register(&m_stop);
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) return -1;
+    if (loop_add(timer_fd, EPOLLIN, on_timer, NULL) != 0) {
+        close(timer_fd);
+        timer_fd = -1;
+        return -1;
+    }
+    return 0;
+}
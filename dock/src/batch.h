@@ -0,0 +1,36 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <microhttpd.h>
+#include "apps.h"
+#include "json.h"
+
+#define BATCH_MAX_WAIT 60   /* seconds a status request may wait for a job */
+
+/* Register the wait timer on the event loop (before loop_start()) — 0 or -1 */
+int  batch_init(void);
+
+/*
+ * Start (start != 0) or stop apps[0..n) as one job. Every unit is queued on
+ * the bus at once, except that an app listing others under "after" in its
+ * manifest starts once those have, and stops before them, when they are in
+ * the same job. Returns the job id (> 0), or -1 if too many jobs are still
+ * unfinished.
+ */
+long batch_submit(int start, const app_t *const *apps, size_t n);
+
+/* Write the status of job id as a JSON object into w — 0, or -1 if unknown */
+int  batch_status(long id, jw_t *w);
+
+/*
+ * If job id is still running, suspend conn until it finishes or seconds
+ * pass and return 1; MHD then calls the handler again. Returns 0 if there
+ * is nothing to wait for. Needs MHD_ALLOW_SUSPEND_RESUME.
+ */
+int  batch_wait(long id, struct MHD_Connection *conn, unsigned seconds);
+
+/* Resume every waiting request, so a draining daemon isn't held up */
+void batch_close(void);
+
+#endif
@@ -0,0 +1,319 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/random.h>
+#include <sys/timerfd.h>
+#include "events.h"
+#include "json.h"
+#include "loop.h"
+#include "metrics.h"
+
+#define RING_SIZE  1024   /* events a reconnecting client can catch up on */
+#define BLOCK_SIZE 4096
+#define KEEPALIVE  25     /* seconds — below nginx's default proxy_read_timeout */
+
+/* Tells the client to re-read GET /apps: events were missed */
+#define RESYNC_FRAME "event: resync\ndata: {}\n\n"
+#define PING_FRAME   ": ping\n\n"
+
+static const char *const type_names[EV_COUNT] = {
+    [EV_INSTALLED] = "installed",
+    [EV_REMOVED]   = "removed",
+    [EV_STARTING]  = "starting",
+    [EV_ACTIVE]    = "active",
+    [EV_FAILED]    = "failed",
+    [EV_STOPPED]   = "stopped",
+};
+
+static metric_t m_published = METRIC_COUNTER_DEF("crimata_dock_events_published_total", NULL,
+                                                 "App lifecycle events sent to /apps/events");
+
+/* Preformatted SSE frames, the event with sequence number s in slot s % RING_SIZE */
+typedef struct {
+    char  *frame;
+    size_t len;
+} event_t;
+
+typedef enum { F_NONE, F_RESYNC, F_EVENT, F_PING } frame_kind_t;
+
+/* One open /apps/events stream, owned by its MHD response */
+typedef struct sub {
+    struct sub            *next, *prev;
+    struct MHD_Connection *conn;
+    unsigned long long     next_seq;   /* first event not yet sent */
+    frame_kind_t           cur;        /* frame partly written, if any */
+    size_t                 off;        /* bytes of it already written */
+    int                    resync;
+    int                    ping;
+    int                    suspended;
+} sub_t;
+
+static event_t             ring[RING_SIZE];
+static unsigned long long  head = 1;   /* sequence number of the next event */
+static unsigned long long  epoch;      /* random per run, so stale Last-Event-IDs are spotted */
+static sub_t              *subs;
+static unsigned            nsubs;
+static int                 closing;
+static pthread_mutex_t     lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ── Subscribers ──────────────────────────────────────────────────────────── */
+
+static unsigned long long oldest(void)
+{
+    return head > RING_SIZE ? head - RING_SIZE : 1;
+}
+
+/* Caller holds lock */
+static void wake_all(void)
+{
+    for (sub_t *s = subs; s; s = s->next) {
+        if (!s->suspended) continue;
+        s->suspended = 0;
+        MHD_resume_connection(s->conn);
+    }
+}
+
+/* Next frame for s, or F_NONE — caller holds lock */
+static frame_kind_t next_frame(sub_t *s, const char **frame, size_t *len)
+{
+    frame_kind_t kind = s->cur;
+
+    if (kind == F_NONE) {
+        if (s->resync)               kind = F_RESYNC;
+        else if (s->next_seq < head) kind = F_EVENT;
+        else if (s->ping)            kind = F_PING;
+    }
+
+    switch (kind) {
+    case F_RESYNC: *frame = RESYNC_FRAME; *len = sizeof(RESYNC_FRAME) - 1; break;
+    case F_PING:   *frame = PING_FRAME;   *len = sizeof(PING_FRAME) - 1;   break;
+    case F_EVENT:
+        *frame = ring[s->next_seq % RING_SIZE].frame;
+        *len   = ring[s->next_seq % RING_SIZE].len;
+        break;
+    case F_NONE: break;
+    }
+    return kind;
+}
+
+static ssize_t read_events(void *cls, uint64_t pos, char *buf, size_t max)
+{
+    (void)pos;
+    sub_t *s = cls;
+    size_t n = 0;
+
+    pthread_mutex_lock(&lock);
+
+    if (closing) {
+        pthread_mutex_unlock(&lock);
+        return MHD_CONTENT_READER_END_OF_STREAM;
+    }
+
+    if (s->next_seq < oldest()) {
+        /* Overwritten mid-frame: end the stream, the reconnect resyncs */
+        if (s->cur == F_EVENT) {
+            pthread_mutex_unlock(&lock);
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        }
+        s->resync   = 1;
+        s->next_seq = head;
+    }
+
+    while (n < max) {
+        const char  *frame;
+        size_t       len;
+        frame_kind_t kind = next_frame(s, &frame, &len);
+        if (kind == F_NONE) break;
+
+        size_t k = len - s->off < max - n ? len - s->off : max - n;
+        memcpy(buf + n, frame + s->off, k);
+        n      += k;
+        s->off += k;
+        if (s->off < len) {
+            s->cur = kind;
+            break;
+        }
+
+        s->cur = F_NONE;
+        s->off = 0;
+        switch (kind) {
+        case F_RESYNC: s->resync = 0; break;
+        case F_EVENT:  s->next_seq++; break;
+        case F_PING:   s->ping = 0;   break;
+        case F_NONE:   break;
+        }
+    }
+
+    /* Nothing to send: park the connection until events_publish() */
+    if (n == 0) {
+        s->suspended = 1;
+        MHD_suspend_connection(s->conn);
+    }
+
+    pthread_mutex_unlock(&lock);
+    return (ssize_t)n;
+}
+
+static void free_sub(void *cls)
+{
+    sub_t *s = cls;
+
+    pthread_mutex_lock(&lock);
+    if (s->prev) s->prev->next = s->next; else subs = s->next;
+    if (s->next) s->next->prev = s->prev;
+    nsubs--;
+    pthread_mutex_unlock(&lock);
+
+    free(s);
+}
+
+/* Where a Last-Event-ID of "<epoch>-<seq>" resumes — caller holds lock */
+static void resume_from(sub_t *s, const char *last_id)
+{
+    unsigned long long e, seq;
+
+    s->next_seq = head;
+    if (!last_id) return;
+
+    if (sscanf(last_id, "%llx-%llu", &e, &seq) == 2 && e == epoch &&
+        seq + 1 >= oldest() && seq < head)
+        s->next_seq = seq + 1;
+    else
+        s->resync = 1;
+}
+
+enum MHD_Result events_subscribe(struct MHD_Connection *conn)
+{
+    sub_t *s = calloc(1, sizeof(*s));
+    if (!s) return MHD_NO;
+    s->conn = conn;
+
+    const char *last_id = MHD_lookup_connection_value(conn, MHD_HEADER_KIND, "Last-Event-ID");
+
+    pthread_mutex_lock(&lock);
+    resume_from(s, last_id);
+    s->next = subs;
+    if (subs) subs->prev = s;
+    subs = s;
+    nsubs++;
+    pthread_mutex_unlock(&lock);
+
+    struct MHD_Response *resp = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, BLOCK_SIZE,
+                                                                  read_events, s, free_sub);
+    if (!resp) {
+        free_sub(s);
+        return MHD_NO;
+    }
+
+    MHD_add_response_header(resp, "Content-Type", "text/event-stream");
+    MHD_add_response_header(resp, "Cache-Control", "no-cache");
+    MHD_add_response_header(resp, "X-Accel-Buffering", "no");
+    MHD_add_response_header(resp, "Access-Control-Allow-Origin", "*");
+
+    enum MHD_Result ret = MHD_queue_response(conn, MHD_HTTP_OK, resp);
+    MHD_destroy_response(resp);
+    return ret;
+}
+
+/* ── Publishing ───────────────────────────────────────────────────────────── */
+
+void events_publish(event_type_t type, const char *id)
+{
+    arena_t arena;
+    jw_t    w;
+    arena_init(&arena, NULL, 0, 1024);
+    jw_init(&w, &arena, 0);
+
+    pthread_mutex_lock(&lock);
+    unsigned long long seq = head;
+
+    jw_object_begin(&w);
+    jw_key(&w, "seq");  jw_uint(&w, seq);
+    jw_key(&w, "type"); jw_string(&w, type_names[type]);
+    jw_key(&w, "id");   jw_string(&w, id);
+    jw_object_end(&w);
+
+    size_t      data_len;
+    const char *data = jw_finish(&w, &data_len);
+    char        head_buf[96];
+    int         head_len = snprintf(head_buf, sizeof(head_buf), "id: %016llx-%llu\nevent: %s\ndata: ",
+                                    epoch, seq, type_names[type]);
+    size_t      len   = (size_t)head_len + data_len + 2;
+    char       *frame = data ? malloc(len) : NULL;
+
+    if (frame) {
+        memcpy(frame, head_buf, (size_t)head_len);
+        memcpy(frame + head_len, data, data_len);
+        memcpy(frame + head_len + data_len, "\n\n", 2);
+        event_t *ev = &ring[seq % RING_SIZE];
+        free(ev->frame);
+        ev->frame = frame;
+        ev->len   = len;
+        head++;
+        wake_all();
+        metrics_inc(&m_published);
+    }
+    pthread_mutex_unlock(&lock);
+
+    arena_free(&arena);
+}
+
+void events_close(void)
+{
+    pthread_mutex_lock(&lock);
+    closing = 1;
+    wake_all();
+    pthread_mutex_unlock(&lock);
+}
+
+/* ── Keepalive ────────────────────────────────────────────────────────────── */
+
+/* Loop thread: ping every stream, which also notices clients that went away */
+static void on_keepalive(int fd, uint32_t events, void *arg)
+{
+    (void)events; (void)arg;
+    uint64_t n;
+    if (read(fd, &n, sizeof(n)) != sizeof(n)) return;
+
+    pthread_mutex_lock(&lock);
+    for (sub_t *s = subs; s; s = s->next) s->ping = 1;
+    wake_all();
+    pthread_mutex_unlock(&lock);
+}
+
+static double subscribers(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&lock);
+    unsigned n = nsubs;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+int events_init(void)
+{
+    /* Random rather than the start time, which a restart within a second reuses */
+    if (getrandom(&epoch, sizeof(epoch), 0) != sizeof(epoch)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        epoch = (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+    }
+
+    metrics_register(&m_published);
+    metrics_gauge("crimata_dock_event_subscribers", "Open /apps/events streams",
+                  subscribers, NULL);
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct itimerspec its = { { KEEPALIVE, 0 }, { KEEPALIVE, 0 } };
+    if (timerfd_settime(fd, 0, &its, NULL) != 0 || loop_add(fd, EPOLLIN, on_keepalive, NULL) != 0) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
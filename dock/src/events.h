@@ -0,0 +1,41 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <microhttpd.h>
+
+/*
+ * App lifecycle events, pushed to GET /apps/events subscribers as
+ * server-sent events. Each subscriber's connection stays suspended in MHD
+ * while it has nothing to send, so idle subscribers hold no thread.
+ */
+typedef enum {
+    EV_INSTALLED,
+    EV_REMOVED,
+    EV_STARTING,
+    EV_ACTIVE,
+    EV_FAILED,
+    EV_STOPPED,
+    EV_COUNT
+} event_type_t;
+
+/*
+ * Register the keepalive timer on the event loop (after loop_init(), before
+ * loop_start()) and the subscriber metrics. Returns 0 or -1.
+ */
+int  events_init(void);
+
+/* Append an event for app id and wake every subscriber — any thread */
+void events_publish(event_type_t type, const char *id);
+
+/*
+ * Answer GET /apps/events with an endless text/event-stream. A
+ * Last-Event-ID from this process resumes after that event; one that is
+ * too old or from an earlier run gets a "resync" event instead, after
+ * which the client should re-read GET /apps. Needs MHD_ALLOW_SUSPEND_RESUME.
+ */
+enum MHD_Result events_subscribe(struct MHD_Connection *conn);
+
+/* End every stream, so a draining daemon isn't held up by subscribers */
+void events_close(void);
+
+#endif
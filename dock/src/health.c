@@ -0,0 +1,414 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include "apps.h"
+#include "health.h"
+#include "httpd.h"
+#include "loop.h"
+#include "metrics.h"
+#include "ondemand.h"
+#include "systemd.h"
+
+#define TICK_MS  250    /* how often due probes, timeouts and waiters are checked */
+#define RETRY_MS 1000   /* probe interval while an app isn't ready */
+#define SAMPLES  8      /* successful probes in the rolling latency */
+#define STATUS   12     /* "HTTP/1.1 200" */
+
+#define REQUEST "GET %s HTTP/1.1\r\nHost: 127.0.0.1:%d\r\n" \
+                "User-Agent: crimata-dock\r\nConnection: close\r\n\r\n"
+
+static metric_t m_probe = METRIC_HISTOGRAM_DEF("crimata_dock_health_probe_seconds", NULL,
+                                               "Health probe: connect to the status line of the answer");
+static metric_t m_fail  = METRIC_COUNTER_DEF("crimata_dock_health_probe_failures_total", NULL,
+                                             "Health probes refused, timed out or answered with a non-2xx status");
+
+/* An app with a health path. Changed on the loop thread, read by request threads */
+typedef struct {
+    char     id[MAX_STR];
+    char    *path;
+    int      port;
+    int      running;
+    int      ready;
+    int      probing;
+    uint64_t next_probe;         /* metrics_now() */
+    unsigned samples[SAMPLES];   /* µs */
+    int      nsamples, pos;
+    unsigned mean_us;
+} target_t;
+
+/* One probe in flight, on probe_ep — loop thread only */
+typedef struct probe {
+    struct probe *next;
+    int           fd;
+    unsigned      local_port;
+    uint64_t      start;
+    size_t        sent, len;
+    size_t        got;
+    char          status[STATUS];
+    char          id[MAX_STR];
+    char          req[];
+} probe_t;
+
+typedef struct waiter {
+    struct waiter         *next;
+    struct MHD_Connection *conn;
+    const char            *id;
+    uint64_t               deadline;
+} waiter_t;
+
+static target_t *targets;
+static int       ntargets;
+static unsigned  synced_version;
+static int       synced;
+static probe_t  *probes;
+static waiter_t *waiters;
+static int       closing;
+static unsigned  generation;
+static unsigned  interval_ms = PROBE_INTERVAL_DEFAULT;
+static int       probe_ep = -1, tick_fd = -1;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+void health_set_interval(unsigned ms)
+{
+    interval_ms = ms ? ms : 1;
+}
+
+unsigned health_generation(void)
+{
+    return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}
+
+static void bump(void)
+{
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+}
+
+/* Caller holds lock */
+static target_t *find(const char *id)
+{
+    for (int i = 0; i < ntargets; i++)
+        if (strcmp(targets[i].id, id) == 0) return &targets[i];
+    return NULL;
+}
+
+/* Caller holds lock */
+static int is_ready(const char *id)
+{
+    const target_t *t = find(id);
+    if (t) return t->running && t->ready;
+
+    char unit[MAX_STR + 16];
+    snprintf(unit, sizeof(unit), "crimata-%s.service", id);
+    return systemd_is_active(unit) == 1;
+}
+
+/* Resume waiters whose app is ready or whose time is up, or all of them — caller holds lock */
+static void resume_waiters(uint64_t now, int all)
+{
+    waiter_t **pp = &waiters;
+    while (*pp) {
+        waiter_t *w = *pp;
+        if (all || w->deadline <= now || is_ready(w->id)) {
+            *pp = w->next;
+            MHD_resume_connection(w->conn);
+        } else {
+            pp = &w->next;
+        }
+    }
+}
+
+/* Keep the targets in step with the registry — caller holds lock */
+static void sync_targets(void)
+{
+    const apps_snapshot_t *snap = apps_acquire();
+    target_t *next = calloc((size_t)snap->count + 1, sizeof(*next));
+    int       n    = 0;
+
+    for (int i = 0; next && i < snap->count; i++) {
+        const app_t *app = snap->apps[i];
+        if (!app->health[0] || app->port <= 0 || apps_find(snap, app->id) != app) continue;
+
+        char *path = strdup(app->health);
+        if (!path) continue;
+
+        target_t *t   = &next[n++];
+        target_t *old = find(app->id);
+        if (old) {
+            *t = *old;
+            free(old->path);
+            old->path = NULL;
+        } else {
+            snprintf(t->id, sizeof(t->id), "%s", app->id);
+        }
+        t->path = path;
+        if (t->port != app->port) {
+            t->port     = app->port;
+            t->nsamples = 0;
+            t->ready    = 0;
+        }
+    }
+
+    if (next) {
+        for (int i = 0; i < ntargets; i++) free(targets[i].path);
+        free(targets);
+        targets        = next;
+        ntargets       = n;
+        synced_version = snap->version;
+        synced         = 1;
+        bump();
+    }
+    apps_release(snap);
+}
+
+/* ── Probes ───────────────────────────────────────────────────────────────── */
+
+/* Record a probe's outcome and free it — caller holds lock, p is off the list */
+static void probe_finish(probe_t *p, int ok, uint64_t now)
+{
+    uint64_t  took = now - p->start;
+    target_t *t    = find(p->id);
+
+    if (p->fd >= 0) close(p->fd);
+    if (ok) metrics_observe(&m_probe, took);
+    else    metrics_inc(&m_fail);
+
+    if (t) {
+        int      was_ready = t->ready;
+        unsigned was_ms    = t->mean_us / 1000;
+
+        t->probing = 0;
+        t->ready   = ok;
+        if (ok) {
+            t->samples[t->pos] = took / 1000 > UINT32_MAX ? UINT32_MAX : (unsigned)(took / 1000);
+            t->pos = (t->pos + 1) % SAMPLES;
+            if (t->nsamples < SAMPLES) t->nsamples++;
+
+            uint64_t sum = 0;
+            for (int i = 0; i < t->nsamples; i++) sum += t->samples[i];
+            t->mean_us = (unsigned)(sum / (uint64_t)t->nsamples);
+        }
+        uint64_t wait_ms = ok || interval_ms < RETRY_MS ? interval_ms : RETRY_MS;
+        t->next_probe = now + wait_ms * 1000000;
+
+        if (t->ready != was_ready || t->mean_us / 1000 != was_ms) bump();
+    }
+    free(p);
+}
+
+/* Connect to t's port and queue the request — caller holds lock */
+static void probe_start(target_t *t, uint64_t now)
+{
+    int      req_len = snprintf(NULL, 0, REQUEST, t->path, t->port);
+    probe_t *p       = calloc(1, sizeof(*p) + (size_t)req_len + 1);
+    if (!p) return;
+    snprintf(p->req, (size_t)req_len + 1, REQUEST, t->path, t->port);
+    snprintf(p->id, sizeof(p->id), "%s", t->id);
+    p->len   = (size_t)req_len;
+    p->start = now;
+    p->fd    = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons((uint16_t)t->port),
+                              .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = p };
+    t->probing = 1;
+
+    if (p->fd < 0 ||
+        (connect(p->fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 && errno != EINPROGRESS) ||
+        epoll_ctl(probe_ep, EPOLL_CTL_ADD, p->fd, &ev) != 0) {
+        probe_finish(p, 0, now);
+        return;
+    }
+
+    struct sockaddr_in local;
+    socklen_t          len = sizeof(local);
+    if (getsockname(p->fd, (struct sockaddr *)&local, &len) == 0)
+        p->local_port = ntohs(local.sin_port);
+
+    p->next = probes;
+    probes  = p;
+}
+
+/* Advance p on a readiness event — 1 while it is still going, else 0 with *ok set */
+static int probe_step(probe_t *p, uint32_t events, int *ok)
+{
+    *ok = 0;
+
+    if (p->sent < p->len) {
+        int       err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(p->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err) return 0;
+
+        ssize_t n = send(p->fd, p->req + p->sent, p->len - p->sent, MSG_NOSIGNAL);
+        if (n < 0) return errno == EAGAIN;
+        p->sent += (size_t)n;
+        if (p->sent == p->len) {
+            struct epoll_event ev = { .events = EPOLLIN, .data.ptr = p };
+            if (epoll_ctl(probe_ep, EPOLL_CTL_MOD, p->fd, &ev) != 0) return 0;
+        }
+        return 1;
+    }
+
+    ssize_t n = recv(p->fd, p->status + p->got, STATUS - p->got, 0);
+    if (n < 0) return errno == EAGAIN && !(events & (EPOLLERR | EPOLLHUP));
+    if (n == 0) return 0;
+    p->got += (size_t)n;
+    if (p->got < STATUS) return 1;
+
+    /* "HTTP/1.x 2xx" */
+    *ok = memcmp(p->status, "HTTP/1.", 7) == 0 && p->status[8] == ' ' && p->status[9] == '2';
+    return 0;
+}
+
+/* Loop thread: probe sockets that are writable or readable */
+static void on_probes(int fd, uint32_t events, void *arg)
+{
+    (void)events; (void)arg;
+    struct epoll_event evs[32];
+    int n = epoll_wait(fd, evs, 32, 0);
+
+    pthread_mutex_lock(&lock);
+    uint64_t now = metrics_now();
+    for (int i = 0; i < n; i++) {
+        probe_t *p = evs[i].data.ptr;
+        int      ok;
+        if (probe_step(p, evs[i].events, &ok)) continue;
+
+        for (probe_t **pp = &probes; *pp; pp = &(*pp)->next) {
+            if (*pp == p) {
+                *pp = p->next;
+                break;
+            }
+        }
+        probe_finish(p, ok, now);
+    }
+    if (waiters) resume_waiters(now, 0);
+    pthread_mutex_unlock(&lock);
+}
+
+/* Loop thread, every TICK_MS: start due probes, fail late ones, release waiters */
+static void on_tick(int fd, uint32_t events, void *arg)
+{
+    (void)events; (void)arg;
+    uint64_t n;
+    if (read(fd, &n, sizeof(n)) != sizeof(n)) return;
+
+    pthread_mutex_lock(&lock);
+    if (!synced || apps_current_version() != synced_version) sync_targets();
+
+    uint64_t now = metrics_now();
+    for (int i = 0; i < ntargets; i++) {
+        target_t *t = &targets[i];
+        char unit[MAX_STR + 16];
+        snprintf(unit, sizeof(unit), "crimata-%s.service", t->id);
+
+        if (systemd_is_active(unit) != 1) {
+            if (t->ready) bump();
+            t->running = t->ready = 0;
+            continue;
+        }
+        if (!t->running) {   /* just started: probe now */
+            t->running    = 1;
+            t->next_probe = now;
+        }
+
+        /* A connection to an app being stopped for idleness would start it again */
+        ondemand_info_t od;
+        if (ondemand_info(t->id, &od) == 0 && od.stopping) continue;
+
+        if (!t->probing && now >= t->next_probe) probe_start(t, now);
+    }
+
+    probe_t **pp = &probes;
+    while (*pp) {
+        probe_t *p = *pp;
+        if (now - p->start >= (uint64_t)PROBE_TIMEOUT * 1000000000) {
+            *pp = p->next;
+            probe_finish(p, 0, now);
+        } else {
+            pp = &p->next;
+        }
+    }
+
+    if (waiters) resume_waiters(now, 0);
+    pthread_mutex_unlock(&lock);
+}
+
+int health_init(void)
+{
+    metrics_register(&m_probe);
+    metrics_register(&m_fail);
+
+    probe_ep = epoll_create1(EPOLL_CLOEXEC);
+    tick_fd  = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (probe_ep < 0 || tick_fd < 0) return -1;
+
+    struct itimerspec its = { { 0, TICK_MS * 1000000L }, { 0, TICK_MS * 1000000L } };
+    if (timerfd_settime(tick_fd, 0, &its, NULL) != 0 ||
+        loop_add(tick_fd, EPOLLIN, on_tick, NULL) != 0 ||
+        loop_add(probe_ep, EPOLLIN, on_probes, NULL) != 0)
+        return -1;
+
+    pthread_mutex_lock(&lock);
+    sync_targets();
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+/* ── Queries ──────────────────────────────────────────────────────────────── */
+
+int health_ready(const char *id, int running, unsigned *probe_us)
+{
+    pthread_mutex_lock(&lock);
+    const target_t *t = find(id);
+    int ready = t ? running && t->running && t->ready : running;
+    *probe_us = t && t->nsamples ? t->mean_us : 0;
+    pthread_mutex_unlock(&lock);
+    return ready;
+}
+
+/* Loop thread only, like the probe list */
+int health_is_probe(unsigned port)
+{
+    for (const probe_t *p = probes; p; p = p->next)
+        if (p->local_port == port) return 1;
+    return 0;
+}
+
+int health_wait(const char *id, struct MHD_Connection *conn, unsigned seconds)
+{
+    if (seconds == 0) return 0;
+    if (seconds > HEALTH_MAX_WAIT) seconds = HEALTH_MAX_WAIT;
+
+    arena_t  *arena = httpd_arena(conn);
+    waiter_t *w     = arena_alloc(arena, sizeof(*w));
+    if (!w || !(w->id = arena_strndup(arena, id, strlen(id)))) return 0;
+
+    pthread_mutex_lock(&lock);
+    if (closing || is_ready(id)) {
+        pthread_mutex_unlock(&lock);
+        return 0;
+    }
+    w->conn     = conn;
+    w->deadline = metrics_now() + (uint64_t)seconds * 1000000000;
+    w->next     = waiters;
+    waiters     = w;
+    MHD_suspend_connection(conn);
+    pthread_mutex_unlock(&lock);
+    return 1;
+}
+
+void health_close(void)
+{
+    pthread_mutex_lock(&lock);
+    closing = 1;
+    resume_waiters(0, 1);
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,43 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <microhttpd.h>
+
+#define PROBE_INTERVAL_DEFAULT 5000   /* ms between probes of one app */
+#define PROBE_TIMEOUT          2      /* seconds before an unanswered probe fails */
+#define HEALTH_MAX_WAIT        60     /* seconds a start may wait for readiness */
+
+/* Probe each app every ms milliseconds instead of PROBE_INTERVAL_DEFAULT */
+void health_set_interval(unsigned ms);
+
+/*
+ * GET the "health" path from each running app's manifest on a schedule,
+ * with non-blocking connects from the event loop thread (after apps_init(),
+ * before loop_start()). Returns 0 or -1.
+ */
+int  health_init(void);
+
+/* Bumped whenever an app's readiness or its probe latency in whole ms changes */
+unsigned health_generation(void);
+
+/*
+ * Whether app id can serve: its last probe got a 2xx, or, without a health
+ * path, it is running. *probe_us gets the mean latency of its recent
+ * successful probes, 0 if there are none.
+ */
+int  health_ready(const char *id, int running, unsigned *probe_us);
+
+/* Whether local port belongs to an open probe, so probes don't count as traffic */
+int  health_is_probe(unsigned port);
+
+/*
+ * If app id isn't ready, suspend conn until it is or seconds pass and return
+ * 1; MHD then calls the handler again. Returns 0 if there is nothing to
+ * wait for. Needs MHD_ALLOW_SUSPEND_RESUME.
+ */
+int  health_wait(const char *id, struct MHD_Connection *conn, unsigned seconds);
+
+/* Resume every waiting request, so a draining daemon isn't held up */
+void health_close(void);
+
+#endif
@@ -0,0 +1,249 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "apps.h"
+#include "health.h"
+#include "json.h"
+#include "listing.h"
+#include "metrics.h"
+#include "response.h"
+#include "systemd.h"
+
+#define GZIP_MIN 1024   /* smaller bodies aren't worth a gzip variant */
+
+#define RESPONSES "crimata_dock_apps_responses_total"
+static metric_t m_full   = METRIC_COUNTER_DEF(RESPONSES, "body=\"full\"",         "GET /apps answers by variant");
+static metric_t m_gzip   = METRIC_COUNTER_DEF(RESPONSES, "body=\"gzip\"",         "GET /apps answers by variant");
+static metric_t m_304    = METRIC_COUNTER_DEF(RESPONSES, "body=\"not_modified\"", "GET /apps answers by variant");
+static metric_t m_builds = METRIC_COUNTER_DEF("crimata_dock_apps_body_builds_total", NULL,
+                                              "Times the /apps body was serialized");
+
+/*
+ * The prebuilt responses for one version of the list. Each body is owned by
+ * its response and freed by MHD once the last connection sending it is done,
+ * so a rebuild never pulls memory out from under a transfer.
+ */
+static struct {
+    int                  valid;
+    unsigned             apps_version;
+    unsigned             units_generation;
+    unsigned             health_generation;
+    char                 etag[24];      /* W/"<16 hex digits>" */
+    struct MHD_Response *full;
+    struct MHD_Response *gzip;          /* NULL below GZIP_MIN or if deflate failed */
+    struct MHD_Response *not_modified;
+} cache;
+
+static pthread_rwlock_t cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static char *serialize(size_t *len)
+{
+    const apps_snapshot_t *snap = apps_acquire();
+
+    arena_t arena;
+    jw_t    w;
+    arena_init(&arena, NULL, 0, 16384);
+    jw_init(&w, &arena, 0);
+    jw_array_begin(&w);
+
+    for (int i = 0; i < snap->count; i++) {
+        const app_t *app        = snap->apps[i];
+        const char  *components = app->components_json[0] ? app->components_json : "[]";
+        const char  *api        = app->api_json[0]        ? app->api_json        : "[]";
+
+        char unit[MAX_STR + 16];
+        snprintf(unit, sizeof(unit), "crimata-%s.service", app->id);
+        int      running = systemd_is_active(unit) == 1;
+        unsigned probe_us;
+        int      ready   = health_ready(app->id, running, &probe_us);
+
+        jw_object_begin(&w);
+        jw_key(&w, "id");               jw_string(&w, app->id);
+        jw_key(&w, "name");             jw_string(&w, app->name);
+        jw_key(&w, "icon");             jw_string(&w, app->icon);
+        jw_key(&w, "port");             jw_int(&w, app->port);
+        jw_key(&w, "running");          jw_bool(&w, running);
+        jw_key(&w, "ready");            jw_bool(&w, ready);
+        jw_key(&w, "probeMs");
+        if (probe_us) jw_double(&w, probe_us / 100 / 10.0); else jw_null(&w);
+        jw_key(&w, "defaultComponent"); jw_string(&w, app->default_component);
+        jw_key(&w, "components");       jw_raw(&w, components, strlen(components));
+        jw_key(&w, "api");              jw_raw(&w, api, strlen(api));
+        jw_object_end(&w);
+    }
+
+    jw_array_end(&w);
+    apps_release(snap);
+
+    const char *body = jw_finish(&w, len);
+    char       *copy = body ? malloc(*len ? *len : 1) : NULL;
+    if (copy) memcpy(copy, body, *len);
+    arena_free(&arena);
+    return copy;
+}
+
+/* gzip-framed deflate of body, or NULL */
+static char *compress_body(const char *body, size_t len, size_t *out_len)
+{
+    z_stream zs = {0};
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+
+    size_t cap = deflateBound(&zs, len);
+    char  *out = malloc(cap);
+    if (out) {
+        zs.next_in   = (Bytef *)body;
+        zs.avail_in  = (uInt)len;
+        zs.next_out  = (Bytef *)out;
+        zs.avail_out = (uInt)cap;
+        if (deflate(&zs, Z_FINISH) == Z_STREAM_END) {
+            *out_len = zs.total_out;
+        } else {
+            free(out);
+            out = NULL;
+        }
+    }
+    deflateEnd(&zs);
+    return out;
+}
+
+static struct MHD_Response *variant(char *body, size_t len, const char *encoding)
+{
+    struct MHD_Response *resp = body
+        ? MHD_create_response_from_buffer_with_free_callback(len, body, free)
+        : MHD_create_response_from_buffer(0, NULL, MHD_RESPMEM_PERSISTENT);
+    if (!resp) {
+        free(body);
+        return NULL;
+    }
+    if (body) MHD_add_response_header(resp, "Content-Type", "application/json");
+    if (encoding) MHD_add_response_header(resp, "Content-Encoding", encoding);
+    MHD_add_response_header(resp, "Access-Control-Allow-Origin", "*");
+    MHD_add_response_header(resp, "ETag", cache.etag);
+    MHD_add_response_header(resp, "Cache-Control", "no-cache");
+    MHD_add_response_header(resp, "Vary", "Accept-Encoding");
+    return resp;
+}
+
+static void drop(struct MHD_Response **resp)
+{
+    if (*resp) MHD_destroy_response(*resp);
+    *resp = NULL;
+}
+
+/* Caller holds the write lock. Returns 0, or -1 with the cache left invalid */
+static int rebuild(unsigned apps_version, unsigned units_generation, unsigned health_generation)
+{
+    size_t len;
+    char  *body = serialize(&len);
+    if (!body) return -1;
+    metrics_inc(&m_builds);
+
+    /*
+     * Content hash, so an unchanged list keeps its ETag even across restarts.
+     * Weak, because the gzip variant shares it.
+     */
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)body[i];
+        h *= 0x100000001b3ULL;
+    }
+    char etag[sizeof(cache.etag)];
+    snprintf(etag, sizeof(etag), "W/\"%016llx\"", (unsigned long long)h);
+
+    if (cache.valid && strcmp(etag, cache.etag) == 0) {
+        free(body);
+    } else {
+        drop(&cache.full);
+        drop(&cache.gzip);
+        drop(&cache.not_modified);
+        cache.valid = 0;
+        memcpy(cache.etag, etag, sizeof(etag));
+
+        size_t gz_len = 0;
+        char  *gz     = len >= GZIP_MIN ? compress_body(body, len, &gz_len) : NULL;
+
+        cache.full         = variant(body, len, NULL);
+        cache.gzip         = gz ? variant(gz, gz_len, "gzip") : NULL;
+        cache.not_modified = variant(NULL, 0, NULL);
+        if (!cache.full || !cache.not_modified) return -1;
+    }
+
+    cache.valid             = 1;
+    cache.apps_version      = apps_version;
+    cache.units_generation  = units_generation;
+    cache.health_generation = health_generation;
+    return 0;
+}
+
+/* Does If-None-Match name etag? Weak comparison, so W/ is optional */
+static int etag_matches(const char *header, const char *etag)
+{
+    if (!header) return 0;
+    if (strcmp(header, "*") == 0) return 1;
+    return strstr(header, etag + 2) != NULL;   /* the quoted part */
+}
+
+static int accepts_gzip(const char *header)
+{
+    if (!header) return 0;
+    const char *p = strstr(header, "gzip");
+    if (!p) return 0;
+
+    /* "gzip;q=0" turns it off */
+    for (p += 4; *p == ' '; p++) {}
+    if (*p != ';') return 1;
+    for (p++; *p == ' '; p++) {}
+    if (strncmp(p, "q=", 2) != 0) return 1;
+    return strtod(p + 2, NULL) > 0;
+}
+
+/* Caller holds the cache lock, so the response can't be destroyed under us */
+static enum MHD_Result send_cached(struct MHD_Connection *conn)
+{
+    const char *inm = MHD_lookup_connection_value(conn, MHD_HEADER_KIND, "If-None-Match");
+    const char *ae  = MHD_lookup_connection_value(conn, MHD_HEADER_KIND, "Accept-Encoding");
+
+    if (etag_matches(inm, cache.etag)) {
+        metrics_inc(&m_304);
+        return response_queue(conn, MHD_HTTP_NOT_MODIFIED, cache.not_modified);
+    }
+    if (cache.gzip && accepts_gzip(ae)) {
+        metrics_inc(&m_gzip);
+        return response_queue(conn, MHD_HTTP_OK, cache.gzip);
+    }
+    metrics_inc(&m_full);
+    return response_queue(conn, MHD_HTTP_OK, cache.full);
+}
+
+enum MHD_Result listing_send(struct MHD_Connection *conn)
+{
+    unsigned apps_version     = apps_current_version();
+    unsigned units_generation = systemd_generation();
+    unsigned health_gen       = health_generation();
+    enum MHD_Result ret;
+
+    pthread_rwlock_rdlock(&cache_lock);
+    if (cache.valid && cache.apps_version == apps_version &&
+        cache.units_generation == units_generation && cache.health_generation == health_gen) {
+        ret = send_cached(conn);
+        pthread_rwlock_unlock(&cache_lock);
+        return ret;
+    }
+    pthread_rwlock_unlock(&cache_lock);
+
+    /* Stale: the first thread in rebuilds, the rest find it done */
+    pthread_rwlock_wrlock(&cache_lock);
+    if (!(cache.valid && cache.apps_version == apps_version &&
+          cache.units_generation == units_generation && cache.health_generation == health_gen) &&
+        rebuild(apps_version, units_generation, health_gen) != 0) {
+        pthread_rwlock_unlock(&cache_lock);
+        static const char oom[] = "{\"error\":\"out of memory\"}";
+        return response_send(conn, MHD_HTTP_INTERNAL_SERVER_ERROR, oom, sizeof(oom) - 1);
+    }
+    ret = send_cached(conn);
+    pthread_rwlock_unlock(&cache_lock);
+    return ret;
+}
@@ -0,0 +1,14 @@
+#ifndef LISTING_H
+#define LISTING_H
+
+#include <microhttpd.h>
+
+/*
+ * GET /apps from a cache. The body is serialized (and gzipped, when large
+ * enough) only when the registry, a unit's state or an app's readiness has
+ * changed; between changes every request queues the same prebuilt response.
+ * Clients that send the ETag back in If-None-Match get a bodiless 304.
+ */
+enum MHD_Result listing_send(struct MHD_Connection *conn);
+
+#endif
@@ -0,0 +1,112 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include "loop.h"
+
+#define MAX_WATCHES  16
+#define MAX_PREPARES 4
+#define MAX_EVENTS   16
+
+typedef struct {
+    int     fd;
+    loop_fn fn;
+    void   *arg;
+} watch_t;
+
+typedef struct {
+    loop_prepare_fn fn;
+    void           *arg;
+} prepare_t;
+
+static int       epfd = -1;
+static watch_t   watches[MAX_WATCHES];
+static int       nwatches;
+static prepare_t prepares[MAX_PREPARES];
+static int       nprepares;
+
+int loop_init(void)
+{
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    return epfd < 0 ? -1 : 0;
+}
+
+int loop_add(int fd, uint32_t events, loop_fn fn, void *arg)
+{
+    /* Reuse a slot loop_del() freed before growing the table */
+    int i = 0;
+    while (i < nwatches && watches[i].fd >= 0) i++;
+    if (i == MAX_WATCHES) return -1;
+
+    watch_t *w = &watches[i];
+    *w = (watch_t){ fd, fn, arg };
+
+    struct epoll_event ev = { .events = events, .data.ptr = w };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        w->fd = -1;
+        return -1;
+    }
+    if (i == nwatches) nwatches++;
+    return 0;
+}
+
+int loop_mod(int fd, uint32_t events)
+{
+    for (int i = 0; i < nwatches; i++) {
+        if (watches[i].fd != fd) continue;
+        struct epoll_event ev = { .events = events, .data.ptr = &watches[i] };
+        return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    return -1;
+}
+
+int loop_del(int fd)
+{
+    for (int i = 0; i < nwatches; i++) {
+        if (watches[i].fd != fd) continue;
+        watches[i].fd = -1;
+        return epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    return -1;
+}
+
+int loop_add_prepare(loop_prepare_fn fn, void *arg)
+{
+    if (nprepares == MAX_PREPARES) return -1;
+    prepares[nprepares++] = (prepare_t){ fn, arg };
+    return 0;
+}
+
+static void *loop_main(void *arg)
+{
+    (void)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    for (;;) {
+        int timeout = -1;
+        for (int i = 0; i < nprepares; i++) {
+            int t = prepares[i].fn(prepares[i].arg);
+            if (t >= 0 && (timeout < 0 || t < timeout)) timeout = t;
+        }
+
+        int n = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return NULL;
+        }
+        for (int i = 0; i < n; i++) {
+            watch_t *w = events[i].data.ptr;
+            w->fn(w->fd, events[i].events, w->arg);
+        }
+    }
+}
+
+int loop_start(void)
+{
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, loop_main, NULL) != 0) return -1;
+    pthread_detach(tid);
+    return 0;
+}
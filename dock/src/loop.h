@@ -0,0 +1,35 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <stdint.h>
+
+/*
+ * The dock's background event loop: one thread on an epoll set, for work
+ * that has to follow the outside world (manifest changes, systemd state)
+ * rather than answer requests. Callbacks run on that thread, one at a time.
+ */
+
+typedef void (*loop_fn)(int fd, uint32_t events, void *arg);
+
+/* Runs before every wait; returns the most ms to sleep, or -1 for no limit */
+typedef int  (*loop_prepare_fn)(void *arg);
+
+/* Create the epoll set. Returns 0 or -1 */
+int  loop_init(void);
+
+/* Call fn whenever fd reports any of events (EPOLLIN etc.) — 0 or -1 */
+int  loop_add(int fd, uint32_t events, loop_fn fn, void *arg);
+
+/* Change the events fd is watched for — from the loop thread */
+int  loop_mod(int fd, uint32_t events);
+
+/* Stop watching fd, before closing it — from a prepare hook on the loop thread */
+int  loop_del(int fd);
+
+/* Register a hook for sources with their own timers, such as sd-bus */
+int  loop_add_prepare(loop_prepare_fn fn, void *arg);
+
+/* Start the loop thread; register everything above first. Returns 0 or -1 */
+int  loop_start(void);
+
+#endif
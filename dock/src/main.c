@@ -1,108 +1,402 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
+#include <stdint.h>
 #include <microhttpd.h>
+#include "httpd.h"
+#include "metrics.h"
+#include "response.h"
 #include "apps.h"
+#include "batch.h"
+#include "events.h"
+#include "health.h"
+#include "listing.h"
+#include "loop.h"
+#include "ondemand.h"
+#include "stats.h"
 #include "systemd.h"
 
 #define PORT     7701
-#define BUF_SIZE 65536
+#define MAX_BODY (64 * 1024)   /* POST /apps/start|stop: a list of app ids */
+
+enum { R_HEALTH, R_METRICS, R_LIST, R_EVENTS, R_STATS, R_APP_STATS, R_START, R_STOP,
+       R_BULK_START, R_BULK_STOP, R_JOBS, R_NOT_FOUND, R_COUNT };
+
+#define ROUTE(path) METRIC_HISTOGRAM_DEF("crimata_dock_http_request_duration_seconds", \
+                                         "route=\"" path "\"", "HTTP request latency by route")
+
+static metric_t route_metrics[R_COUNT] = {
+    [R_HEALTH]     = ROUTE("/health"),
+    [R_METRICS]    = ROUTE("/metrics"),
+    [R_LIST]       = ROUTE("/apps"),
+    [R_EVENTS]     = ROUTE("/apps/events"),
+    [R_STATS]      = ROUTE("/apps/stats"),
+    [R_APP_STATS]  = ROUTE("/apps/{id}/stats"),
+    [R_START]      = ROUTE("/apps/{id}/start"),
+    [R_STOP]       = ROUTE("/apps/{id}/stop"),
+    [R_BULK_START] = ROUTE("/apps/start"),
+    [R_BULK_STOP]  = ROUTE("/apps/stop"),
+    [R_JOBS]       = ROUTE("/apps/jobs/{id}"),
+    [R_NOT_FOUND]  = ROUTE("other"),
+};
+
+/* ── Responses ────────────────────────────────────────────────────────────── */
+
+/* Constant bodies, built once in main() and shared by every request */
+enum {
+    J_HEALTH, J_NOT_FOUND, J_NO_APP, J_SYSTEMD_FAILED, J_OK,
+    J_APPS_LIST, J_BATCH_BUSY, J_NO_SUCH_JOB, J_TOO_LARGE, J_OUT_OF_MEMORY,
+    J_COUNT
+};
+
+static const char *const json_bodies[J_COUNT] = {
+    [J_HEALTH]         = "{\"status\":\"ok\"}",
+    [J_NOT_FOUND]      = "{\"error\":\"not found\"}",
+    [J_NO_APP]         = "{\"error\":\"app not found\"}",
+    [J_SYSTEMD_FAILED] = "{\"error\":\"systemd call failed\"}",
+    [J_OK]             = "{\"ok\":true}",
+    [J_APPS_LIST]      = "{\"error\":\"apps must be an array of app ids or \\\"all\\\"\"}",
+    [J_BATCH_BUSY]     = "{\"error\":\"too many start/stop jobs in progress\"}",
+    [J_NO_SUCH_JOB]    = "{\"error\":\"job not found\"}",
+    [J_TOO_LARGE]      = "{\"error\":\"request body too large\"}",
+    [J_OUT_OF_MEMORY]  = "{\"error\":\"out of memory\"}",
+};
+
+static struct MHD_Response *json_static[J_COUNT];
+
+static enum MHD_Result send_static(struct MHD_Connection *conn, unsigned int status, int id)
+{
+    return response_queue(conn, status, json_static[id]);
+}
+
+static char parked;   /* *con_cls once a request has waited */
 
-/* ── JSON response helper ─────────────────────────────────────────────────── */
+/* ── POST /apps/{id}/start|stop ───────────────────────────────────────────── */
 
-static enum MHD_Result send_json(struct MHD_Connection *conn,
-                                  unsigned int status, const char *body)
+/*
+ * With ?wait=S (up to HEALTH_MAX_WAIT) a start holds the request until the
+ * app is ready — its health path answers — or S seconds pass, and reports
+ * which. Sets *waiting when the connection was parked instead of answered.
+ */
+static enum MHD_Result handle_action(struct MHD_Connection *conn, const char *app_id,
+                                      int start, void **con_cls, int *waiting)
 {
-    struct MHD_Response *resp = MHD_create_response_from_buffer(
-        strlen(body), (void *)body, MHD_RESPMEM_MUST_COPY);
-    MHD_add_response_header(resp, "Content-Type", "application/json");
-    MHD_add_response_header(resp, "Access-Control-Allow-Origin", "*");
-    enum MHD_Result r = MHD_queue_response(conn, status, resp);
-    MHD_destroy_response(resp);
-    return r;
+    char unit[MAX_STR + 16];
+    snprintf(unit, sizeof(unit), "crimata-%s.service", app_id);
+
+    const char *wait = start ? MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "wait") : NULL;
+
+    if (*con_cls != &parked) {
+        const apps_snapshot_t *snap = apps_acquire();
+        int found = apps_find(snap, app_id) != NULL;
+        apps_release(snap);
+
+        if (!found)
+            return send_static(conn, MHD_HTTP_NOT_FOUND, J_NO_APP);
+
+        int r = start ? systemd_start(unit) : systemd_stop(unit);
+
+        if (r < 0)
+            return send_static(conn, MHD_HTTP_INTERNAL_SERVER_ERROR, J_SYSTEMD_FAILED);
+        if (!wait)
+            return send_static(conn, MHD_HTTP_OK, J_OK);
+
+        *con_cls = &parked;
+        if (health_wait(app_id, conn, (unsigned)strtoul(wait, NULL, 10))) {
+            *waiting = 1;
+            return MHD_YES;
+        }
+    }
+
+    unsigned probe_us;
+    jw_t     w;
+    jw_init(&w, httpd_arena(conn), 0);
+    jw_object_begin(&w);
+    jw_key(&w, "ok");    jw_bool(&w, 1);
+    jw_key(&w, "ready"); jw_bool(&w, health_ready(app_id, systemd_is_active(unit) == 1, &probe_us));
+    jw_object_end(&w);
+    return response_send_jw(conn, MHD_HTTP_OK, &w);
 }
 
-/* ── GET /apps ────────────────────────────────────────────────────────────── */
+/* ── Request context ──────────────────────────────────────────────────────── */
 
-static enum MHD_Result handle_list(struct MHD_Connection *conn)
+/* Body of a POST /apps/start|stop, in the connection's arena */
+typedef struct {
+    char    *body;
+    size_t   body_len;
+    size_t   body_cap;
+    int      too_large;   /* body exceeded MAX_BODY — answered with 413 */
+    uint64_t start;       /* metrics_now() when the request arrived */
+} request_ctx_t;
+
+/* Returns -1 only on out-of-memory; past MAX_BODY the rest is dropped and flagged */
+static int body_append(struct MHD_Connection *conn, request_ctx_t *ctx,
+                       const char *data, size_t n)
 {
-    app_t apps[MAX_APPS];
-    int   count = apps_scan(apps);
-
-    /* Check running status for each app */
-    for (int i = 0; i < count; i++) {
-        char unit[MAX_STR + 16];
-        snprintf(unit, sizeof(unit), "crimata-%s.service", apps[i].id);
-        apps[i].running = (systemd_is_active(unit) == 1) ? 1 : 0;
-    }
-
-    /* Build JSON array */
-    char buf[BUF_SIZE];
-    int  pos = 0;
-    pos += snprintf(buf + pos, sizeof(buf) - pos, "[");
-
-    for (int i = 0; i < count; i++) {
-        const char *components = apps[i].components_json[0] ? apps[i].components_json : "[]";
-        const char *api        = apps[i].api_json[0]        ? apps[i].api_json        : "[]";
-
-        pos += snprintf(buf + pos, sizeof(buf) - pos,
-            "%s{"
-            "\"id\":\"%s\","
-            "\"name\":\"%s\","
-            "\"icon\":\"%s\","
-            "\"port\":%d,"
-            "\"running\":%s,"
-            "\"defaultComponent\":\"%s\","
-            "\"components\":%s,"
-            "\"api\":%s"
-            "}",
-            i > 0 ? "," : "",
-            apps[i].id,
-            apps[i].name,
-            apps[i].icon,
-            apps[i].port,
-            apps[i].running ? "true" : "false",
-            apps[i].default_component,
-            components,
-            api);
-    }
-
-    pos += snprintf(buf + pos, sizeof(buf) - pos, "]");
-
-    return send_json(conn, MHD_HTTP_OK, buf);
+    if (ctx->too_large || n > MAX_BODY - 1 - ctx->body_len) {
+        ctx->too_large = 1;
+        return 0;
+    }
+
+    if (ctx->body_len + n + 1 > ctx->body_cap) {
+        size_t cap = ctx->body_cap ? ctx->body_cap : 1024;
+        while (cap < ctx->body_len + n + 1) cap *= 2;
+        if (cap > MAX_BODY) cap = MAX_BODY;
+
+        char *p = arena_alloc(httpd_arena(conn), cap);
+        if (!p) return -1;
+        if (ctx->body_len) memcpy(p, ctx->body, ctx->body_len);
+        ctx->body     = p;
+        ctx->body_cap = cap;
+    }
+
+    memcpy(ctx->body + ctx->body_len, data, n);
+    ctx->body_len += n;
+    ctx->body[ctx->body_len] = '\0';
+    return 0;
 }
 
-/* ── POST /apps/{id}/start|stop ───────────────────────────────────────────── */
+/* ── POST /apps/start|stop ────────────────────────────────────────────────── */
 
-static enum MHD_Result handle_action(struct MHD_Connection *conn,
-                                      const char *app_id, int start)
+/*
+ * Apps named by the body, { "apps": [id...] } or { "apps": "all" }; no body
+ * means all. Returns the count, or -1 after queueing an error response.
+ */
+static int bulk_apps(struct MHD_Connection *conn, const request_ctx_t *ctx,
+                     const apps_snapshot_t *snap, arena_t *arena,
+                     const app_t ***out, enum MHD_Result *ret)
 {
-    app_t apps[MAX_APPS];
-    int   count = apps_scan(apps);
-    int   found = 0;
+    json_doc_t doc;
+    int        apps = -1;
+
+    if (ctx->body_len > 0) {
+        if (json_parse_arena(&doc, ctx->body, ctx->body_len, arena) == 0 &&
+            doc.toks[0].type == JSON_OBJECT)
+            apps = json_object_get(&doc, 0, "apps");
+        if (apps < 0 ||
+            (doc.toks[apps].type != JSON_ARRAY &&
+             !(doc.toks[apps].type == JSON_STRING && doc.toks[apps].len == 3 &&
+               memcmp(doc.src + doc.toks[apps].start, "all", 3) == 0))) {
+            *ret = send_static(conn, MHD_HTTP_BAD_REQUEST, J_APPS_LIST);
+            return -1;
+        }
+    }
 
-    for (int i = 0; i < count; i++) {
-        if (strcmp(apps[i].id, app_id) == 0) { found = 1; break; }
+    int listed = apps >= 0 && doc.toks[apps].type == JSON_ARRAY;
+    size_t cap = listed ? doc.toks[apps].size : (size_t)snap->count;
+    const app_t **list = arena_alloc(arena, cap * sizeof(*list) + 1);
+    if (!list) {
+        *ret = send_static(conn, MHD_HTTP_INTERNAL_SERVER_ERROR, J_OUT_OF_MEMORY);
+        return -1;
     }
 
-    if (!found)
-        return send_json(conn, MHD_HTTP_NOT_FOUND,
-                         "{\"error\":\"app not found\"}");
+    int n = 0;
+    if (!listed) {
+        /* Every app, once — apps_find() skips packages that lost a duplicate id */
+        for (int i = 0; i < snap->count; i++)
+            if (apps_find(snap, snap->apps[i]->id) == snap->apps[i]) list[n++] = snap->apps[i];
+        *out = list;
+        return n;
+    }
 
-    char unit[MAX_STR + 16];
-    snprintf(unit, sizeof(unit), "crimata-%s.service", app_id);
+    unsigned idx = (unsigned)apps + 1;
+    for (uint32_t i = 0; i < doc.toks[apps].size; i++, idx = doc.toks[idx].next) {
+        char        *id  = doc.toks[idx].type == JSON_STRING
+                         ? json_string_dup(&doc, (int)idx, arena) : NULL;
+        const app_t *app = id ? apps_find(snap, id) : NULL;
+        if (!app) {
+            *ret = send_static(conn, MHD_HTTP_NOT_FOUND, J_NO_APP);
+            return -1;
+        }
+
+        int dup = 0;
+        for (int j = 0; j < n && !dup; j++) dup = list[j] == app;
+        if (!dup) list[n++] = app;
+    }
+    *out = list;
+    return n;
+}
 
-    int r = start ? systemd_start(unit) : systemd_stop(unit);
+/*
+ * POST /apps/start|stop → 202 { jobId }. Every unit is queued on the bus at
+ * once; GET /apps/jobs/<id> reports when they have all got there.
+ */
+static enum MHD_Result handle_bulk(struct MHD_Connection *conn, const request_ctx_t *ctx,
+                                    int start)
+{
+    if (ctx->too_large)
+        return send_static(conn, MHD_HTTP_CONTENT_TOO_LARGE, J_TOO_LARGE);
+
+    const apps_snapshot_t *snap = apps_acquire();
+    const app_t          **list;
+    enum MHD_Result        ret;
+    arena_t                arena;
+    arena_init(&arena, NULL, 0, 16384);
+
+    int n = bulk_apps(conn, ctx, snap, &arena, &list, &ret);
+    if (n < 0) {
+        arena_free(&arena);
+        apps_release(snap);
+        return ret;
+    }
+
+    long id = batch_submit(start, list, (size_t)n);
+    arena_free(&arena);
+    apps_release(snap);
+
+    if (id < 0)
+        return send_static(conn, MHD_HTTP_SERVICE_UNAVAILABLE, J_BATCH_BUSY);
+
+    jw_t w;
+    jw_init(&w, httpd_arena(conn), 0);
+    jw_object_begin(&w);
+    jw_key(&w, "success"); jw_bool(&w, 1);
+    jw_key(&w, "jobId");   jw_int(&w, id);
+    jw_key(&w, "total");   jw_int(&w, n);
+    jw_object_end(&w);
+    return response_send_jw(conn, MHD_HTTP_ACCEPTED, &w);
+}
 
-    if (r < 0)
-        return send_json(conn, MHD_HTTP_INTERNAL_SERVER_ERROR,
-                         "{\"error\":\"systemd call failed\"}");
+/* ── GET /apps/jobs/<id> ──────────────────────────────────────────────────── */
 
-    return send_json(conn, MHD_HTTP_OK, "{\"ok\":true}");
+/*
+ * Job progress. With ?wait=S (up to BATCH_MAX_WAIT) an unfinished job holds
+ * the request until it is done or S seconds pass. Sets *waiting when the
+ * connection was parked instead of answered.
+ */
+static enum MHD_Result handle_job(struct MHD_Connection *conn, const char *id_str,
+                                   void **con_cls, int *waiting)
+{
+    char *end;
+    long id = strtol(id_str, &end, 10);
+    if (*id_str == '\0' || *end != '\0')
+        return send_static(conn, MHD_HTTP_NOT_FOUND, J_NO_SUCH_JOB);
+
+    const char *wait = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "wait");
+    if (wait && !*con_cls) {
+        *con_cls = &parked;
+        if (batch_wait(id, conn, (unsigned)strtoul(wait, NULL, 10))) {
+            *waiting = 1;
+            return MHD_YES;
+        }
+    }
+
+    jw_t w;
+    jw_init(&w, httpd_arena(conn), 0);
+    if (batch_status(id, &w) != 0)
+        return send_static(conn, MHD_HTTP_NOT_FOUND, J_NO_SUCH_JOB);
+    return response_send_jw(conn, MHD_HTTP_OK, &w);
 }
 
 /* ── Main request handler ─────────────────────────────────────────────────── */
 
+/*
+ * Route a request. *route is set to the R_* to time when this call finishes
+ * the request, and left at -1 while a body is still arriving or a job wait
+ * is parked; *start is moved back to the request's arrival for bodies.
+ */
+static enum MHD_Result dispatch(struct MHD_Connection *conn,
+                                 const char *url,
+                                 const char *method,
+                                 const char *upload_data,
+                                 size_t *upload_data_size,
+                                 void **con_cls,
+                                 int *route,
+                                 uint64_t *start)
+{
+    if (strcmp(url, "/health") == 0 && strcmp(method, "GET") == 0) {
+        *route = R_HEALTH;
+        return send_static(conn, MHD_HTTP_OK, J_HEALTH);
+    }
+
+    if (strcmp(url, "/metrics") == 0 && strcmp(method, "GET") == 0) {
+        *route = R_METRICS;
+        return httpd_send_metrics(conn);
+    }
+
+    if (strcmp(url, "/apps") == 0 && strcmp(method, "GET") == 0) {
+        *route = R_LIST;
+        return listing_send(conn);
+    }
+
+    if (strcmp(url, "/apps/events") == 0 && strcmp(method, "GET") == 0) {
+        *route = R_EVENTS;
+        return events_subscribe(conn);
+    }
+
+    if (strcmp(url, "/apps/stats") == 0 && strcmp(method, "GET") == 0) {
+        *route = R_STATS;
+        return stats_send(conn, NULL);
+    }
+
+    /* GET /apps/jobs/<id> */
+    if (strncmp(url, "/apps/jobs/", 11) == 0 && strcmp(method, "GET") == 0) {
+        int waiting = 0;
+        enum MHD_Result ret = handle_job(conn, url + 11, con_cls, &waiting);
+        if (!waiting) *route = R_JOBS;
+        return ret;
+    }
+
+    /* Bulk start/stop, which take a body */
+    if ((strcmp(url, "/apps/start") == 0 || strcmp(url, "/apps/stop") == 0) &&
+        strcmp(method, "POST") == 0)
+    {
+        if (!*con_cls) {
+            /* Lives until the request completes, like the connection's arena */
+            request_ctx_t *ctx = arena_alloc(httpd_arena(conn), sizeof(request_ctx_t));
+            if (!ctx) return MHD_NO;
+            memset(ctx, 0, sizeof(*ctx));
+            ctx->start = *start;
+            *con_cls = ctx;
+            return MHD_YES;
+        }
+
+        request_ctx_t *ctx = *con_cls;
+
+        if (*upload_data_size > 0) {
+            if (body_append(conn, ctx, upload_data, *upload_data_size) != 0) return MHD_NO;
+            *upload_data_size = 0;
+            return MHD_YES;
+        }
+
+        int bulk_start = strcmp(url, "/apps/start") == 0;
+        *start = ctx->start;
+        *route = bulk_start ? R_BULK_START : R_BULK_STOP;
+        return handle_bulk(conn, ctx, bulk_start);
+    }
+
+    char app_id[MAX_STR];
+
+    if (strcmp(method, "GET") == 0) {
+        int n = 0;
+        if (sscanf(url, "/apps/%255[^/]/stats%n", app_id, &n) == 1 && url[n] == '\0') {
+            *route = R_APP_STATS;
+            return stats_send(conn, app_id);
+        }
+    }
+
+    if (strcmp(method, "POST") == 0) {
+        int waiting = 0;
+        enum MHD_Result ret;
+
+        if (sscanf(url, "/apps/%255[^/]/start", app_id) == 1) {
+            ret = handle_action(conn, app_id, 1, con_cls, &waiting);
+            if (!waiting) *route = R_START;
+            return ret;
+        }
+
+        if (sscanf(url, "/apps/%255[^/]/stop", app_id) == 1) {
+            ret = handle_action(conn, app_id, 0, con_cls, &waiting);
+            if (!waiting) *route = R_STOP;
+            return ret;
+        }
+    }
+
+    *route = R_NOT_FOUND;
+    return send_static(conn, MHD_HTTP_NOT_FOUND, J_NOT_FOUND);
+}
+
 static enum MHD_Result handler(void *cls,
                                 struct MHD_Connection *conn,
                                 const char *url,
@@ -112,47 +406,131 @@ static enum MHD_Result handler(void *cls,
                                 size_t *upload_data_size,
                                 void **con_cls)
 {
-    (void)cls; (void)version; (void)upload_data; (void)upload_data_size;
-    (void)con_cls;
+    (void)cls; (void)version;
 
-    if (strcmp(url, "/health") == 0 && strcmp(method, "GET") == 0)
-        return send_json(conn, MHD_HTTP_OK, "{\"status\":\"ok\"}");
+    int      route = -1;
+    uint64_t start = metrics_now();
 
-    if (strcmp(url, "/apps") == 0 && strcmp(method, "GET") == 0)
-        return handle_list(conn);
+    enum MHD_Result ret = dispatch(conn, url, method, upload_data, upload_data_size,
+                                   con_cls, &route, &start);
+    if (route >= 0)
+        metrics_observe(&route_metrics[route], metrics_now() - start);
+    return ret;
+}
 
-    char app_id[MAX_STR];
+/* ── Entry point ──────────────────────────────────────────────────────────── */
 
-    if (strcmp(method, "POST") == 0) {
-        if (sscanf(url, "/apps/%255[^/]/start", app_id) == 1)
-            return handle_action(conn, app_id, 1);
+/* On SIGTERM: end event streams and job and start waits, which would outlast the drain */
+static void drain(void)
+{
+    events_close();
+    batch_close();
+    health_close();
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --apps-dir D       load and watch D/crimata-*/crimata.json (default %s)\n"
+            "  --cgroup-root D    read app usage from D/crimata-<id>.service (default %s)\n"
+            "  --stats-interval M serve /apps/stats samples for up to M ms (default %d)\n"
+            "  --idle-timeout S   stop apps after S idle seconds unless their manifest\n"
+            "                     sets idleTimeout (default 0: keep them running)\n"
+            "  --unit-dir D       write on-demand socket units to D (default %s)\n"
+            "  --probe-interval M probe each running app's health path every M ms (default %d)\n",
+            prog, APPS_DIR_DEFAULT, CGROUP_ROOT_DEFAULT, STATS_INTERVAL_DEFAULT, UNIT_DIR_DEFAULT,
+            PROBE_INTERVAL_DEFAULT);
+    httpd_config_usage(stderr);
+    fprintf(stderr, "HTTP settings can also be set as CRIMATA_DOCK_THREADS etc.\n");
+}
 
-        if (sscanf(url, "/apps/%255[^/]/stop", app_id) == 1)
-            return handle_action(conn, app_id, 0);
+int main(int argc, char **argv)
+{
+    httpd_block_signals();
+
+    httpd_config_t httpd = { .port = PORT, .threads = 1 };
+    httpd_config_env(&httpd, "CRIMATA_DOCK");
+
+    static const struct option opts[] = {
+        { "apps-dir",       required_argument, NULL, 'a' },
+        { "cgroup-root",    required_argument, NULL, 'c' },
+        { "stats-interval", required_argument, NULL, 'i' },
+        { "idle-timeout",   required_argument, NULL, 't' },
+        { "unit-dir",       required_argument, NULL, 'u' },
+        { "probe-interval", required_argument, NULL, 'p' },
+        { "help",           no_argument,       NULL, 'h' },
+        HTTPD_LONG_OPTIONS,
+        { NULL, 0, NULL, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "h", opts, NULL)) != -1) {
+        switch (c) {
+        case 'a': apps_set_dir(optarg); break;
+        case 'c': stats_set_root(optarg); break;
+        case 'i': stats_set_interval((unsigned)strtoul(optarg, NULL, 10)); break;
+        case 't': ondemand_set_idle_timeout((unsigned)strtoul(optarg, NULL, 10)); break;
+        case 'u': ondemand_set_unit_dir(optarg); break;
+        case 'p': health_set_interval((unsigned)strtoul(optarg, NULL, 10)); break;
+        case 'h': usage(argv[0]); return 0;
+        default:
+            if (httpd_config_set(&httpd, c, optarg) == 0) break;
+            usage(argv[0]);
+            return 1;
+        }
     }
 
-    return send_json(conn, MHD_HTTP_NOT_FOUND, "{\"error\":\"not found\"}");
-}
+    for (int i = 0; i < R_COUNT; i++) metrics_register(&route_metrics[i]);
+    stats_init();
 
-/* ── Entry point ──────────────────────────────────────────────────────────── */
+    if (loop_init() != 0 || events_init() != 0 || batch_init() != 0) {
+        fprintf(stderr, "failed to start event loop\n");
+        return 1;
+    }
+    if (apps_init() != 0) {
+        fprintf(stderr, "failed to load app manifests\n");
+        return 1;
+    }
+    if (health_init() != 0) {
+        fprintf(stderr, "failed to start health probes\n");
+        return 1;
+    }
+    if (systemd_init() != 0)
+        fprintf(stderr, "no system bus — apps will show as stopped and cannot be started\n");
+    else if (ondemand_init() != 0)
+        fprintf(stderr, "on-demand start unavailable — apps keep running when idle\n");
+    if (loop_start() != 0) {
+        fprintf(stderr, "failed to start event loop\n");
+        return 1;
+    }
 
-int main(void)
-{
-    struct MHD_Daemon *daemon = MHD_start_daemon(
-        MHD_USE_INTERNAL_POLLING_THREAD,
-        PORT, NULL, NULL,
-        &handler, NULL,
-        MHD_OPTION_END
-    );
+    for (int i = 0; i < J_COUNT; i++) {
+        json_static[i] = response_static(json_bodies[i]);
+        if (!json_static[i]) {
+            fprintf(stderr, "failed to build static responses\n");
+            return 1;
+        }
+    }
+
+    /* /apps/events subscribers and job waits sit suspended */
+    struct MHD_Daemon *daemon = httpd_start(&httpd, MHD_ALLOW_SUSPEND_RESUME,
+                                            &handler, NULL, NULL);
 
     if (!daemon) {
-        fprintf(stderr, "failed to start daemon on port %d\n", PORT);
+        fprintf(stderr, "failed to start daemon on port %u\n", httpd.port);
         return 1;
     }
 
-    printf("crimata-dock listening on :%d\n", PORT);
-    getchar();
+    metrics_gauge("crimata_dock_http_connections", "Open HTTP connections",
+                  httpd_connections, daemon);
+
+    printf("crimata-dock listening on :%u\n", httpd.port);
+    fflush(stdout);
+    httpd_set_drain_hook(drain);
+    httpd_serve(&httpd, daemon);
+
+    for (int i = 0; i < J_COUNT; i++) MHD_destroy_response(json_static[i]);
 
-    MHD_stop_daemon(daemon);
     return 0;
 }
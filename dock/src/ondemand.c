@@ -0,0 +1,618 @@
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include "apps.h"
+#include "health.h"
+#include "loop.h"
+#include "metrics.h"
+#include "ondemand.h"
+#include "systemd.h"
+
+#define COLD_POLL_MS 10   /* accept-queue checks while a cold start is timed */
+#define COLD_MAX     60   /* seconds before a start that never accepts is given up on */
+#define PATH_LEN     (4096 + MAX_STR + 64)
+#define DROPIN       "crimata-on-demand.conf"
+
+/* First line of every file we write; files without it are left alone */
+#define MARKER "# Generated by crimata-dock for on-demand start\n"
+
+static metric_t m_cold  = METRIC_HISTOGRAM_DEF("crimata_dock_cold_start_seconds", NULL,
+                                               "On-demand start: service starting to the waiting connection being accepted");
+static metric_t m_stops = METRIC_COUNTER_DEF("crimata_dock_idle_stops_total", NULL,
+                                             "Services stopped after their idle timeout");
+
+/* One on-demand app. Changed on the loop thread, read by ondemand_info() */
+typedef struct {
+    char         id[MAX_STR];
+    int          port;
+    unsigned     idle_timeout;   /* seconds */
+    event_type_t state;          /* of crimata-<id>.service */
+    int          stopping;       /* idle stop queued */
+    int          restart;        /* socket moved to a new port: restart it after the reload */
+    uint64_t     last_active;    /* metrics_now() of the latest traffic seen */
+    uint64_t     cold_since;     /* service left stopped, while a cold start is timed */
+    int          cold_queued;    /* a connection was seen waiting on the socket */
+    unsigned     queue;          /* accept queue at the last scan */
+    unsigned     cold_starts;
+    uint64_t     last_cold;
+} od_app_t;
+
+static char      unit_dir[4096] = UNIT_DIR_DEFAULT;
+static unsigned  default_timeout;
+
+static od_app_t *apps;           /* sorted by port */
+static int       count;
+static unsigned  synced_version;
+static int       synced;         /* units match synced_version */
+static unsigned  synced_connects; /* systemd_connects() they were applied under */
+static int       unapplied;      /* unit files written, but no daemon-reload got through */
+static int       reloading;      /* daemon-reload in flight */
+static int       resync;         /* registry changed during it */
+static char    (*stale)[MAX_STR];  /* sockets to stop once the reload is done */
+static int       nstale;
+static int       diag_fd = -1, scan_fd = -1, cold_fd = -1;
+static int       cold_armed;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+void ondemand_set_unit_dir(const char *dir)
+{
+    snprintf(unit_dir, sizeof(unit_dir), "%s", dir);
+}
+
+void ondemand_set_idle_timeout(unsigned seconds)
+{
+    default_timeout = seconds;
+}
+
+/* ── Table ────────────────────────────────────────────────────────────────── */
+
+/* Caller holds lock */
+static od_app_t *find_id(const char *id)
+{
+    for (int i = 0; i < count; i++)
+        if (strcmp(apps[i].id, id) == 0) return &apps[i];
+    return NULL;
+}
+
+/* Caller holds lock */
+static od_app_t *find_port(int port)
+{
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (apps[mid].port == port) return &apps[mid];
+        if (apps[mid].port < port) lo = mid + 1; else hi = mid;
+    }
+    return NULL;
+}
+
+static int by_port(const void *a, const void *b)
+{
+    return ((const od_app_t *)a)->port - ((const od_app_t *)b)->port;
+}
+
+/* ── Units ────────────────────────────────────────────────────────────────── */
+
+/* Whether path is a file we wrote */
+static int generated(const char *path)
+{
+    char  line[sizeof(MARKER)];
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int ours = fgets(line, sizeof(line), f) && strcmp(line, MARKER) == 0;
+    fclose(f);
+    return ours;
+}
+
+/*
+ * Write body to path unless it already holds exactly that, or was not
+ * written by us. Returns 1 if written, 0 if left as it is, -1 on error.
+ */
+static int write_unit(const char *path, const char *body)
+{
+    char   cur[2048];
+    size_t len = strlen(body);
+    FILE  *f   = fopen(path, "r");
+    if (f) {
+        size_t n = fread(cur, 1, sizeof(cur), f);
+        fclose(f);
+        if (n == len && memcmp(cur, body, len) == 0) return 0;
+        if (n < sizeof(MARKER) - 1 || memcmp(cur, MARKER, sizeof(MARKER) - 1) != 0) return 0;
+    }
+
+    char tmp[PATH_LEN + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (!(f = fopen(tmp, "w"))) return -1;
+    int ok = fwrite(body, 1, len, f) == len;
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 1;
+}
+
+/* crimata-<id>.socket and the drop-in tying the service to it — as write_unit() */
+static int write_units(od_app_t *a)
+{
+    char path[PATH_LEN], body[1024 + 3 * MAX_STR];
+
+    snprintf(path, sizeof(path), "%s/crimata-%s.socket", unit_dir, a->id);
+    int existed = access(path, F_OK) == 0;
+    snprintf(body, sizeof(body),
+             MARKER
+             "[Unit]\nDescription=crimata-%s on demand\n\n"
+             "[Socket]\nListenStream=127.0.0.1:%d\n",
+             a->id, a->port);
+    int rs = write_unit(path, body);
+    if (rs > 0 && existed) a->restart = 1;
+
+    snprintf(path, sizeof(path), "%s/crimata-%s.service.d", unit_dir, a->id);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+    snprintf(path, sizeof(path), "%s/crimata-%s.service.d/" DROPIN, unit_dir, a->id);
+    snprintf(body, sizeof(body),
+             MARKER
+             "[Unit]\nRequires=crimata-%s.socket\nAfter=crimata-%s.socket\n",
+             a->id, a->id);
+    int rd = write_unit(path, body);
+
+    if (rs < 0 || rd < 0) return -1;
+    return rs || rd;
+}
+
+/*
+ * Remove the units of apps that were uninstalled or lost their timeout,
+ * and remember their sockets for stopping after the reload. Returns the
+ * number removed. Caller holds lock.
+ */
+static int sweep_stale(void)
+{
+    DIR *d = opendir(unit_dir);
+    if (!d) return 0;
+
+    int            removed = 0;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        size_t n = strlen(e->d_name);
+        if (strncmp(e->d_name, "crimata-", 8) != 0 || n <= 15 || n - 15 >= MAX_STR ||
+            strcmp(e->d_name + n - 7, ".socket") != 0)
+            continue;
+
+        char id[MAX_STR], path[PATH_LEN];
+        memcpy(id, e->d_name + 8, n - 15);
+        id[n - 15] = '\0';
+        snprintf(path, sizeof(path), "%s/%s", unit_dir, e->d_name);
+        if (find_id(id) || !generated(path)) continue;
+
+        char (*more)[MAX_STR] = realloc(stale, (size_t)(nstale + 1) * sizeof(*stale));
+        if (!more) break;
+        stale = more;
+        memcpy(stale[nstale++], id, n - 14);
+
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/crimata-%s.service.d/" DROPIN, unit_dir, id);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/crimata-%s.service.d", unit_dir, id);
+        rmdir(path);   /* fails, as it should, if anything else is in it */
+        removed++;
+    }
+    closedir(d);
+    return removed;
+}
+
+/* ── Jobs ─────────────────────────────────────────────────────────────────── */
+
+typedef struct {
+    int  restart;   /* stop, then start */
+    char unit[MAX_STR + 16];
+} socket_job_t;
+
+static void on_socket_job(void *arg, const char *result)
+{
+    socket_job_t *j = arg;
+
+    if (j->restart && result && strcmp(result, "done") == 0) {
+        j->restart = 0;
+        if (systemd_submit(1, j->unit, on_socket_job, j) == 0) return;
+        result = NULL;
+    }
+    if (!result || strcmp(result, "done") != 0)
+        fprintf(stderr, "%s: %s\n", j->unit, result ? result : "bus call failed");
+    free(j);
+}
+
+/* Start, stop or (restart) stop-then-start crimata-<id>.socket */
+static void socket_job(const char *id, int start, int restart)
+{
+    socket_job_t *j = malloc(sizeof(*j));
+    if (!j) return;
+    j->restart = restart;
+    snprintf(j->unit, sizeof(j->unit), "crimata-%s.socket", id);
+    if (systemd_submit(start && !restart, j->unit, on_socket_job, j) != 0) free(j);
+}
+
+/* Listen on every stopped app's port. Caller holds lock */
+static void start_sockets(void)
+{
+    for (int i = 0; i < count; i++) {
+        od_app_t *a = &apps[i];
+        if (a->restart) {
+            a->restart = 0;
+            socket_job(a->id, 1, 1);
+        } else if (a->state == EV_STOPPED || a->state == EV_FAILED) {
+            /* A running service bound the port itself; its socket starts once it stops */
+            socket_job(a->id, 1, 0);
+        }
+    }
+}
+
+static void sync_units(void);
+
+static void on_reloaded(void *arg, const char *result)
+{
+    (void)arg;
+    pthread_mutex_lock(&lock);
+    reloading = 0;
+    if (!result) {
+        fprintf(stderr, "daemon-reload failed — on-demand units not applied\n");
+        synced    = 0;
+        unapplied = 1;
+    } else {
+        unapplied = 0;
+        for (int i = 0; i < nstale; i++) socket_job(stale[i], 0, 0);
+        nstale = 0;
+        start_sockets();
+    }
+    if (resync) {
+        resync = 0;
+        sync_units();
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void on_idle_stop(void *arg, const char *result)
+{
+    char *id = arg;
+
+    if (!result || strcmp(result, "done") != 0) {
+        fprintf(stderr, "crimata-%s.service: idle stop %s\n", id, result ? result : "failed");
+        pthread_mutex_lock(&lock);
+        od_app_t *a = find_id(id);
+        if (a) {
+            a->stopping    = 0;
+            a->last_active = metrics_now();   /* try again after another timeout */
+        }
+        pthread_mutex_unlock(&lock);
+    }
+    free(id);
+}
+
+/* ── Registry ─────────────────────────────────────────────────────────────── */
+
+/*
+ * Bring the table and the generated units in line with the registry, and
+ * reload systemd if any unit file changed. Caller holds lock.
+ */
+static void sync_units(void)
+{
+    if (reloading) {
+        resync = 1;
+        return;
+    }
+
+    const apps_snapshot_t *snap = apps_acquire();
+    od_app_t *next = calloc((size_t)snap->count + 1, sizeof(*next));
+    if (!next) {
+        apps_release(snap);
+        return;
+    }
+
+    uint64_t now = metrics_now();
+    int      n   = 0;
+    for (int i = 0; i < snap->count; i++) {
+        const app_t *app = snap->apps[i];
+        unsigned timeout = app->idle_timeout >= 0 ? (unsigned)app->idle_timeout : default_timeout;
+        if (app->port <= 0 || timeout == 0 || apps_find(snap, app->id) != app) continue;
+
+        /* The id is written into root-owned unit files as is; never let it add a line */
+        if (!apps_valid_id(app->id)) {
+            fprintf(stderr, "%s: not a valid unit name, not started on demand\n", app->pkg);
+            continue;
+        }
+
+        od_app_t       *a   = &next[n++];
+        const od_app_t *old = find_id(app->id);
+        if (old) {
+            *a = *old;
+        } else {
+            char unit[MAX_STR + 16];
+            snprintf(unit, sizeof(unit), "crimata-%s.service", app->id);
+            snprintf(a->id, sizeof(a->id), "%s", app->id);
+            a->state       = systemd_is_active(unit) == 1 ? EV_ACTIVE : EV_STOPPED;
+            a->last_active = now;
+        }
+        a->port         = app->port;
+        a->idle_timeout = timeout;
+        a->restart      = 0;
+    }
+    unsigned version = snap->version;
+    apps_release(snap);
+
+    qsort(next, (size_t)n, sizeof(*next), by_port);
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        if (kept && next[kept - 1].port == next[i].port) {
+            fprintf(stderr, "%s: port %d already taken by %s, not started on demand\n",
+                    next[i].id, next[i].port, next[kept - 1].id);
+            continue;
+        }
+        next[kept++] = next[i];
+    }
+    free(apps);
+    apps  = next;
+    count = kept;
+
+    int changed = 0, failed = 0;
+    for (int i = 0; i < count; i++) {
+        int r = write_units(&apps[i]);
+        if (r < 0) {
+            fprintf(stderr, "%s/crimata-%s.socket: %s\n", unit_dir, apps[i].id, strerror(errno));
+            failed = 1;
+        } else {
+            changed |= r;
+        }
+    }
+    if (sweep_stale() > 0 || nstale > 0) changed = 1;
+
+    synced_version  = version;
+    synced_connects = systemd_connects();
+    synced          = !failed;
+    if (unapplied) changed = 1;
+
+    if (!changed) {
+        start_sockets();
+        return;
+    }
+    if (systemd_reload(on_reloaded, NULL) != 0) {
+        synced    = 0;
+        unapplied = 1;
+        return;
+    }
+    reloading = 1;
+}
+
+/* ── Traffic ──────────────────────────────────────────────────────────────── */
+
+/* One socket from the dump: listeners give the accept queue, connections their last data */
+static void note_socket(const struct inet_diag_msg *m, const struct tcp_info *ti, uint64_t now)
+{
+    od_app_t *a = find_port(ntohs(m->id.idiag_sport));
+    if (!a || health_is_probe(ntohs(m->id.idiag_dport))) return;
+
+    uint64_t seen = now;
+    if (m->idiag_state == TCP_LISTEN) {
+        a->queue += m->idiag_rqueue;
+        if (m->idiag_rqueue == 0) return;
+    } else if (ti) {
+        uint64_t ms = ti->tcpi_last_data_recv < ti->tcpi_last_data_sent
+                    ? ti->tcpi_last_data_recv : ti->tcpi_last_data_sent;
+        seen = ms * 1000000 < now ? now - ms * 1000000 : 0;
+    }
+    if (seen > a->last_active) a->last_active = seen;
+}
+
+/*
+ * Walk the TCP sockets of family in states (a TCPF_* style mask) through
+ * NETLINK_SOCK_DIAG, one dump for the whole host. Returns 0 or -1.
+ * Caller holds lock.
+ */
+static int diag_dump(int family, uint32_t states, uint64_t now)
+{
+    struct {
+        struct nlmsghdr         nlh;
+        struct inet_diag_req_v2 req;
+    } msg = {
+        .nlh = { .nlmsg_len   = sizeof(msg),
+                 .nlmsg_type  = SOCK_DIAG_BY_FAMILY,
+                 .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP },
+        .req = { .sdiag_family   = (uint8_t)family,
+                 .sdiag_protocol = IPPROTO_TCP,
+                 .idiag_ext      = 1 << (INET_DIAG_INFO - 1),
+                 .idiag_states   = states },
+    };
+    if (send(diag_fd, &msg, sizeof(msg), 0) < 0) return -1;
+
+    static long buf[8192];   /* loop thread only */
+    for (;;) {
+        int n = (int)recv(diag_fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, n); h = NLMSG_NEXT(h, n)) {
+            if (h->nlmsg_type == NLMSG_DONE)  return 0;
+            if (h->nlmsg_type == NLMSG_ERROR) return -1;
+
+            const struct inet_diag_msg *m  = NLMSG_DATA(h);
+            const struct tcp_info      *ti = NULL;
+            int len = (int)h->nlmsg_len - NLMSG_LENGTH(sizeof(*m));
+            for (struct rtattr *a = (struct rtattr *)(m + 1); RTA_OK(a, len); a = RTA_NEXT(a, len))
+                if (a->rta_type == INET_DIAG_INFO &&
+                    RTA_PAYLOAD(a) >= offsetof(struct tcp_info, tcpi_last_ack_recv))
+                    ti = RTA_DATA(a);
+            note_socket(m, ti, now);
+        }
+    }
+}
+
+/* Both families: a Node app bound to :: takes IPv4 connections on an IPv6 socket */
+static void scan(uint32_t states, uint64_t now)
+{
+    for (int i = 0; i < count; i++) apps[i].queue = 0;
+    if (diag_dump(AF_INET, states, now) != 0 || diag_dump(AF_INET6, states, now) != 0)
+        fprintf(stderr, "sock_diag: %s\n", strerror(errno));
+}
+
+/* Caller holds lock */
+static void arm_cold(int on)
+{
+    if (on == cold_armed) return;
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+    if (on) its.it_interval.tv_nsec = its.it_value.tv_nsec = COLD_POLL_MS * 1000000L;
+    if (timerfd_settime(cold_fd, 0, &its, NULL) == 0) cold_armed = on;
+}
+
+/* Loop thread, every COLD_POLL_MS while a start is timed: has the app taken its connection yet? */
+static void on_cold(int fd, uint32_t events, void *arg)
+{
+    (void)events; (void)arg;
+    uint64_t n;
+    if (read(fd, &n, sizeof(n)) != sizeof(n)) return;
+
+    pthread_mutex_lock(&lock);
+    uint64_t now = metrics_now();
+    scan(1 << TCP_LISTEN, now);
+
+    int timing = 0;
+    for (int i = 0; i < count; i++) {
+        od_app_t *a = &apps[i];
+        if (!a->cold_since) continue;
+
+        if (a->queue) {
+            a->cold_queued = 1;
+        } else if (a->cold_queued) {
+            a->last_cold = now - a->cold_since;
+            a->cold_starts++;
+            a->cold_since = 0;
+            metrics_observe(&m_cold, a->last_cold);
+            continue;
+        } else {
+            a->cold_since = 0;   /* nothing waiting: started by hand, not by a connection */
+            continue;
+        }
+
+        if (now - a->cold_since > (uint64_t)COLD_MAX * 1000000000) a->cold_since = 0;
+        else timing = 1;
+    }
+    if (!timing) arm_cold(0);
+    pthread_mutex_unlock(&lock);
+}
+
+/* Loop thread, every IDLE_SCAN seconds: follow the registry, note traffic, stop idle apps */
+static void on_scan(int fd, uint32_t events, void *arg)
+{
+    (void)events; (void)arg;
+    uint64_t n;
+    if (read(fd, &n, sizeof(n)) != sizeof(n)) return;
+
+    pthread_mutex_lock(&lock);
+    /* After a (re)connect, socket starts made while the bus was away are redone */
+    if (!synced || apps_current_version() != synced_version ||
+        systemd_connects() != synced_connects)
+        sync_units();
+
+    uint64_t now = metrics_now();
+    if (count) scan((1 << TCP_ESTABLISHED) | (1 << TCP_LISTEN), now);
+
+    for (int i = 0; i < count; i++) {
+        od_app_t *a = &apps[i];
+        if (a->state != EV_ACTIVE || a->stopping ||
+            now - a->last_active < (uint64_t)a->idle_timeout * 1000000000)
+            continue;
+
+        char *id = strdup(a->id);
+        char  unit[MAX_STR + 16];
+        snprintf(unit, sizeof(unit), "crimata-%s.service", a->id);
+        if (!id || systemd_submit(0, unit, on_idle_stop, id) != 0) {
+            free(id);
+            continue;
+        }
+        a->stopping = 1;
+        metrics_inc(&m_stops);
+        fprintf(stderr, "%s: idle for %u s, stopping\n", a->id, a->idle_timeout);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* Loop thread: a service changed state — time cold starts, re-listen once stopped */
+static void on_state(const char *id, event_type_t state)
+{
+    pthread_mutex_lock(&lock);
+    od_app_t *a = find_id(id);
+    if (a) {
+        int was_down = a->state == EV_STOPPED || a->state == EV_FAILED;
+        int up       = state == EV_STARTING || state == EV_ACTIVE;
+
+        if (was_down && up) {
+            a->last_active = metrics_now();   /* a fresh start gets its whole timeout */
+            a->cold_since  = a->last_active;
+            a->cold_queued = 0;
+            arm_cold(1);
+        } else if (!up) {
+            a->stopping   = 0;
+            a->cold_since = 0;
+            /* Whoever stopped it, the next connection starts it again */
+            if (!was_down && !reloading) socket_job(a->id, 1, 0);
+        }
+        a->state = state;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* ── Setup ────────────────────────────────────────────────────────────────── */
+
+int ondemand_init(void)
+{
+    metrics_register(&m_cold);
+    metrics_register(&m_stops);
+
+    diag_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    scan_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    cold_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (diag_fd < 0 || scan_fd < 0 || cold_fd < 0) return -1;
+
+    struct itimerspec its = { { IDLE_SCAN, 0 }, { IDLE_SCAN, 0 } };
+    if (timerfd_settime(scan_fd, 0, &its, NULL) != 0 ||
+        loop_add(scan_fd, EPOLLIN, on_scan, NULL) != 0 ||
+        loop_add(cold_fd, EPOLLIN, on_cold, NULL) != 0)
+        return -1;
+
+    systemd_set_state_hook(on_state);
+
+    pthread_mutex_lock(&lock);
+    sync_units();
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+int ondemand_info(const char *id, ondemand_info_t *out)
+{
+    pthread_mutex_lock(&lock);
+    const od_app_t *a = find_id(id);
+    if (a) {
+        uint64_t now = metrics_now();
+        out->idle_timeout = a->idle_timeout;
+        out->running      = a->state == EV_STARTING || a->state == EV_ACTIVE;
+        out->stopping     = a->stopping;
+        out->idle_ns      = out->running && now > a->last_active ? now - a->last_active : 0;
+        out->cold_starts  = a->cold_starts;
+        out->last_cold_ns = a->last_cold;
+    }
+    pthread_mutex_unlock(&lock);
+    return a ? 0 : -1;
+}
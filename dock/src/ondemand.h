@@ -0,0 +1,36 @@
+#ifndef ONDEMAND_H
+#define ONDEMAND_H
+
+#include <stdint.h>
+
+#define UNIT_DIR_DEFAULT "/run/systemd/system"
+#define IDLE_SCAN        5   /* seconds between scans of the apps' connections */
+
+/* Write the generated units under dir instead of UNIT_DIR_DEFAULT */
+void ondemand_set_unit_dir(const char *dir);
+
+/* Idle timeout for manifests without "idleTimeout" — 0 (the default) keeps them running */
+void ondemand_set_idle_timeout(unsigned seconds);
+
+/*
+ * Scale-to-zero for apps with a port and an idle timeout. Each gets a
+ * generated crimata-<id>.socket on its port, so the first connection starts
+ * the service, and the service is stopped once none of its connections has
+ * carried data for the timeout. Call after systemd_init(), before
+ * loop_start(). Returns 0 or -1.
+ */
+int  ondemand_init(void);
+
+typedef struct {
+    unsigned idle_timeout;   /* seconds */
+    int      running;
+    int      stopping;       /* idle stop queued */
+    uint64_t idle_ns;        /* since the app's last traffic, while running */
+    unsigned cold_starts;    /* starts that had a connection waiting on them */
+    uint64_t last_cold_ns;   /* the latest: service starting → connection accepted */
+} ondemand_info_t;
+
+/* On-demand state of app id — 0, or -1 if it is not started on demand */
+int  ondemand_info(const char *id, ondemand_info_t *out);
+
+#endif
@@ -0,0 +1,266 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "apps.h"
+#include "httpd.h"
+#include "json.h"
+#include "metrics.h"
+#include "ondemand.h"
+#include "response.h"
+#include "stats.h"
+
+static metric_t m_sample = METRIC_HISTOGRAM_DEF("crimata_dock_stats_sample_seconds", NULL,
+                                                "Time to read every app's cgroup for /apps/stats");
+
+static char     cgroup_root[4096] = CGROUP_ROOT_DEFAULT;
+static unsigned interval_ms       = STATS_INTERVAL_DEFAULT;
+
+/* One app's counters; found is 0 while its service has no cgroup (stopped) */
+typedef struct {
+    const char *id;
+    int         found;
+    uint64_t    memory;     /* memory.current, bytes */
+    uint64_t    cpu_usec;   /* cpu.stat usage_usec */
+    uint64_t    tasks;      /* pids.current */
+    uint64_t    io_read;    /* io.stat rbytes, every device */
+    uint64_t    io_write;   /* io.stat wbytes */
+    int             on_demand;
+    ondemand_info_t od;
+} usage_t;
+
+/* The last sample: per-app entries for /apps/<id>/stats, one shared body for /apps/stats */
+static struct {
+    int                  valid;
+    unsigned             apps_version;
+    uint64_t             taken;       /* metrics_now() */
+    long long            taken_ms;    /* wall clock, for sampledAt */
+    usage_t             *usage;
+    int                  count;
+    arena_t              arena;       /* usage and the ids */
+    struct MHD_Response *all;
+} cache;
+
+static pthread_rwlock_t cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+void stats_set_root(const char *dir)
+{
+    snprintf(cgroup_root, sizeof(cgroup_root), "%s", dir);
+}
+
+void stats_set_interval(unsigned ms)
+{
+    interval_ms = ms;
+}
+
+void stats_init(void)
+{
+    metrics_register(&m_sample);
+}
+
+/* ── cgroupfs ─────────────────────────────────────────────────────────────── */
+
+/* Small cgroup file under dirfd into buf — length, or -1 */
+static ssize_t read_at(int dirfd, const char *name, char *buf, size_t size)
+{
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+/* Sum of every "key=N" in io.stat, or the value of "key N" in cpu.stat */
+static uint64_t field_sum(const char *text, const char *key)
+{
+    size_t   klen = strlen(key);
+    uint64_t sum  = 0;
+    for (const char *p = text; (p = strstr(p, key)); p += klen) {
+        if ((p != text && p[-1] != ' ' && p[-1] != '\n') ||
+            (p[klen] != '=' && p[klen] != ' '))
+            continue;
+        sum += strtoull(p + klen + 1, NULL, 10);
+    }
+    return sum;
+}
+
+static void sample_app(usage_t *u)
+{
+    char path[4096 + MAX_STR + 32];
+    char buf[4096];
+
+    snprintf(path, sizeof(path), "%s/crimata-%s.service", cgroup_root, u->id);
+    int dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return;   /* not running: systemd removes the cgroup */
+
+    u->found = 1;
+    if (read_at(dirfd, "memory.current", buf, sizeof(buf)) > 0)
+        u->memory = strtoull(buf, NULL, 10);
+    if (read_at(dirfd, "pids.current", buf, sizeof(buf)) > 0)
+        u->tasks = strtoull(buf, NULL, 10);
+    if (read_at(dirfd, "cpu.stat", buf, sizeof(buf)) > 0)
+        u->cpu_usec = field_sum(buf, "usage_usec");
+    if (read_at(dirfd, "io.stat", buf, sizeof(buf)) > 0) {
+        u->io_read  = field_sum(buf, "rbytes");
+        u->io_write = field_sum(buf, "wbytes");
+    }
+    close(dirfd);
+}
+
+/* ── Cache ────────────────────────────────────────────────────────────────── */
+
+static void write_usage(jw_t *w, const usage_t *u)
+{
+    jw_object_begin(w);
+    jw_key(w, "id");      jw_string(w, u->id);
+    jw_key(w, "running"); jw_bool(w, u->found);
+    if (u->found) {
+        jw_key(w, "memoryBytes");  jw_uint(w, u->memory);
+        jw_key(w, "cpuUsec");      jw_uint(w, u->cpu_usec);
+        jw_key(w, "tasks");        jw_uint(w, u->tasks);
+        jw_key(w, "ioReadBytes");  jw_uint(w, u->io_read);
+        jw_key(w, "ioWriteBytes"); jw_uint(w, u->io_write);
+    }
+    if (u->on_demand) {
+        jw_key(w, "idleTimeout"); jw_uint(w, u->od.idle_timeout);
+        if (u->od.running) {
+            jw_key(w, "idleSeconds"); jw_uint(w, u->od.idle_ns / 1000000000);
+        }
+        jw_key(w, "coldStarts"); jw_uint(w, u->od.cold_starts);
+        if (u->od.cold_starts) {
+            jw_key(w, "lastColdStartMs"); jw_uint(w, u->od.last_cold_ns / 1000000);
+        }
+    }
+    jw_object_end(w);
+}
+
+/* { sampledAt, apps: [...] } as a response that owns its body, or NULL */
+static struct MHD_Response *build_all(void)
+{
+    arena_t arena;
+    jw_t    w;
+    arena_init(&arena, NULL, 0, 16384);
+    jw_init(&w, &arena, 0);
+
+    jw_object_begin(&w);
+    jw_key(&w, "sampledAt"); jw_int(&w, cache.taken_ms);
+    jw_key(&w, "apps");
+    jw_array_begin(&w);
+    for (int i = 0; i < cache.count; i++) write_usage(&w, &cache.usage[i]);
+    jw_array_end(&w);
+    jw_object_end(&w);
+
+    size_t      len;
+    const char *body = jw_finish(&w, &len);
+    char       *copy = body ? malloc(len) : NULL;
+    if (copy) memcpy(copy, body, len);
+    arena_free(&arena);
+    if (!copy) return NULL;
+
+    struct MHD_Response *resp = MHD_create_response_from_buffer_with_free_callback(len, copy, free);
+    if (!resp) {
+        free(copy);
+        return NULL;
+    }
+    MHD_add_response_header(resp, "Content-Type", "application/json");
+    MHD_add_response_header(resp, "Access-Control-Allow-Origin", "*");
+    MHD_add_response_header(resp, "Cache-Control", "no-cache");
+    return resp;
+}
+
+/* Caller holds the write lock. Returns 0, or -1 with the cache left invalid */
+static int resample(unsigned apps_version)
+{
+    uint64_t start = metrics_now();
+
+    if (cache.all) MHD_destroy_response(cache.all);
+    cache.all   = NULL;
+    cache.valid = 0;
+    arena_free(&cache.arena);
+    arena_init(&cache.arena, NULL, 0, 16384);
+
+    const apps_snapshot_t *snap = apps_acquire();
+    cache.usage = arena_alloc(&cache.arena, (size_t)snap->count * sizeof(usage_t) + 1);
+    cache.count = 0;
+    for (int i = 0; cache.usage && i < snap->count; i++) {
+        const app_t *app = snap->apps[i];
+        if (apps_find(snap, app->id) != app) continue;   /* lost a duplicate id */
+
+        usage_t *u = &cache.usage[cache.count];
+        memset(u, 0, sizeof(*u));
+        u->id = arena_strndup(&cache.arena, app->id, strlen(app->id));
+        if (!u->id) break;
+        sample_app(u);
+        u->on_demand = ondemand_info(u->id, &u->od) == 0;
+        cache.count++;
+    }
+    apps_release(snap);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    cache.taken_ms     = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    cache.taken        = metrics_now();
+    cache.apps_version = apps_version;
+    cache.all          = cache.usage ? build_all() : NULL;
+    metrics_observe(&m_sample, metrics_now() - start);
+
+    if (!cache.all) return -1;
+    cache.valid = 1;
+    return 0;
+}
+
+static int fresh(unsigned apps_version)
+{
+    return cache.valid && cache.apps_version == apps_version &&
+           metrics_now() - cache.taken < (uint64_t)interval_ms * 1000000;
+}
+
+/* Caller holds the cache lock */
+static enum MHD_Result send_cached(struct MHD_Connection *conn, const char *id)
+{
+    if (!id) return response_queue(conn, MHD_HTTP_OK, cache.all);
+
+    for (int i = 0; i < cache.count; i++) {
+        if (strcmp(cache.usage[i].id, id) != 0) continue;
+        jw_t w;
+        jw_init(&w, httpd_arena(conn), 0);
+        jw_object_begin(&w);
+        jw_key(&w, "sampledAt"); jw_int(&w, cache.taken_ms);
+        jw_key(&w, "app");       write_usage(&w, &cache.usage[i]);
+        jw_object_end(&w);
+        return response_send_jw(conn, MHD_HTTP_OK, &w);
+    }
+
+    static const char no_app[] = "{\"error\":\"app not found\"}";
+    return response_send(conn, MHD_HTTP_NOT_FOUND, no_app, sizeof(no_app) - 1);
+}
+
+enum MHD_Result stats_send(struct MHD_Connection *conn, const char *id)
+{
+    unsigned apps_version = apps_current_version();
+    enum MHD_Result ret;
+
+    pthread_rwlock_rdlock(&cache_lock);
+    if (fresh(apps_version)) {
+        ret = send_cached(conn, id);
+        pthread_rwlock_unlock(&cache_lock);
+        return ret;
+    }
+    pthread_rwlock_unlock(&cache_lock);
+
+    /* Stale: the first thread in resamples, the rest find it done */
+    pthread_rwlock_wrlock(&cache_lock);
+    if (!fresh(apps_version) && resample(apps_version) != 0) {
+        pthread_rwlock_unlock(&cache_lock);
+        static const char oom[] = "{\"error\":\"out of memory\"}";
+        return response_send(conn, MHD_HTTP_INTERNAL_SERVER_ERROR, oom, sizeof(oom) - 1);
+    }
+    ret = send_cached(conn, id);
+    pthread_rwlock_unlock(&cache_lock);
+    return ret;
+}
@@ -0,0 +1,26 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <microhttpd.h>
+
+#define CGROUP_ROOT_DEFAULT    "/sys/fs/cgroup/system.slice"
+#define STATS_INTERVAL_DEFAULT 1000   /* ms a sample is served for */
+
+/* Read crimata-<id>.service/ cgroups under dir instead of CGROUP_ROOT_DEFAULT */
+void stats_set_root(const char *dir);
+
+/* Resample at most every ms milliseconds */
+void stats_set_interval(unsigned ms);
+
+/* Register the sampling metrics */
+void stats_init(void);
+
+/*
+ * GET /apps/stats (id NULL) or GET /apps/<id>/stats: memory, CPU time, task
+ * count and IO bytes of each app's service, read from its cgroup (v2). All
+ * apps are sampled together and the result is reused for the interval, so
+ * polling costs one cached response. 404 for an id that isn't installed.
+ */
+enum MHD_Result stats_send(struct MHD_Connection *conn, const char *id);
+
+#endif
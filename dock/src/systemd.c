@@ -1,90 +1,616 @@
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <systemd/sd-bus.h>
+#include "events.h"
+#include "loop.h"
+#include "metrics.h"
 #include "systemd.h"
 
 #define SYSTEMD_DEST  "org.freedesktop.systemd1"
 #define SYSTEMD_PATH  "/org/freedesktop/systemd1"
+#define UNIT_PREFIX   "/org/freedesktop/systemd1/unit"
 #define MANAGER_IFACE "org.freedesktop.systemd1.Manager"
 #define UNIT_IFACE    "org.freedesktop.systemd1.Unit"
 
-static sd_bus *open_bus(void)
+#define UNIT_PATTERN  "crimata-*.service"
+#define UNIT_BUCKETS  256
+
+/* Reconnect backoff after the system bus drops */
+#define RETRY_MIN_MS  1000
+#define RETRY_MAX_MS  30000
+
+#define PROPS_MATCH \
+    "type='signal',sender='" SYSTEMD_DEST "'," \
+    "interface='org.freedesktop.DBus.Properties',member='PropertiesChanged'," \
+    "path_namespace='" UNIT_PREFIX "',arg0='" UNIT_IFACE "'"
+
+#define CALL_SECONDS "crimata_dock_systemd_call_seconds"
+static metric_t m_start   = METRIC_HISTOGRAM_DEF(CALL_SECONDS, "call=\"start\"", "sd-bus round trip per systemd_* call, including the hand-off to the bus thread");
+static metric_t m_stop    = METRIC_HISTOGRAM_DEF(CALL_SECONDS, "call=\"stop\"",  "sd-bus round trip per systemd_* call, including the hand-off to the bus thread");
+static metric_t m_job     = METRIC_HISTOGRAM_DEF("crimata_dock_systemd_job_seconds", NULL,
+                                                 "Time from systemd_submit() to the job's JobRemoved signal");
+static metric_t m_signals = METRIC_COUNTER_DEF("crimata_dock_unit_state_changes_total", NULL,
+                                               "ActiveState changes applied from systemd signals");
+
+/*
+ * ActiveState of every crimata-* unit systemd has told us about. Written
+ * only on the loop thread; request threads read it under the rwlock.
+ * Entries are never removed — an unloaded unit is just inactive.
+ */
+typedef struct unit {
+    struct unit *next;
+    int          active;
+    event_type_t state;     /* last lifecycle event: EV_STARTING … EV_STOPPED */
+    unsigned     listed;    /* list_pass of the last ListUnitsByPatterns it was in */
+    char         name[];
+} unit_t;
+
+static unit_t          *units[UNIT_BUCKETS];
+static pthread_rwlock_t units_lock = PTHREAD_RWLOCK_INITIALIZER;
+static unsigned         generation;
+static unsigned         list_pass;
+static int              bus_up;
+static int              loaded;     /* init done; lists after that publish what changed */
+static unsigned         connects;   /* successful connections to the bus */
+static void           (*state_hook)(const char *id, event_type_t state);
+
+/*
+ * start/stop handed from request threads to the loop, which owns the bus.
+ * systemd_start/stop wait on the reply; systemd_submit() calls carry fn and
+ * stay on the jobs list until systemd removes the job they queued. A
+ * systemd_reload() call has no unit and is over when its reply arrives.
+ */
+typedef struct call {
+    struct call   *next;
+    const char    *method;
+    const char    *unit;
+    systemd_job_fn fn;
+    void          *arg;
+    char          *job;      /* job object path from the reply */
+    uint64_t       start;
+    int            done;
+    int            result;
+} call_t;
+
+static sd_bus         *bus;
+static int             bus_fd = -1;
+static uint64_t        retry_at;                  /* metrics_now() of the next reconnect */
+static int             retry_ms = RETRY_MIN_MS;
+static int             wake_fd = -1;
+static call_t         *calls_head, *calls_tail;
+static call_t         *jobs;    /* loop thread only */
+static pthread_mutex_t calls_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  calls_done = PTHREAD_COND_INITIALIZER;
+
+/* ── State table ──────────────────────────────────────────────────────────── */
+
+static unsigned name_hash(const char *s)
 {
-    sd_bus *bus = NULL;
-    if (sd_bus_open_system(&bus) < 0) return NULL;
-    return bus;
+    unsigned h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h % UNIT_BUCKETS;
 }
 
-int systemd_is_active(const char *unit)
+static int is_ours(const char *unit)
 {
-    sd_bus         *bus   = open_bus();
-    sd_bus_error    error = SD_BUS_ERROR_NULL;
-    sd_bus_message *reply = NULL;
-    const char     *path;
-    char           *state = NULL;
-    int             result = 0;
+    size_t n = strlen(unit);
+    return strncmp(unit, "crimata-", 8) == 0 && n > 16 &&
+           strcmp(unit + n - 8, ".service") == 0;
+}
+
+/* Lifecycle event for an ActiveState, or -1 for transitional states that don't change it */
+static int state_event(const char *active_state)
+{
+    if (strcmp(active_state, "activating") == 0) return EV_STARTING;
+    if (strcmp(active_state, "active") == 0)     return EV_ACTIVE;
+    if (strcmp(active_state, "failed") == 0)     return EV_FAILED;
+    if (strcmp(active_state, "inactive") == 0)   return EV_STOPPED;
+    return -1;
+}
 
-    if (!bus) return -1;
+/* Loop thread only; events go out once the initial list is loaded */
+static void set_state(const char *unit, const char *active_state)
+{
+    int active = strcmp(active_state, "active") == 0;
+    int event  = state_event(active_state);
 
-    /* GetUnit → object path */
-    if (sd_bus_call_method(bus, SYSTEMD_DEST, SYSTEMD_PATH, MANAGER_IFACE,
-                           "GetUnit", &error, &reply, "s", unit) < 0)
-        goto done;  /* unit doesn't exist = not running */
+    pthread_rwlock_wrlock(&units_lock);
+    unit_t **pp = &units[name_hash(unit)];
+    while (*pp && strcmp((*pp)->name, unit) != 0) pp = &(*pp)->next;
 
-    if (sd_bus_message_read(reply, "o", &path) < 0) goto done;
+    if (!*pp) {
+        size_t  len = strlen(unit) + 1;
+        unit_t *u   = malloc(sizeof(*u) + len);
+        if (u) {
+            u->next   = NULL;
+            u->active = !active;   /* counted as a change below */
+            u->state  = EV_STOPPED;
+            u->listed = 0;
+            memcpy(u->name, unit, len);
+            *pp = u;
+        }
+    }
 
-    /* Read ActiveState property */
-    if (sd_bus_get_property_string(bus, SYSTEMD_DEST, path, UNIT_IFACE,
-                                   "ActiveState", &error, &state) < 0)
+    unit_t *u = *pp;
+    if (u) u->listed = list_pass;
+    if (u && u->active != active) {
+        u->active = active;
+        __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+        metrics_inc(&m_signals);
+    }
+    int changed = u && event >= 0 && u->state != (event_type_t)event;
+    if (changed) u->state = (event_type_t)event;
+    pthread_rwlock_unlock(&units_lock);
+
+    /* crimata-<id>.service → <id> */
+    if (changed && loaded) {
+        char id[256];
+        size_t n = strlen(unit) - 16;
+        if (n < sizeof(id)) {
+            memcpy(id, unit + 8, n);
+            id[n] = '\0';
+            events_publish((event_type_t)event, id);
+            if (state_hook) state_hook(id, (event_type_t)event);
+        }
+    }
+}
+
+/* ── Signals ──────────────────────────────────────────────────────────────── */
+
+/* Load every loaded crimata-* unit with one call; unloaded ones are inactive */
+static int list_units(void)
+{
+    sd_bus_error    error = SD_BUS_ERROR_NULL;
+    sd_bus_message *m = NULL, *reply = NULL;
+    int r;
+
+    char *states[]   = { NULL };
+    char *patterns[] = { UNIT_PATTERN, NULL };
+
+    r = sd_bus_message_new_method_call(bus, &m, SYSTEMD_DEST, SYSTEMD_PATH,
+                                       MANAGER_IFACE, "ListUnitsByPatterns");
+    if (r >= 0) r = sd_bus_message_append_strv(m, states);
+    if (r >= 0) r = sd_bus_message_append_strv(m, patterns);
+    if (r >= 0) r = sd_bus_call(bus, m, 0, &error, &reply);
+    if (r < 0) {
+        fprintf(stderr, "ListUnitsByPatterns: %s\n", error.message ? error.message : strerror(-r));
         goto done;
+    }
 
-    result = (strcmp(state, "active") == 0) ? 1 : 0;
+    list_pass++;
+    r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(ssssssouso)");
+    while (r >= 0) {
+        const char *name, *active;
+        r = sd_bus_message_read(reply, "(ssssssouso)", &name, NULL, NULL, &active,
+                                NULL, NULL, NULL, NULL, NULL, NULL);
+        if (r <= 0) break;
+        if (is_ours(name)) set_state(name, active);
+    }
+    if (r >= 0) {
+        /* Units systemd no longer has loaded; only this thread changes the table */
+        for (int i = 0; i < UNIT_BUCKETS; i++)
+            for (unit_t *u = units[i]; u; u = u->next)
+                if (u->listed != list_pass) set_state(u->name, "inactive");
+    }
 
 done:
-    free(state);
     sd_bus_message_unref(reply);
+    sd_bus_message_unref(m);
     sd_bus_error_free(&error);
-    sd_bus_unref(bus);
-    return result;
+    return r < 0 ? -1 : 0;
 }
 
-int systemd_start(const char *unit)
+/* PropertiesChanged("org.freedesktop.systemd1.Unit", {..., ActiveState, ...}, [...]) */
+static int on_properties(sd_bus_message *m, void *arg, sd_bus_error *ret_error)
 {
-    sd_bus         *bus   = open_bus();
-    sd_bus_error    error = SD_BUS_ERROR_NULL;
-    sd_bus_message *reply = NULL;
-    int             result = -1;
+    (void)arg; (void)ret_error;
+    char *unit = NULL;
+
+    if (sd_bus_path_decode(sd_bus_message_get_path(m), UNIT_PREFIX, &unit) <= 0) return 0;
+    if (!is_ours(unit)) goto done;
+
+    if (sd_bus_message_skip(m, "s") < 0) goto done;
+    if (sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{sv}") < 0) goto done;
+
+    while (sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY, "sv") > 0) {
+        const char *key, *value;
+        if (sd_bus_message_read(m, "s", &key) < 0) break;
+        if (strcmp(key, "ActiveState") == 0) {
+            if (sd_bus_message_read(m, "v", "s", &value) >= 0) set_state(unit, value);
+            break;
+        }
+        if (sd_bus_message_skip(m, "v") < 0 || sd_bus_message_exit_container(m) < 0) break;
+    }
+
+done:
+    free(unit);
+    return 0;
+}
+
+/* UnitRemoved(name, path) — systemd garbage-collected an inactive unit */
+static int on_unit_removed(sd_bus_message *m, void *arg, sd_bus_error *ret_error)
+{
+    (void)arg; (void)ret_error;
+    const char *unit;
+    if (sd_bus_message_read(m, "s", &unit) > 0 && is_ours(unit))
+        set_state(unit, "inactive");
+    return 0;
+}
+
+/* Reloading(false) after daemon-reload — signals may have been missed */
+static int on_reloading(sd_bus_message *m, void *arg, sd_bus_error *ret_error)
+{
+    (void)arg; (void)ret_error;
+    int active;
+    if (sd_bus_message_read(m, "b", &active) > 0 && !active) list_units();
+    return 0;
+}
+
+/* ── Calls ────────────────────────────────────────────────────────────────── */
+
+/* Submitted calls: report the job result (NULL if it never got a job) and free */
+static void job_finish(call_t *c, const char *result)
+{
+    if (c->unit) metrics_observe(&m_job, metrics_now() - c->start);
+    c->fn(c->arg, result);
+    free(c->job);
+    free(c);
+}
+
+static void call_finish(call_t *c, int result)
+{
+    if (c->fn) {
+        job_finish(c, NULL);
+        return;
+    }
+
+    pthread_mutex_lock(&calls_lock);
+    c->result = result;
+    c->done   = 1;
+    pthread_cond_broadcast(&calls_done);
+    pthread_mutex_unlock(&calls_lock);
+}
+
+static int on_reply(sd_bus_message *m, void *arg, sd_bus_error *ret_error)
+{
+    (void)ret_error;
+    call_t     *c = arg;
+    const char *path;
+
+    if (sd_bus_message_is_method_error(m, NULL)) {
+        call_finish(c, -1);
+        return 0;
+    }
+    if (!c->fn) {
+        call_finish(c, 0);
+        return 0;
+    }
+    if (!c->unit) {
+        job_finish(c, "done");
+        return 0;
+    }
+
+    /* Replies and signals arrive in order, so JobRemoved can't have passed yet */
+    if (sd_bus_message_read(m, "o", &path) <= 0 || !(c->job = strdup(path))) {
+        call_finish(c, -1);
+        return 0;
+    }
+    c->next = jobs;
+    jobs    = c;
+    return 0;
+}
+
+/* JobRemoved(id, job, unit, result) — "done", "failed", "canceled", "timeout", … */
+static int on_job_removed(sd_bus_message *m, void *arg, sd_bus_error *ret_error)
+{
+    (void)arg; (void)ret_error;
+    uint32_t    id;
+    const char *path, *unit, *result;
+
+    if (sd_bus_message_read(m, "uoss", &id, &path, &unit, &result) <= 0) return 0;
+
+    for (call_t **pp = &jobs; *pp; pp = &(*pp)->next) {
+        if (strcmp((*pp)->job, path) == 0) {
+            call_t *c = *pp;
+            *pp = c->next;
+            job_finish(c, result);
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Loop thread: send every queued start/stop */
+static void on_wake(int fd, uint32_t events, void *arg)
+{
+    (void)events; (void)arg;
+    uint64_t n;
+    while (read(fd, &n, sizeof(n)) > 0) {}
+
+    pthread_mutex_lock(&calls_lock);
+    call_t *c = calls_head;
+    calls_head = calls_tail = NULL;
+    pthread_mutex_unlock(&calls_lock);
+
+    while (c) {
+        call_t *next = c->next;   /* c may be gone once finished */
+        int r = !bus_up ? -ENOTCONN
+            : c->unit ? sd_bus_call_method_async(bus, NULL, SYSTEMD_DEST, SYSTEMD_PATH, MANAGER_IFACE,
+                                                 c->method, on_reply, c, "ss", c->unit, "replace")
+                      : sd_bus_call_method_async(bus, NULL, SYSTEMD_DEST, SYSTEMD_PATH, MANAGER_IFACE,
+                                                 c->method, on_reply, c, "");
+        if (r < 0) call_finish(c, -1);
+        c = next;
+    }
+}
+
+static int enqueue(call_t *c)
+{
+    /* Nothing would ever read the queue */
+    if (wake_fd < 0) return -1;
+
+    pthread_mutex_lock(&calls_lock);
+    if (calls_tail) calls_tail->next = c; else calls_head = c;
+    calls_tail = c;
+    pthread_mutex_unlock(&calls_lock);
+
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) != sizeof(one)) {}
+    return 0;
+}
 
-    if (!bus) return -1;
+static int call(const char *method, const char *unit)
+{
+    call_t c = { .method = method, .unit = unit };
+    if (enqueue(&c) != 0) return -1;
+
+    pthread_mutex_lock(&calls_lock);
+    while (!c.done) pthread_cond_wait(&calls_done, &calls_lock);
+    pthread_mutex_unlock(&calls_lock);
+    return c.result;
+}
+
+/* ── Bus on the event loop ────────────────────────────────────────────────── */
+
+static void on_bus(int fd, uint32_t events, void *arg)
+{
+    (void)fd; (void)events; (void)arg;
+    /* Work happens in bus_prepare(), which runs before the next wait */
+}
+
+/* Open the system bus and load the current unit states — 0 or -1 */
+static int bus_connect(void)
+{
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    int r;
 
+    if ((r = sd_bus_open_system(&bus)) < 0) {
+        fprintf(stderr, "system bus: %s\n", strerror(-r));
+        bus = NULL;
+        return -1;
+    }
+
+    /* Matches first, so no change between them and the initial list is lost */
+    if ((r = sd_bus_add_match(bus, NULL, PROPS_MATCH, on_properties, NULL)) < 0 ||
+        (r = sd_bus_match_signal(bus, NULL, SYSTEMD_DEST, SYSTEMD_PATH, MANAGER_IFACE,
+                                 "UnitRemoved", on_unit_removed, NULL)) < 0 ||
+        (r = sd_bus_match_signal(bus, NULL, SYSTEMD_DEST, SYSTEMD_PATH, MANAGER_IFACE,
+                                 "JobRemoved", on_job_removed, NULL)) < 0 ||
+        (r = sd_bus_match_signal(bus, NULL, SYSTEMD_DEST, SYSTEMD_PATH, MANAGER_IFACE,
+                                 "Reloading", on_reloading, NULL)) < 0) {
+        fprintf(stderr, "system bus match: %s\n", strerror(-r));
+        goto fail;
+    }
+
+    /* Without a subscriber systemd doesn't emit unit signals */
     if (sd_bus_call_method(bus, SYSTEMD_DEST, SYSTEMD_PATH, MANAGER_IFACE,
-                           "StartUnit", &error, &reply,
-                           "ss", unit, "replace") >= 0)
-        result = 0;
+                           "Subscribe", &error, NULL, "") < 0) {
+        fprintf(stderr, "Subscribe: %s\n", error.message ? error.message : "failed");
+        sd_bus_error_free(&error);
+        goto fail;
+    }
 
-    sd_bus_message_unref(reply);
-    sd_bus_error_free(&error);
-    sd_bus_unref(bus);
-    return result;
+    if (list_units() != 0) goto fail;
+
+    bus_fd = sd_bus_get_fd(bus);
+    if (loop_add(bus_fd, EPOLLIN, on_bus, NULL) != 0) goto fail;
+    return 0;
+
+fail:
+    bus    = sd_bus_flush_close_unref(bus);
+    bus_fd = -1;
+    return -1;
+}
+
+/*
+ * The connection is gone: fail what was waiting on it and close it. The
+ * prepare hook reconnects with backoff; until then every unit reads as
+ * unknown and start/stop fail fast.
+ */
+static void bus_down(int r)
+{
+    fprintf(stderr, "system bus: %s — reconnecting\n", strerror(-r));
+    __atomic_store_n(&bus_up, 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+
+    /* Their JobRemoved will never arrive */
+    while (jobs) {
+        call_t *c = jobs;
+        jobs = c->next;
+        job_finish(c, NULL);
+    }
+
+    loop_del(bus_fd);
+    bus      = sd_bus_flush_close_unref(bus);
+    bus_fd   = -1;
+    retry_ms = RETRY_MIN_MS;
+    retry_at = metrics_now() + (uint64_t)retry_ms * 1000000;
+}
+
+/* Try the bus again once retry_at has passed — ms until the next try, or -1 once up */
+static int bus_retry(void)
+{
+    uint64_t now = metrics_now();
+    if (now < retry_at) return (int)((retry_at - now + 999999) / 1000000);
+
+    if (bus_connect() != 0) {
+        retry_ms = retry_ms * 2 < RETRY_MAX_MS ? retry_ms * 2 : RETRY_MAX_MS;
+        retry_at = now + (uint64_t)retry_ms * 1000000;
+        return retry_ms;
+    }
+
+    fprintf(stderr, "system bus: connected\n");
+    __atomic_add_fetch(&connects, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&bus_up, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+    return -1;
+}
+
+/* Dispatch whatever sd-bus has queued, then tell the loop what to wait for */
+static int bus_prepare(void *arg)
+{
+    (void)arg;
+    if (!bus_up) {
+        int t = bus_retry();
+        if (t >= 0) return t;
+    }
+
+    /* Once the link drops sd-bus fails each pending call here, then returns < 0 */
+    int r;
+    while ((r = sd_bus_process(bus, NULL)) > 0) {}
+    if (r < 0) {
+        bus_down(r);
+        return retry_ms;
+    }
+
+    int events = sd_bus_get_events(bus);
+    loop_mod(bus_fd, events > 0 ? (uint32_t)events : EPOLLIN);
+
+    uint64_t until;
+    if (sd_bus_get_timeout(bus, &until) < 0 || until == UINT64_MAX) return -1;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+    return until <= now ? 0 : (int)((until - now + 999) / 1000);
+}
+
+int systemd_init(void)
+{
+    metrics_register(&m_start);
+    metrics_register(&m_stop);
+    metrics_register(&m_job);
+    metrics_register(&m_signals);
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0 || loop_add(wake_fd, EPOLLIN, on_wake, NULL) != 0) return -1;
+
+    if (loop_add_prepare(bus_prepare, NULL) != 0) return -1;
+
+    /* A bus that isn't up yet (dbus still starting) is retried like one that dropped */
+    loaded = 1;
+    if (bus_connect() != 0) {
+        fprintf(stderr, "system bus: not connected — retrying\n");
+        retry_at = metrics_now() + (uint64_t)retry_ms * 1000000;
+        return 0;
+    }
+    connects = 1;
+    bus_up   = 1;
+    return 0;
+}
+
+unsigned systemd_generation(void)
+{
+    return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}
+
+unsigned systemd_connects(void)
+{
+    return __atomic_load_n(&connects, __ATOMIC_ACQUIRE);
+}
+
+int systemd_is_active(const char *unit)
+{
+    if (!__atomic_load_n(&bus_up, __ATOMIC_RELAXED)) return -1;
+
+    int active = 0;
+    pthread_rwlock_rdlock(&units_lock);
+    for (const unit_t *u = units[name_hash(unit)]; u; u = u->next) {
+        if (strcmp(u->name, unit) == 0) {
+            active = u->active;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&units_lock);
+    return active;
+}
+
+int systemd_start(const char *unit)
+{
+    uint64_t start = metrics_now();
+    int r = call("StartUnit", unit);
+    metrics_observe(&m_start, metrics_now() - start);
+    return r;
 }
 
 int systemd_stop(const char *unit)
 {
-    sd_bus         *bus   = open_bus();
-    sd_bus_error    error = SD_BUS_ERROR_NULL;
-    sd_bus_message *reply = NULL;
-    int             result = -1;
+    uint64_t start = metrics_now();
+    int r = call("StopUnit", unit);
+    metrics_observe(&m_stop, metrics_now() - start);
+    return r;
+}
 
-    if (!bus) return -1;
+int systemd_submit(int start, const char *unit, systemd_job_fn fn, void *arg)
+{
+    if (wake_fd < 0) return -1;
 
-    if (sd_bus_call_method(bus, SYSTEMD_DEST, SYSTEMD_PATH, MANAGER_IFACE,
-                           "StopUnit", &error, &reply,
-                           "ss", unit, "replace") >= 0)
-        result = 0;
+    size_t  len = strlen(unit) + 1;
+    call_t *c   = calloc(1, sizeof(*c) + len);
+    if (!c) return -1;
 
-    sd_bus_message_unref(reply);
-    sd_bus_error_free(&error);
-    sd_bus_unref(bus);
-    return result;
+    memcpy(c + 1, unit, len);
+    c->method = start ? "StartUnit" : "StopUnit";
+    c->unit   = (const char *)(c + 1);
+    c->fn     = fn;
+    c->arg    = arg;
+    c->start  = metrics_now();
+    if (enqueue(c) != 0) {
+        free(c);
+        return -1;
+    }
+    return 0;
+}
+
+int systemd_reload(systemd_job_fn fn, void *arg)
+{
+    if (wake_fd < 0) return -1;
+
+    call_t *c = calloc(1, sizeof(*c));
+    if (!c) return -1;
+
+    c->method = "Reload";
+    c->fn     = fn;
+    c->arg    = arg;
+    c->start  = metrics_now();
+    if (enqueue(c) != 0) {
+        free(c);
+        return -1;
+    }
+    return 0;
+}
+
+void systemd_set_state_hook(void (*fn)(const char *id, event_type_t state))
+{
+    state_hook = fn;
 }
@@ -1,11 +1,51 @@
 #ifndef SYSTEMD_H
 #define SYSTEMD_H
 
-/* Returns 1 if active, 0 if inactive/not found, -1 on error */
+#include "events.h"
+
+/*
+ * Connect to the system bus on the event loop (after loop_init(), before
+ * loop_start()), load the state of every crimata-*.service and keep it
+ * current from systemd's signals. A bus that can't be reached, now or
+ * later, is retried with backoff; until then systemd_is_active() is -1 and
+ * calls fail. Returns 0, or -1 if the loop can't host the bus.
+ */
+int  systemd_init(void);
+
+/* From the cached state: 1 if active, 0 if inactive/not found, -1 if the bus is down */
 int  systemd_is_active(const char *unit);
 
+/* Bumped whenever a cached state changes, so callers can tell when to refresh */
+unsigned systemd_generation(void);
+
+/* Bumped on every connection to the bus, the first included — a reconnect means calls made meanwhile failed */
+unsigned systemd_connects(void);
+
 /* Returns 0 on success, -1 on error */
 int  systemd_start(const char *unit);
 int  systemd_stop(const char *unit);
 
+/*
+ * Called on the event loop thread when a submitted job is over. result is
+ * systemd's JobRemoved result ("done", "failed", "canceled", "timeout",
+ * "dependency", "skipped"), or NULL if the call itself failed.
+ */
+typedef void (*systemd_job_fn)(void *arg, const char *result);
+
+/*
+ * Queue StartUnit (start != 0) or StopUnit for unit without waiting, and
+ * call fn once systemd has finished the job — any thread, fn never runs
+ * before this returns. Returns 0, or -1 (fn is not called).
+ */
+int  systemd_submit(int start, const char *unit, systemd_job_fn fn, void *arg);
+
+/* daemon-reload without waiting; fn gets "done", or NULL if it failed — 0 or -1 */
+int  systemd_reload(systemd_job_fn fn, void *arg);
+
+/*
+ * Have fn told, on the event loop thread, whenever an app's service changes
+ * lifecycle state — the same changes that go out on /apps/events.
+ */
+void systemd_set_state_hook(void (*fn)(const char *id, event_type_t state));
+
 #endif
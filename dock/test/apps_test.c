@@ -0,0 +1,101 @@
+/*
+ * apps_test — manifests whose id can't become a unit name stay out of the
+ * registry. Builds a throwaway apps directory, loads it with apps_init()
+ * and checks what made it in. Run with `make test` in dock/.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "apps.h"
+#include "events.h"
+#include "loop.h"
+
+/* The registry announces changes; nothing subscribes here */
+void events_publish(event_type_t type, const char *id)
+{
+    (void)type; (void)id;
+}
+
+static int failures;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+            failures++;                                                    \
+        }                                                                  \
+    } while (0)
+
+static void write_manifest(const char *dir, const char *pkg, const char *id_json)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, pkg);
+    if (mkdir(path, 0755) != 0) {
+        perror(path);
+        exit(1);
+    }
+    snprintf(path, sizeof(path), "%s/%s/crimata.json", dir, pkg);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(f, "{\"id\": %s, \"name\": \"Test\", \"port\": 4000}\n", id_json);
+    fclose(f);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/crimata-apps-test.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    write_manifest(dir, "crimata-good",      "\"good\"");
+    write_manifest(dir, "crimata-dotted",    "\"my.app_2:x-y\"");
+    write_manifest(dir, "crimata-newline",   "\"a\\nb\"");
+    write_manifest(dir, "crimata-injection", "\"x\\n[Service]\\nExecStartPre=/bin/true\"");
+    write_manifest(dir, "crimata-space",     "\"a b\"");
+    write_manifest(dir, "crimata-slash",     "\"a/b\"");
+    write_manifest(dir, "crimata-backslash", "\"a\\\\b\"");
+
+    CHECK(apps_valid_id("contacts"));
+    CHECK(!apps_valid_id(""));
+    CHECK(!apps_valid_id("a\nb"));
+
+    char long_id[MAX_STR + 1];
+    memset(long_id, 'a', MAX_STR);
+    long_id[MAX_STR] = '\0';
+    CHECK(!apps_valid_id(long_id));
+    long_id[MAX_STR - 1] = '\0';
+    CHECK(apps_valid_id(long_id));
+
+    apps_set_dir(dir);
+    if (loop_init() != 0 || apps_init() != 0) {
+        fprintf(stderr, "apps_init failed\n");
+        return 1;
+    }
+
+    const apps_snapshot_t *snap = apps_acquire();
+    CHECK(snap->count == 2);
+    CHECK(apps_find(snap, "good") != NULL);
+    CHECK(apps_find(snap, "my.app_2:x-y") != NULL);
+    CHECK(apps_find(snap, "a\nb") == NULL);
+    for (int i = 0; i < snap->count; i++)
+        CHECK(apps_valid_id(snap->apps[i]->id));
+    apps_release(snap);
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0) {}
+
+    if (failures) {
+        fprintf(stderr, "apps_test: %d failed\n", failures);
+        return 1;
+    }
+    printf("apps_test: ok\n");
+    return 0;
+}
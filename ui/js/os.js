@@ -13,15 +13,7 @@ function connectWS() {
 
   ws.onopen = () => console.log('agent connected')
 
-  ws.onmessage = (e) => {
-    const msg = JSON.parse(e.data)
-    switch (msg.op) {
-      case 'render':          renderEl(msg.element);              break
-      case 'remove':          removeEl(msg.id);                   break
-      case 'canvas':          msg.elements.forEach(renderEl);     break
-      case 'cursor_response': showCursorResponse(msg);            break
-    }
-  }
+  ws.onmessage = (e) => applyOp(JSON.parse(e.data))
 
   ws.onclose = () => {
     console.log('agent disconnected — reconnecting in 2s')
@@ -29,6 +21,17 @@ function connectWS() {
   }
 }
 
+// A batch is one agent turn — applied in one go, so its windows appear together
+function applyOp(msg) {
+  switch (msg.op) {
+    case 'render':          renderEl(msg.element);              break
+    case 'remove':          removeEl(msg.id);                   break
+    case 'canvas':          msg.elements.forEach(renderEl);     break
+    case 'cursor_response': showCursorResponse(msg);            break
+    case 'batch':           msg.ops.forEach(applyOp);           break
+  }
+}
+
 function sendEvent(event) {
   if (ws && ws.readyState === WebSocket.OPEN)
     ws.send(JSON.stringify(event))